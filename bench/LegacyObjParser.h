@@ -0,0 +1,7 @@
+#pragma once
+#include "render/Mesh.h"
+#include <string>
+#include <vector>
+
+void LoadObjLegacy(const std::string &path, std::vector<Vertex> &outVertices,
+                   std::vector<unsigned int> &outIndices);
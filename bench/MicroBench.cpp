@@ -0,0 +1,973 @@
+// Micro benchmarks for engine subsystems that don't need a GL context.
+//
+//   RenderCoreMicroBench [--filter name] [--obj path] [--grid N]
+//                        [--threads N] [--repeat N] [--objects dir]
+//                        [--entities N]
+#include "App.h"
+#include "LegacyObjParser.h"
+#include "components/MaterialComponent.h"
+#include "components/MeshComponent.h"
+#include "components/PointLightComponent.h"
+#include "components/ShaderComponent.h"
+#include "components/TransformComponent.h"
+#include "core/HandlePool.h"
+#include "core/Profiler.h"
+#include "core/ThreadPool.h"
+#include "glm/geometric.hpp"
+#include "managers/MeshManager.h"
+#include "managers/PrefabManager.h"
+#include "managers/WorldStreamer.h"
+#include "render/ObjParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+struct Options {
+  std::string filter;
+  std::string objPath;
+  unsigned int grid = 1024; // 1024 x 1024 quads, about 2M triangles
+  unsigned int threads = 0;
+  unsigned int repeat = 3;
+  std::string objectsDir = "resources/objects";
+  unsigned int entities = 0; // 0: each benchmark's own sizes
+};
+
+struct Benchmark {
+  const char *name;
+  std::function<void(const Options &)> run;
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// best of n runs, the first one also warms the page cache
+template <typename Fn> double BestOf(unsigned int n, Fn fn) {
+  double best = 1e30;
+  for (unsigned int i = 0; i < n; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    best = std::min(best, Seconds(start));
+  }
+  return best;
+}
+
+// Resident set size from /proc/self/status ("VmRSS", "VmHWM"), in MB; 0
+// where there is no procfs
+double ReadRssMB(const std::string &field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, field.size() + 1, field + ":") == 0)
+      return std::stod(line.substr(field.size() + 1)) / 1024.0;
+  return 0.0;
+}
+
+// Starts a new peak RSS measurement, returns the current RSS
+double ResetPeakRss() {
+#ifdef __GLIBC__
+  malloc_trim(0); // so memory freed by the previous step doesn't count
+#endif
+  std::ofstream("/proc/self/clear_refs") << "5";
+  return ReadRssMB("VmRSS");
+}
+
+// Heightfield with positions, uvs and normals, written as quads
+std::string WriteGridObj(unsigned int n) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("rendercore_grid_" + std::to_string(n) + ".obj");
+  if (std::filesystem::exists(path))
+    return path.string();
+
+  std::ofstream out(path);
+  char line[128];
+  for (unsigned int y = 0; y <= n; ++y) {
+    for (unsigned int x = 0; x <= n; ++x) {
+      float fx = float(x) / n, fy = float(y) / n;
+      std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", fx * 10.0f,
+                    0.25f * (fx - 0.5f) * (fy - 0.5f), fy * 10.0f);
+      out << line;
+      std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", fx, fy);
+      out << line;
+      std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", 0.0f, 1.0f,
+                    0.0f);
+      out << line;
+    }
+  }
+  for (unsigned int y = 0; y < n; ++y) {
+    for (unsigned int x = 0; x < n; ++x) {
+      unsigned int a = y * (n + 1) + x + 1, b = a + 1, c = b + n + 1,
+                   d = a + n + 1;
+      std::snprintf(line, sizeof(line),
+                    "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b,
+                    b, c, c, c, d, d, d);
+      out << line;
+    }
+  }
+  return path.string();
+}
+
+void ObjParse(const Options &options) {
+  std::string path =
+      options.objPath.empty() ? WriteGridObj(options.grid) : options.objPath;
+  double megabytes = double(std::filesystem::file_size(path)) / (1 << 20);
+  unsigned int threads = options.threads
+                             ? options.threads
+                             : std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<Vertex> legacyVertices, vertices;
+  std::vector<unsigned int> legacyIndices, indices;
+
+  double legacy = BestOf(options.repeat, [&] {
+    legacyVertices.clear();
+    legacyIndices.clear();
+    LoadObjLegacy(path, legacyVertices, legacyIndices);
+  });
+  double single = BestOf(options.repeat, [&] {
+    ObjParser::Parse(path, vertices, indices, 1);
+  });
+  double parallel = BestOf(options.repeat, [&] {
+    ObjParser::Parse(path, vertices, indices, threads);
+  });
+
+  bool match = legacyIndices == indices &&
+               legacyVertices.size() == vertices.size();
+  for (size_t i = 0; match && i < vertices.size(); ++i)
+    match = std::memcmp(&legacyVertices[i], &vertices[i], sizeof(Vertex)) == 0;
+
+  std::printf("obj_parse: %s, %.1f MB, %zu triangles, %zu vertices\n",
+              path.c_str(), megabytes, indices.size() / 3, vertices.size());
+  std::printf("  %-22s %8.3f s %9.1f MB/s\n", "legacy (getline)", legacy,
+              megabytes / legacy);
+  std::printf("  %-22s %8.3f s %9.1f MB/s  %5.1fx\n", "ObjParser, 1 thread",
+              single, megabytes / single, legacy / single);
+  std::printf("  %-22s %8.3f s %9.1f MB/s  %5.1fx  (%u threads)\n",
+              "ObjParser, parallel", parallel, megabytes / parallel,
+              legacy / parallel, threads);
+  std::printf("  output %s the legacy parser\n",
+              match ? "matches" : "DIFFERS from");
+}
+
+// Import without and with a valid .rcmesh entry, GL upload excluded
+void MeshCacheLoad(const Options &options) {
+  auto cacheDir = std::filesystem::temp_directory_path() / "rendercore_cache";
+  std::vector<std::string> paths;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(options.objectsDir))
+    if (entry.path().extension() == ".obj")
+      paths.push_back(entry.path().string());
+  std::sort(paths.begin(), paths.end());
+
+  std::printf("mesh_cache: %s\n", options.objectsDir.c_str());
+  std::printf("  %-36s %9s %9s %10s %10s %7s\n", "asset", "obj KB",
+              "cache KB", "cold ms", "warm ms", "speedup");
+  for (const std::string &path : paths) {
+    MeshManager manager;
+    manager.GetCache().SetDirectory(cacheDir.string());
+    std::string entryPath = manager.GetCache().GetEntryPath(path);
+    std::filesystem::remove(entryPath);
+
+    double cold = BestOf(1, [&] {
+      MeshAsset asset;
+      manager.LoadAsset(path, asset);
+    });
+    bool hit = true;
+    double warm = BestOf(options.repeat, [&] {
+      MeshAsset asset;
+      manager.LoadAsset(path, asset);
+      hit &= asset.fromCache;
+    });
+
+    std::printf("  %-36s %9.1f %9.1f %10.3f %10.3f %6.1fx%s\n", path.c_str(),
+                std::filesystem::file_size(path) / 1024.0,
+                std::filesystem::file_size(entryPath) / 1024.0, cold * 1e3,
+                warm * 1e3, cold / warm, hit ? "" : "  (cache MISSED)");
+  }
+  std::filesystem::remove_all(cacheDir);
+}
+
+// Scene benchmarks request resources without workers or uploads, so no GL
+// context is needed
+struct SceneResources {
+  explicit SceneResources(const std::string &cacheDir) {
+    meshes.GetCache().SetDirectory(cacheDir);
+    context.meshes = &meshes;
+    context.shaders = &shaders;
+  }
+
+  MeshManager meshes;
+  ShaderManager shaders;
+  ResourceContext context;
+};
+
+// 100 x 100 layers 3 units apart
+glm::vec3 StackedGrid(unsigned int i) {
+  return glm::vec3(i % 100, (i / 100) % 100, i / 10000) * 3.0f;
+}
+
+// Lit cubes at position(i), every 50th one a point light
+void BuildSyntheticScene(
+    Coordinator &coordinator, ResourceContext &resources,
+    const Options &options, unsigned int entities,
+    const std::function<glm::vec3(unsigned int)> &position = StackedGrid) {
+  MeshId mesh =
+      resources.meshes->LoadMeshAsync(options.objectsDir + "/cube.obj");
+  ShaderId shader = resources.shaders->LoadShaderAsync(
+      "resources/shaders/default.frag", "resources/shaders/default.vert");
+  for (unsigned int i = 0; i < entities; ++i) {
+    Entity entity = coordinator.CreateEntity();
+    TransformComponent transform{};
+    transform.mPosition = position(i);
+    coordinator.AddComponent(entity, transform);
+    coordinator.AddComponent(entity, MeshComponent{mesh});
+    ShaderComponent shaderComponent{};
+    shaderComponent.mId = shader;
+    coordinator.AddComponent(entity, shaderComponent);
+    coordinator.AddComponent(entity, MaterialComponent{});
+    if (i % 50 == 0)
+      coordinator.AddComponent(entity, PointLightComponent{});
+  }
+}
+
+void SceneLoad(const Options &options) {
+  auto cacheDir = std::filesystem::temp_directory_path() / "rendercore_cache";
+  unsigned int entities = options.entities ? options.entities : 100000;
+  SceneResources resources(cacheDir.string());
+  SerializationRegistry registry = App::RegisterSerializeDefaultComponents();
+
+  std::string text;
+  {
+    Coordinator coordinator;
+    App::RegisterDefaultComponents(coordinator);
+    BuildSyntheticScene(coordinator, resources.context, options, entities);
+    SceneManager scenes(coordinator, registry, resources.context);
+    text = scenes.SerializeScene().dump();
+  }
+
+  // deserialization alone on the calling thread, then with a worker pool
+  // like the engine's (--threads N workers, as many as hardware threads
+  // less one by default)
+  auto run = [&](ThreadPool *workers, double &parse, double &deserialize,
+                 size_t &loaded) {
+    resources.meshes.SetWorkers(workers);
+    resources.shaders.SetWorkers(workers);
+    for (unsigned int i = 0; i < options.repeat; ++i) {
+      Coordinator coordinator;
+      App::RegisterDefaultComponents(coordinator);
+      SceneManager scenes(coordinator, registry, resources.context);
+      scenes.SetWorkers(workers);
+
+      auto start = std::chrono::steady_clock::now();
+      Json scene = Json::parse(text);
+      parse = std::min(parse, Seconds(start));
+      start = std::chrono::steady_clock::now();
+      scenes.DeserializeScene(scene);
+      deserialize = std::min(deserialize, Seconds(start));
+      loaded = coordinator.GetAllEntities().size();
+      if (workers)
+        workers->WaitIdle();
+    }
+    resources.meshes.SetWorkers(nullptr);
+    resources.shaders.SetWorkers(nullptr);
+  };
+
+  double parse = 1e30, serial = 1e30, parallel = 1e30;
+  size_t loaded = 0;
+  run(nullptr, parse, serial, loaded);
+  ThreadPool workers(options.threads);
+  run(&workers, parse, parallel, loaded);
+
+  std::printf("scene_load: %u entities, %.1f MB of JSON\n", entities,
+              text.size() / 1e6);
+  std::printf("  %-22s %8.1f ms\n", "parse", parse * 1e3);
+  std::printf("  %-22s %8.1f ms  %zu entities\n", "deserialize, 1 thread",
+              serial * 1e3, loaded);
+  std::printf("  %-22s %8.1f ms  %5.1fx  (%zu threads)\n",
+              "deserialize, parallel", parallel * 1e3, serial / parallel,
+              workers.GetThreadCount() + 1);
+  std::filesystem::remove_all(cacheDir);
+}
+
+// Save and load of the same scene through JSON and .rcscene files
+void SceneFormat(const Options &options) {
+  auto dir = std::filesystem::temp_directory_path() / "rendercore_scenes";
+  std::filesystem::create_directories(dir);
+  std::vector<unsigned int> sizes = {10000, 100000, 1000000};
+  if (options.entities)
+    sizes = {options.entities};
+  SceneResources resources((dir / "cache").string());
+  SerializationRegistry registry = App::RegisterSerializeDefaultComponents();
+
+  struct Result {
+    unsigned int entities;
+    double jsonSave, jsonLoad, binarySave, binaryLoad;
+    double jsonMB, binaryMB;
+  };
+  std::vector<Result> results;
+
+  for (unsigned int entities : sizes) {
+    std::string jsonPath = (dir / "scene.json").string();
+    std::string binaryPath =
+        (dir / (std::string("scene") + SceneManager::BINARY_EXTENSION))
+            .string();
+    Result result{entities, 1e30, 1e30, 1e30, 1e30, 0, 0};
+    {
+      Coordinator coordinator;
+      App::RegisterDefaultComponents(coordinator);
+      BuildSyntheticScene(coordinator, resources.context, options, entities);
+      SceneManager scenes(coordinator, registry, resources.context);
+      // binary first, writing the JSON leaves the page cache busy flushing
+      result.binarySave =
+          BestOf(options.repeat, [&] { scenes.SaveScene(binaryPath); });
+      result.jsonSave =
+          BestOf(options.repeat, [&] { scenes.SaveScene(jsonPath); });
+    }
+
+    auto load = [&](const std::string &path) {
+      double best = 1e30;
+      for (unsigned int i = 0; i < options.repeat; ++i) {
+        Coordinator coordinator;
+        App::RegisterDefaultComponents(coordinator);
+        SceneManager scenes(coordinator, registry, resources.context);
+        auto start = std::chrono::steady_clock::now();
+        scenes.LoadScene(path);
+        best = std::min(best, Seconds(start));
+      }
+      return best;
+    };
+    result.jsonLoad = load(jsonPath);
+    result.binaryLoad = load(binaryPath);
+    result.jsonMB = std::filesystem::file_size(jsonPath) / 1e6;
+    result.binaryMB = std::filesystem::file_size(binaryPath) / 1e6;
+    results.push_back(result);
+  }
+
+  std::printf("scene_format: cubes with transform, mesh, shader, material\n");
+  std::printf("  %9s %10s %10s %10s %10s %10s %10s %8s\n", "entities",
+              "json MB", "save ms", "load ms", "bin MB", "save ms",
+              "load ms", "load x");
+  for (const Result &r : results)
+    std::printf("  %9u %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %7.1fx\n",
+                r.entities, r.jsonMB, r.jsonSave * 1e3, r.jsonLoad * 1e3,
+                r.binaryMB, r.binarySave * 1e3, r.binaryLoad * 1e3,
+                r.jsonLoad / r.binaryLoad);
+  std::filesystem::remove_all(dir);
+}
+
+// Whole-document JSON (the old load/save) against the streaming reader and
+// writer SceneManager uses, with the peak RSS each one adds
+void SceneStream(const Options &options) {
+  auto dir = std::filesystem::temp_directory_path() / "rendercore_scenes";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "scene.json").string();
+  std::vector<unsigned int> sizes = {100000, 1000000};
+  if (options.entities)
+    sizes = {options.entities};
+  SceneResources resources((dir / "cache").string());
+  SerializationRegistry registry = App::RegisterSerializeDefaultComponents();
+
+  struct Step {
+    const char *name;
+    double seconds;
+    double peakMB;
+  };
+
+  for (unsigned int entities : sizes) {
+    std::vector<Step> steps;
+    auto measure = [&](const char *name, const std::function<void()> &fn) {
+      double baseline = ResetPeakRss();
+      auto start = std::chrono::steady_clock::now();
+      fn();
+      double seconds = Seconds(start);
+      steps.push_back({name, seconds, ReadRssMB("VmHWM") - baseline});
+    };
+
+    {
+      Coordinator coordinator;
+      App::RegisterDefaultComponents(coordinator);
+      BuildSyntheticScene(coordinator, resources.context, options, entities);
+      SceneManager scenes(coordinator, registry, resources.context);
+      measure("save, document", [&] {
+        std::ofstream(path, std::ios::binary) << scenes.SerializeScene();
+      });
+      measure("save, streaming", [&] { scenes.SaveJsonScene(path); });
+    }
+    double megabytes = std::filesystem::file_size(path) / 1e6;
+
+    auto load = [&](const char *name, bool streaming) {
+      Coordinator coordinator;
+      App::RegisterDefaultComponents(coordinator);
+      SceneManager scenes(coordinator, registry, resources.context);
+      measure(name, [&] {
+        if (streaming) {
+          scenes.LoadJsonScene(path);
+        } else {
+          Json scene;
+          std::ifstream(path, std::ios::binary) >> scene;
+          scenes.DeserializeScene(scene);
+        }
+      });
+    };
+    load("load, document", false);
+    load("load, streaming", true);
+
+    std::printf("scene_stream: %u entities, %.1f MB of JSON\n", entities,
+                megabytes);
+    std::printf("  %-22s %10s %10s %14s\n", "", "ms", "MB/s",
+                "peak RSS +MB");
+    for (const Step &step : steps)
+      std::printf("  %-22s %10.1f %10.1f %14.1f\n", step.name,
+                  step.seconds * 1e3, megabytes / step.seconds, step.peakMB);
+  }
+  std::filesystem::remove_all(dir);
+}
+
+// Autosave of a world where 1% of the entities changed: a delta appended to
+// the log against a full snapshot, and the load of snapshot plus log
+void SceneDelta(const Options &options) {
+  auto dir = std::filesystem::temp_directory_path() / "rendercore_scenes";
+  std::filesystem::create_directories(dir);
+  std::string path =
+      (dir / (std::string("scene") + SceneManager::BINARY_EXTENSION)).string();
+  unsigned int entities = options.entities ? options.entities : 100000;
+  SceneResources resources((dir / "cache").string());
+  SerializationRegistry registry = App::RegisterSerializeDefaultComponents();
+
+  // entities sorted by id, the order a world keeps them in varies
+  auto snapshot = [](SceneManager &scenes) {
+    Json scene = scenes.SerializeScene();
+    std::vector<Json> &list = scene["entities"].get_ref<Json::array_t &>();
+    std::sort(list.begin(), list.end(), [](const Json &a, const Json &b) {
+      return a["id"].get<Entity>() < b["id"].get<Entity>();
+    });
+    return scene.dump();
+  };
+
+  Coordinator coordinator;
+  App::RegisterDefaultComponents(coordinator);
+  BuildSyntheticScene(coordinator, resources.context, options, entities);
+  SceneManager scenes(coordinator, registry, resources.context);
+  double fullSave = BestOf(options.repeat, [&] { scenes.SaveScene(path); });
+
+  // every 100th entity moves; the first round also destroys a tenth of
+  // those and spawns as many
+  std::vector<Entity> touched;
+  for (Entity e : coordinator.GetAllEntities())
+    if (e % 100 == 0)
+      touched.push_back(e);
+  double deltaSave = 1e30;
+  size_t changed = 0;
+  for (unsigned int round = 0; round < options.repeat; ++round) {
+    for (size_t i = 0; i < touched.size(); ++i) {
+      if (!coordinator.IsAlive(touched[i]))
+        continue;
+      if (round == 0 && i % 10 == 5) {
+        coordinator.DestroyEntity(touched[i]);
+        Entity spawned = coordinator.CreateEntity();
+        coordinator.AddComponent(spawned, TransformComponent{});
+        coordinator.AddComponent(spawned, MaterialComponent{});
+        continue;
+      }
+      coordinator.GetComponent<TransformComponent>(touched[i]).mPosition.y +=
+          1.0f;
+      coordinator.MarkChanged(touched[i]);
+    }
+    changed = coordinator.GetChangedEntities().size();
+    auto start = std::chrono::steady_clock::now();
+    scenes.SaveSceneDelta(path);
+    deltaSave = std::min(deltaSave, Seconds(start));
+  }
+  std::string expected = snapshot(scenes);
+  double logKB =
+      std::filesystem::file_size(SceneManager::GetDeltaLogPath(path)) / 1024.0;
+
+  Coordinator loadedWorld;
+  App::RegisterDefaultComponents(loadedWorld);
+  SceneManager loaded(loadedWorld, registry, resources.context);
+  auto start = std::chrono::steady_clock::now();
+  loaded.LoadScene(path);
+  double load = Seconds(start);
+  bool equal = snapshot(loaded) == expected;
+  start = std::chrono::steady_clock::now();
+  scenes.SaveScene(path);
+  double compact = Seconds(start);
+
+  std::printf("scene_delta: %u entities, %zu changed per save\n", entities,
+              changed);
+  std::printf("  %-26s %8.1f ms\n", "full save", fullSave * 1e3);
+  std::printf("  %-26s %8.1f ms  %5.0fx  (log %.1f KB after %u saves)\n",
+              "delta save", deltaSave * 1e3, fullSave / deltaSave, logKB,
+              options.repeat);
+  std::printf("  %-26s %8.1f ms  %s\n", "load snapshot + log", load * 1e3,
+              equal ? "same world" : "DIFFERENT WORLD");
+  std::printf("  %-26s %8.1f ms\n", "compaction", compact * 1e3);
+  std::filesystem::remove_all(dir);
+}
+
+// A flat world of cubes 2 units apart, split into cells and streamed
+// around a camera flying across it at 600 units/s. Frames are paced at
+// 60 Hz so the workers read cells in between, like in the engine.
+void WorldStream(const Options &options) {
+  auto dir = std::filesystem::temp_directory_path() / "rendercore_world";
+  std::filesystem::remove_all(dir);
+  unsigned int entities = options.entities ? options.entities : 1000000;
+  unsigned int side = static_cast<unsigned int>(std::ceil(std::sqrt(entities)));
+  constexpr float SPACING = 2.0f;
+  constexpr float CELL_SIZE = 64.0f;
+  float extent = side * SPACING;
+  SceneResources resources((dir / "cache").string());
+  SerializationRegistry registry = App::RegisterSerializeDefaultComponents();
+
+  double partition;
+  {
+    Coordinator coordinator;
+    App::RegisterDefaultComponents(coordinator);
+    BuildSyntheticScene(coordinator, resources.context, options, entities,
+                        [&](unsigned int i) {
+                          return glm::vec3(i % side, 0, i / side) * SPACING;
+                        });
+    SceneManager scenes(coordinator, registry, resources.context);
+    auto start = std::chrono::steady_clock::now();
+    WorldStreamer::PartitionWorld(coordinator, scenes, dir.string(),
+                                  CELL_SIZE);
+    partition = Seconds(start);
+  }
+
+  Coordinator coordinator;
+  App::RegisterDefaultComponents(coordinator);
+  SceneManager scenes(coordinator, registry, resources.context);
+  ThreadPool workers(options.threads);
+  WorldStreamer streamer(coordinator, scenes);
+  streamer.SetWorkers(&workers);
+  streamer.Open(dir.string());
+  const StreamingSettings &settings = streamer.GetSettings();
+
+  // corner to corner, then back along the middle
+  constexpr double FRAME = 1.0 / 60.0;
+  constexpr float SPEED = 600.0f;
+  std::vector<glm::vec3> path = {glm::vec3(0.0f, 10.0f, 0.0f),
+                                 glm::vec3(extent, 10.0f, extent),
+                                 glm::vec3(0.0f, 10.0f, extent * 0.5f)};
+  std::vector<double> updates;
+  size_t maxEntities = 0, maxBytes = 0, popIn = 0;
+  auto frameStart = std::chrono::steady_clock::now();
+  for (size_t leg = 0; leg + 1 < path.size(); ++leg) {
+    glm::vec3 delta = path[leg + 1] - path[leg];
+    float length = glm::length(delta);
+    size_t frames = static_cast<size_t>(length / (SPEED * FRAME)) + 1;
+    for (size_t f = 0; f < frames; ++f) {
+      glm::vec3 viewer = path[leg] + delta * (float(f) / frames);
+      auto start = std::chrono::steady_clock::now();
+      streamer.Update(viewer);
+      updates.push_back(Seconds(start) * 1e3);
+
+      const StreamingStats &stats = streamer.GetStats();
+      maxEntities = std::max(maxEntities, stats.residentEntities);
+      maxBytes = std::max(maxBytes, stats.residentBytes);
+      // cells touching the viewer's own should always be there
+      if (streamer.CountMissingCells(viewer, CELL_SIZE) > 0)
+        ++popIn;
+
+      frameStart += std::chrono::microseconds(
+          static_cast<long long>(FRAME * 1e6));
+      std::this_thread::sleep_until(frameStart);
+    }
+  }
+
+  std::vector<double> sorted = updates;
+  std::sort(sorted.begin(), sorted.end());
+  double mean = 0.0;
+  for (double ms : updates)
+    mean += ms / updates.size();
+  size_t hitches = std::count_if(updates.begin(), updates.end(),
+                                 [&](double ms) { return ms > FRAME * 1e3; });
+  const StreamingStats &stats = streamer.GetStats();
+
+  std::printf("world_stream: %u entities in %zu cells of %.0f, partitioned "
+              "in %.1f s\n",
+              entities, streamer.GetCellCount(), CELL_SIZE, partition);
+  std::printf("  radii %.0f / %.0f, budget %zu MB, %zu threads\n",
+              settings.loadRadius, settings.unloadRadius,
+              settings.memoryBudget >> 20, workers.GetThreadCount());
+  std::printf("  %zu frames, update mean %.2f ms  p99 %.2f ms  max %.2f ms\n",
+              updates.size(), mean, sorted[sorted.size() * 99 / 100],
+              sorted.back());
+  std::printf("  hitches (update > 16.7 ms): %zu, frames with a neighbour "
+              "cell missing: %zu\n",
+              hitches, popIn);
+  std::printf("  resident at most %zu entities (%.1f%%), %.1f MB; %zu cells "
+              "loaded, %zu unloaded\n",
+              maxEntities, 100.0 * maxEntities / entities, maxBytes / 1e6,
+              stats.cellsLoaded, stats.cellsUnloaded);
+  streamer.Close();
+  workers.WaitIdle();
+  std::filesystem::remove_all(dir);
+}
+
+// Spawning lit cubes one AddComponent at a time, from JSON scenes with
+// full components and with prefab instances overriding the position, and
+// through PrefabManager::Instantiate
+void PrefabSpawn(const Options &options) {
+  auto dir = std::filesystem::temp_directory_path() / "rendercore_prefabs";
+  std::filesystem::create_directories(dir);
+  unsigned int entities = options.entities ? options.entities : 100000;
+  SceneResources resources((dir / "cache").string());
+  SerializationRegistry registry = App::RegisterSerializeDefaultComponents();
+  PrefabManager prefabs(registry, resources.context);
+  resources.context.prefabs = &prefabs;
+
+  MeshId mesh =
+      resources.meshes.LoadMeshAsync(options.objectsDir + "/cube.obj");
+  ShaderId shader = resources.shaders.LoadShaderAsync(
+      "resources/shaders/default.frag", "resources/shaders/default.vert");
+  auto addCube = [&](Coordinator &coordinator, Entity entity,
+                     const glm::vec3 &position) {
+    TransformComponent transform{};
+    transform.mPosition = position;
+    coordinator.AddComponent(entity, transform);
+    coordinator.AddComponent(entity, MeshComponent{mesh});
+    ShaderComponent shaderComponent{};
+    shaderComponent.mId = shader;
+    coordinator.AddComponent(entity, shaderComponent);
+    coordinator.AddComponent(entity, MaterialComponent{});
+  };
+
+  std::string prefabPath = (dir / "cube.json").string();
+  {
+    Coordinator coordinator;
+    App::RegisterDefaultComponents(coordinator);
+    addCube(coordinator, coordinator.CreateEntity(), glm::vec3(0.0f));
+    SceneManager scenes(coordinator, registry, resources.context);
+    Json entity = scenes.SerializeScene()["entities"][0];
+    std::ofstream(prefabPath) << Json{{"components", entity["components"]}};
+  }
+  PrefabId prefab = prefabs.Load(prefabPath);
+
+  // the same cubes as instances, and expanded (saved without prefabs)
+  Json instances = {{"entities", Json::array()}};
+  for (unsigned int i = 0; i < entities; ++i) {
+    glm::vec3 position = StackedGrid(i);
+    instances["entities"].push_back(
+        {{"id", i},
+         {"prefab", prefabPath},
+         {"components",
+          {{"TransformComponent",
+            {{"pos_x", position.x},
+             {"pos_y", position.y},
+             {"pos_z", position.z}}}}}});
+  }
+  Json full;
+  {
+    Coordinator coordinator;
+    App::RegisterDefaultComponents(coordinator);
+    SceneManager scenes(coordinator, registry, resources.context);
+    scenes.DeserializeScene(instances);
+    resources.context.prefabs = nullptr;
+    full = scenes.SerializeScene();
+    resources.context.prefabs = &prefabs;
+  }
+
+  // each run spawns into a new world and is timed up to its CommitBatch
+  auto spawn = [&](const std::function<void(Coordinator &)> &fn) {
+    double best = 1e30;
+    size_t spawned = 0;
+    for (unsigned int r = 0; r < options.repeat; ++r) {
+      Coordinator coordinator;
+      App::RegisterDefaultComponents(coordinator);
+      auto start = std::chrono::steady_clock::now();
+      fn(coordinator);
+      best = std::min(best, Seconds(start));
+      spawned = coordinator.GetComponentArray<TransformComponent>()
+                    .GetComponents()
+                    .size();
+    }
+    return std::make_pair(best, spawned);
+  };
+
+  auto perComponent = spawn([&](Coordinator &coordinator) {
+    coordinator.BeginBatch();
+    for (unsigned int i = 0; i < entities; ++i)
+      addCube(coordinator, coordinator.CreateEntity(), StackedGrid(i));
+    coordinator.CommitBatch();
+  });
+  auto fromJson = [&](const Json &scene) {
+    return spawn([&](Coordinator &coordinator) {
+      SceneManager scenes(coordinator, registry, resources.context);
+      scenes.DeserializeScene(scene);
+    });
+  };
+  auto jsonFull = fromJson(full);
+  auto jsonInstances = fromJson(instances);
+  auto instantiate = spawn([&](Coordinator &coordinator) {
+    std::vector<Entity> spawned(entities);
+    coordinator.BeginBatch();
+    for (Entity &entity : spawned)
+      entity = coordinator.CreateEntity();
+    prefabs.Instantiate(prefab, spawned.data(), spawned.size(), coordinator);
+    for (unsigned int i = 0; i < entities; ++i)
+      coordinator.GetComponent<TransformComponent>(spawned[i]).mPosition =
+          StackedGrid(i);
+    coordinator.CommitBatch();
+  });
+
+  std::printf("prefab_spawn: %u cubes (transform, mesh, shader, material), "
+              "1 thread\n",
+              entities);
+  auto row = [&](const char *name, std::pair<double, size_t> result) {
+    std::printf("  %-28s %8.1f ms %7.2f us/entity  %zu spawned\n", name,
+                result.first * 1e3, result.first * 1e6 / entities,
+                result.second);
+  };
+  row("AddComponent per entity", perComponent);
+  row("JSON, full components", jsonFull);
+  row("JSON, prefab instances", jsonInstances);
+  row("PrefabManager::Instantiate", instantiate);
+  std::printf("  JSON size: %.1f MB full, %.1f MB as instances\n",
+              full.dump().size() / 1e6, instances.dump().size() / 1e6);
+  std::filesystem::remove_all(dir);
+}
+
+// What the draw list costs per entity to find its mesh: the lock, hash
+// lookup and shared_ptr copy MeshManager used to do, against a generational
+// handle into dense slots
+void HandleLookup(const Options &options) {
+  constexpr unsigned int RESOURCES = 4096;
+  unsigned int lookups = options.entities ? options.entities : 1000000;
+
+  std::mutex mutex;
+  std::unordered_map<std::uint32_t, std::shared_ptr<MeshInfo>> map;
+  HandlePool<MeshInfo> pool;
+  std::vector<std::uint32_t> keys, handles;
+  for (unsigned int i = 0; i < RESOURCES; ++i) {
+    MeshInfo info;
+    info.boundsRadius = float(i);
+    map[i] = std::make_shared<MeshInfo>(info);
+    keys.push_back(i);
+    handles.push_back(pool.Allocate());
+    *pool.Get(handles.back()) = info;
+  }
+
+  // entities in creation order refer to meshes in no particular order
+  std::mt19937 random(42);
+  std::vector<unsigned int> order(lookups);
+  for (unsigned int &resource : order)
+    resource = random() % RESOURCES;
+
+  float sum = 0.0f;
+  double locked = BestOf(options.repeat, [&] {
+    for (unsigned int resource : order) {
+      std::shared_ptr<MeshInfo> info;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = map.find(keys[resource]);
+        if (it != map.end())
+          info = it->second;
+      }
+      sum += info->boundsRadius;
+    }
+  });
+  double handle = BestOf(options.repeat, [&] {
+    for (unsigned int resource : order) {
+      const MeshInfo *info = pool.Get(handles[resource]);
+      sum += info->boundsRadius;
+    }
+  });
+
+  // freed slots reused by new resources don't answer to the old handles
+  for (unsigned int i = 0; i < RESOURCES; i += 2)
+    pool.Free(handles[i]);
+  for (unsigned int i = 0; i < RESOURCES; i += 2)
+    pool.Allocate();
+  size_t stale = 0;
+  for (unsigned int i = 0; i < RESOURCES; i += 2)
+    stale += pool.Get(handles[i]) == nullptr;
+
+  std::printf("handle_lookup: %u lookups over %u meshes (checksum %.0f)\n",
+              lookups, RESOURCES, sum);
+  std::printf("  %-36s %8.2f ms %6.1f ns/lookup\n",
+              "mutex + unordered_map + shared_ptr", locked * 1e3,
+              locked * 1e9 / lookups);
+  std::printf("  %-36s %8.2f ms %6.1f ns/lookup\n", "HandlePool::Get",
+              handle * 1e3, handle * 1e9 / lookups);
+  std::printf("  stale handles rejected after reuse: %zu of %u\n", stale,
+              RESOURCES / 2);
+}
+
+// The ECS calls systems and loaders make per entity: creating entities
+// with components (systems are matched on every AddComponent, or once per
+// entity in a batch), component lookups, component removal and
+// destruction
+void EcsOps(const Options &options) {
+  unsigned int entities = options.entities ? options.entities : 100000;
+  double create = 1e30, batched = 1e30, lookup = 1e30, remove = 1e30,
+         destroy = 1e30;
+  float sum = 0.0f;
+
+  for (unsigned int run = 0; run < options.repeat; ++run) {
+    auto fill = [&](Coordinator &coordinator) {
+      for (unsigned int i = 0; i < entities; ++i) {
+        Entity entity = coordinator.CreateEntity();
+        TransformComponent transform{};
+        transform.mPosition = StackedGrid(i);
+        coordinator.AddComponent(entity, transform);
+        coordinator.AddComponent(entity, MaterialComponent{});
+        coordinator.AddComponent(entity, MeshComponent{});
+      }
+    };
+    {
+      Coordinator coordinator;
+      App::RegisterDefaultComponents(coordinator);
+      coordinator.BeginBatch();
+      auto start = std::chrono::steady_clock::now();
+      fill(coordinator);
+      coordinator.CommitBatch();
+      batched = std::min(batched, Seconds(start));
+    }
+
+    Coordinator coordinator;
+    App::RegisterDefaultComponents(coordinator);
+    auto start = std::chrono::steady_clock::now();
+    fill(coordinator);
+    create = std::min(create, Seconds(start));
+
+    std::vector<Entity> all = coordinator.GetAllEntities();
+    start = std::chrono::steady_clock::now();
+    for (Entity entity : all) {
+      TransformComponent &transform =
+          coordinator.GetComponent<TransformComponent>(entity);
+      transform.mPosition.y += 1.0f;
+      sum += transform.mPosition.y;
+    }
+    lookup = std::min(lookup, Seconds(start));
+
+    start = std::chrono::steady_clock::now();
+    for (Entity entity : all)
+      coordinator.RemoveComponent<MaterialComponent>(entity);
+    remove = std::min(remove, Seconds(start));
+
+    start = std::chrono::steady_clock::now();
+    for (Entity entity : all)
+      coordinator.DestroyEntity(entity);
+    destroy = std::min(destroy, Seconds(start));
+  }
+
+  std::printf("ecs_ops: %u entities, 3 components each (checksum %.0f)\n",
+              entities, sum);
+  auto row = [&](const char *name, double seconds, unsigned int count) {
+    std::printf("  %-28s %8.2f ms %7.1f ns/op\n", name, seconds * 1e3,
+                seconds * 1e9 / count);
+  };
+  row("create + 3 AddComponent", create, entities);
+  row("same, batched", batched, entities);
+  row("GetComponent", lookup, entities);
+  row("RemoveComponent", remove, entities);
+  row("DestroyEntity", destroy, entities);
+}
+
+// What a PROFILE_SCOPE costs while the profiler is disabled, which every
+// build with it compiled in pays, and while it records
+void ProfilerOverhead(const Options &options) {
+  unsigned int scopes = options.entities ? options.entities : 10000000;
+  volatile unsigned int sink = 0;
+  double empty = BestOf(options.repeat, [&] {
+    for (unsigned int i = 0; i < scopes; ++i)
+      sink = sink + i;
+  });
+  double disabled = BestOf(options.repeat, [&] {
+    for (unsigned int i = 0; i < scopes; ++i) {
+      PROFILE_SCOPE("profiler_overhead");
+      sink = sink + i;
+    }
+  });
+  Profiler::SetEnabled(true);
+  double enabled = BestOf(options.repeat, [&] {
+    for (unsigned int i = 0; i < scopes; ++i) {
+      PROFILE_SCOPE("profiler_overhead");
+      sink = sink + i;
+    }
+  });
+  Profiler::SetEnabled(false);
+  Profiler::Reset();
+
+#ifdef RENDERCORE_PROFILER
+  const char *build = "compiled in";
+#else
+  const char *build = "compiled out";
+#endif
+  std::printf("profiler_overhead: %u scopes, profiler %s\n", scopes, build);
+  std::printf("  %-20s %8.2f ms %6.2f ns/iteration\n", "no scope",
+              empty * 1e3, empty * 1e9 / scopes);
+  // what a scope adds to the bare loop
+  std::printf("  %-20s %8.2f ms %+6.2f ns/scope\n", "disabled",
+              disabled * 1e3, (disabled - empty) * 1e9 / scopes);
+  std::printf("  %-20s %8.2f ms %+6.2f ns/scope\n", "enabled", enabled * 1e3,
+              (enabled - empty) * 1e9 / scopes);
+}
+
+const Benchmark BENCHMARKS[] = {
+    {"obj_parse", ObjParse},
+    {"mesh_cache", MeshCacheLoad},
+    {"scene_load", SceneLoad},
+    {"scene_format", SceneFormat},
+    {"scene_stream", SceneStream},
+    {"scene_delta", SceneDelta},
+    {"world_stream", WorldStream},
+    {"prefab_spawn", PrefabSpawn},
+    {"handle_lookup", HandleLookup},
+    {"ecs_ops", EcsOps},
+    {"profiler_overhead", ProfilerOverhead},
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--filter" && hasValue)
+      options.filter = argv[++i];
+    else if (arg == "--obj" && hasValue)
+      options.objPath = argv[++i];
+    else if (arg == "--grid" && hasValue)
+      options.grid = std::stoul(argv[++i]);
+    else if (arg == "--threads" && hasValue)
+      options.threads = std::stoul(argv[++i]);
+    else if (arg == "--objects" && hasValue)
+      options.objectsDir = argv[++i];
+    else if (arg == "--entities" && hasValue)
+      options.entities = std::stoul(argv[++i]);
+    else if (arg == "--repeat" && hasValue)
+      options.repeat = std::max(1ul, std::stoul(argv[++i]));
+    else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  for (const Benchmark &benchmark : BENCHMARKS) {
+    if (!options.filter.empty() &&
+        std::string(benchmark.name).find(options.filter) == std::string::npos)
+      continue;
+    benchmark.run(options);
+  }
+  return 0;
+}
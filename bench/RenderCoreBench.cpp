@@ -0,0 +1,338 @@
+// Whole-frame benchmark: renders a scene offscreen along a fixed camera
+// path and reports frame time percentiles, overall and per system.
+//
+//   RenderCoreBench [--scene path] [--entities N] [--lights M] [--meshes K]
+//                   [--frames N] [--warmup N] [--width W] [--height H]
+//                   [--json path]
+//
+// Without --scene it builds a stress scene of N lit entities sharing K
+// generated meshes under M point lights. The camera orbits the scene once
+// over the measured frames, each frame advancing a fixed 1/60 s, so runs
+// on the same machine draw the same frames.
+#include "App.h"
+#include "components/CameraComponent.h"
+#include "components/DirectionalLightComponent.h"
+#include "components/MaterialComponent.h"
+#include "components/MeshComponent.h"
+#include "components/PointLightComponent.h"
+#include "components/ShaderComponent.h"
+#include "components/TransformComponent.h"
+#include "systems/RenderSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr float FRAME_TIME_S = 1.0f / 60.0f;
+constexpr float PI = 3.14159265f;
+// a scene that doesn't finish loading within this many frames is measured
+// as it is
+constexpr unsigned int MAX_LOAD_FRAMES = 6000;
+
+struct Options {
+  std::string scene;
+  unsigned int entities = 10000;
+  unsigned int lights = 8;
+  unsigned int meshes = 16;
+  unsigned int frames = 600;
+  unsigned int warmup = 60;
+  int width = 1280;
+  int height = 720;
+  std::string jsonPath;
+};
+
+struct Summary {
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+// nearest-rank percentiles
+Summary Summarize(std::vector<double> samples) {
+  Summary summary;
+  if (samples.empty())
+    return summary;
+  std::sort(samples.begin(), samples.end());
+  auto rank = [&](double percentile) {
+    size_t index = size_t(std::ceil(percentile * samples.size()));
+    return samples[std::min(samples.size(), std::max<size_t>(index, 1)) - 1];
+  };
+  for (double sample : samples)
+    summary.mean += sample;
+  summary.mean /= samples.size();
+  summary.p50 = rank(0.50);
+  summary.p95 = rank(0.95);
+  summary.p99 = rank(0.99);
+  summary.max = samples.back();
+  return summary;
+}
+
+// UV sphere of the given number of segments around, half as many rings
+std::string WriteSphereObj(unsigned int segments) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("rendercore_sphere_" + std::to_string(segments) + ".obj");
+  if (std::filesystem::exists(path))
+    return path.string();
+
+  std::ofstream out(path);
+  unsigned int rings = std::max(2u, segments / 2);
+  char line[128];
+  for (unsigned int ring = 0; ring <= rings; ++ring) {
+    float theta = PI * ring / rings;
+    for (unsigned int segment = 0; segment <= segments; ++segment) {
+      float phi = 2.0f * PI * segment / segments;
+      float x = std::sin(theta) * std::cos(phi), y = std::cos(theta),
+            z = std::sin(theta) * std::sin(phi);
+      std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x * 0.5f,
+                    y * 0.5f, z * 0.5f);
+      out << line;
+      std::snprintf(line, sizeof(line), "vt %.6f %.6f\n",
+                    float(segment) / segments, float(ring) / rings);
+      out << line;
+      std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", x, y, z);
+      out << line;
+    }
+  }
+  for (unsigned int ring = 0; ring < rings; ++ring) {
+    for (unsigned int segment = 0; segment < segments; ++segment) {
+      unsigned int a = ring * (segments + 1) + segment + 1, b = a + 1,
+                   c = b + segments + 1, d = a + segments + 1;
+      std::snprintf(line, sizeof(line),
+                    "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, d, d,
+                    d, c, c, c, b, b, b);
+      out << line;
+    }
+  }
+  return path.string();
+}
+
+// Entities on a square grid in XZ, 3 units apart, returns the grid's
+// half width
+float BuildStressScene(App &app, const Options &options) {
+  Coordinator &coordinator = app.GetCoordinator();
+  ResourceContext &resources = app.GetResources();
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  std::vector<MeshId> meshes;
+  for (unsigned int i = 0; i < std::max(1u, options.meshes); ++i)
+    meshes.push_back(
+        resources.meshes->LoadMeshAsync(WriteSphereObj(8 + 4 * i)));
+  ShaderId shader = resources.shaders->LoadShaderAsync(
+      "resources/shaders/default.frag", "resources/shaders/default.vert");
+
+  unsigned int side = std::max(
+      1u, unsigned(std::ceil(std::sqrt(double(options.entities)))));
+  float half = (side - 1) * 1.5f;
+  coordinator.BeginBatch();
+  for (unsigned int i = 0; i < options.entities; ++i) {
+    Entity entity = coordinator.CreateEntity();
+    TransformComponent transform{};
+    transform.mPosition =
+        glm::vec3((i % side) * 3.0f - half, 0.0f, (i / side) * 3.0f - half);
+    transform.mRotation = glm::vec3(0.0f, unit(random) * 2.0f * PI, 0.0f);
+    coordinator.AddComponent(entity, transform);
+    coordinator.AddComponent(entity,
+                             MeshComponent{meshes[i % meshes.size()]});
+    ShaderComponent shaderComponent{};
+    shaderComponent.mId = shader;
+    coordinator.AddComponent(entity, shaderComponent);
+    MaterialComponent material{};
+    material.diffuse = glm::vec3(unit(random), unit(random), unit(random));
+    coordinator.AddComponent(entity, material);
+  }
+  for (unsigned int i = 0; i < options.lights; ++i) {
+    Entity entity = coordinator.CreateEntity();
+    TransformComponent transform{};
+    transform.mPosition = glm::vec3((unit(random) * 2.0f - 1.0f) * half, 4.0f,
+                                    (unit(random) * 2.0f - 1.0f) * half);
+    coordinator.AddComponent(entity, transform);
+    PointLightComponent light{};
+    light.lightColor = glm::vec3(unit(random), unit(random), unit(random));
+    light.intensity = 4.0f;
+    coordinator.AddComponent(entity, light);
+  }
+  Entity sun = coordinator.CreateEntity();
+  coordinator.AddComponent(sun, DirectionalLightComponent{
+                                    .direction = glm::vec3(1.0f, -1.0f, 0.5f),
+                                    .intensity = 0.4f});
+  coordinator.CommitBatch();
+
+  // the components hold their own references now
+  for (MeshId mesh : meshes)
+    resources.meshes->ReleaseMesh(mesh);
+  resources.shaders->ReleaseShader(shader);
+  return half;
+}
+
+// The active camera, or a new one when the scene has none
+Entity FindCamera(Coordinator &coordinator) {
+  for (Entity entity : coordinator.GetAllEntities())
+    if (coordinator.HasComponent<CameraComponent>(entity) &&
+        coordinator.GetComponent<CameraComponent>(entity).mActive)
+      return entity;
+  Entity camera = coordinator.CreateEntity();
+  coordinator.AddComponent(camera, TransformComponent{});
+  coordinator.AddComponent(camera, CameraComponent{});
+  return camera;
+}
+
+bool IsLoading(ResourceContext &resources) {
+  return resources.meshes->GetPendingCount() > 0 ||
+         resources.shaders->GetPendingCount() > 0 ||
+         resources.meshes->GetUploadStats().bytesQueued > 0;
+}
+
+void Print(const char *name, const Summary &summary) {
+  std::printf("  %-10s %8.3f %8.3f %8.3f %8.3f %8.3f\n", name, summary.mean,
+              summary.p50, summary.p95, summary.p99, summary.max);
+}
+
+Json ToJson(const Summary &summary) {
+  return {{"mean", summary.mean}, {"p50", summary.p50}, {"p95", summary.p95},
+          {"p99", summary.p99},   {"max", summary.max}};
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--scene" && hasValue)
+      options.scene = argv[++i];
+    else if (arg == "--entities" && hasValue)
+      options.entities = std::stoul(argv[++i]);
+    else if (arg == "--lights" && hasValue)
+      options.lights = std::stoul(argv[++i]);
+    else if (arg == "--meshes" && hasValue)
+      options.meshes = std::stoul(argv[++i]);
+    else if (arg == "--frames" && hasValue)
+      options.frames = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--warmup" && hasValue)
+      options.warmup = std::stoul(argv[++i]);
+    else if (arg == "--width" && hasValue)
+      options.width = std::stoi(argv[++i]);
+    else if (arg == "--height" && hasValue)
+      options.height = std::stoi(argv[++i]);
+    else if (arg == "--json" && hasValue)
+      options.jsonPath = argv[++i];
+    else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  HeadlessSettings headless;
+  headless.enabled = true;
+  App app(options.width, options.height, "RenderCoreBench", headless);
+  app.Init();
+  Coordinator &coordinator = app.GetCoordinator();
+  ResourceContext &resources = app.GetResources();
+
+  float radius = 10.0f;
+  if (options.scene.empty())
+    radius = BuildStressScene(app, options) * 1.5f + 5.0f;
+  else if (!app.GetSceneManager().LoadScene(options.scene))
+    return 1;
+
+  Entity cameraEntity = FindCamera(coordinator);
+  CameraComponent &camera =
+      coordinator.GetComponent<CameraComponent>(cameraEntity);
+  camera.mAutoRotate = false;
+  if (options.scene.empty()) {
+    camera.mDistance = radius;
+    camera.mPitch = 0.6f;
+    camera.mFarPlane = radius * 3.0f;
+  }
+  float startYaw = camera.mYaw, startPitch = camera.mPitch;
+
+  unsigned int loadFrames = 0;
+  while (IsLoading(resources) && loadFrames < MAX_LOAD_FRAMES) {
+    app.Frame(FRAME_TIME_S);
+    ++loadFrames;
+  }
+  for (unsigned int i = 0; i < options.warmup; ++i)
+    app.Frame(FRAME_TIME_S);
+
+  std::vector<double> cpu, gpu, uploads, lights, cameraTimes, streaming,
+      extract, render;
+  for (unsigned int frame = 0; frame < options.frames; ++frame) {
+    // once around, bobbing up and down twice
+    float t = float(frame) / options.frames;
+    CameraComponent &view =
+        coordinator.GetComponent<CameraComponent>(cameraEntity);
+    view.mYaw = startYaw + 2.0f * PI * t;
+    view.mPitch = startPitch + 0.15f * std::sin(4.0f * PI * t);
+
+    app.Frame(FRAME_TIME_S);
+    const FrameTimings &timings = app.GetFrameTimings();
+    cpu.push_back(timings.cpu);
+    uploads.push_back(timings.uploads);
+    lights.push_back(timings.lights);
+    cameraTimes.push_back(timings.camera);
+    streaming.push_back(timings.streaming);
+    extract.push_back(timings.extract);
+    render.push_back(timings.render);
+    // the first few measured frames read back warmup queries
+    if (timings.gpu >= 0.0 && frame >= App::GPU_QUERY_LATENCY)
+      gpu.push_back(timings.gpu);
+  }
+
+  const RenderStats &stats =
+      coordinator.GetSystem<RenderSystem>()->GetFrameStats();
+  std::printf("RenderCoreBench: %s, %zu entities, %ux%d, %u frames after %u "
+              "loading and %u warmup\n",
+              options.scene.empty() ? "stress scene" : options.scene.c_str(),
+              coordinator.GetAllEntities().size(), options.width,
+              options.height, options.frames, loadFrames, options.warmup);
+  std::printf("  last frame: %zu draws, %zu triangles\n", stats.drawCalls,
+              stats.triangles);
+  std::printf("  %-10s %8s %8s %8s %8s %8s   (ms)\n", "", "mean", "p50",
+              "p95", "p99", "max");
+  std::vector<std::pair<const char *, Summary>> rows = {
+      {"cpu", Summarize(cpu)},           {"gpu", Summarize(gpu)},
+      {"uploads", Summarize(uploads)},   {"lights", Summarize(lights)},
+      {"camera", Summarize(cameraTimes)}, {"streaming", Summarize(streaming)},
+      {"extract", Summarize(extract)},   {"render", Summarize(render)}};
+  for (const auto &[name, summary] : rows)
+    Print(name, summary);
+
+  if (!options.jsonPath.empty()) {
+    Json systems = Json::object();
+    for (size_t i = 2; i < rows.size(); ++i)
+      systems[rows[i].first] = ToJson(rows[i].second);
+    Json result = {
+        {"scene", options.scene.empty() ? "stress" : options.scene},
+        {"entities", coordinator.GetAllEntities().size()},
+        {"lights", options.lights},
+        {"meshes", options.meshes},
+        {"width", options.width},
+        {"height", options.height},
+        {"frames", options.frames},
+        {"warmup", options.warmup},
+        {"renderer", reinterpret_cast<const char *>(glGetString(GL_RENDERER))},
+        {"draws", stats.drawCalls},
+        {"triangles", stats.triangles},
+        {"cpu_ms", ToJson(rows[0].second)},
+        {"gpu_ms", ToJson(rows[1].second)},
+        {"systems_ms", systems}};
+    std::ofstream file(options.jsonPath);
+    file << result.dump(2) << "\n";
+    if (!file) {
+      std::cerr << "Couldn't write " << options.jsonPath << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
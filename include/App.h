@@ -3,41 +3,184 @@
 #include "glad/glad.h"
 //
 #include "GLFW/glfw3.h"
+#include "core/ThreadPool.h"
 #include "ecs/Coordinator.h"
+#include "managers/PrefabManager.h"
 #include "managers/ResourceContext.h"
 #include "managers/SceneManager.h"
 #include "managers/SerializationRegistry.h"
 #include "managers/UniformBufferManager.h"
+#include "managers/WorldStreamer.h"
+#include "render/GpuProfiler.h"
+#include "render/HeadlessContext.h"
+#include "render/OffscreenTarget.h"
+#include "render/RenderPacket.h"
+#include "render/RenderThread.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
+
+struct HeadlessSettings {
+  // draw into an offscreen framebuffer of a context without a window
+  bool enabled = false;
+  // Run() returns after this many frames
+  int frames = 1;
+  // each frame is written here as frame_NNNN.ppm, nothing when empty
+  std::string dumpDirectory;
+  // frames only count once no mesh or shader is loading, so dumps don't
+  // depend on how fast the workers were
+  bool waitForLoads = true;
+};
+
+// Where the last App::Frame() spent its time, in milliseconds
+struct FrameTimings {
+  // finished async loads turned into GL objects
+  double uploads = 0.0;
+  double lights = 0.0;
+  double camera = 0.0;
+  double streaming = 0.0;
+  // copying what the frame draws out of the ECS
+  double extract = 0.0;
+  // uploading the uniforms, culling, sorting and submitting the draws
+  double render = 0.0;
+  // all of Frame(), from the first system to the last draw call
+  double cpu = 0.0;
+  // GPU time of the draws of the frame GPU_QUERY_LATENCY frames back, so
+  // reading it never stalls; negative until there is one
+  double gpu = -1.0;
+};
 
 class App {
 public:
-  App(int width, int height, const char *title);
+  // frames between issuing a GPU timer query and reading it back
+  static constexpr unsigned int GPU_QUERY_LATENCY = GpuProfiler::LATENCY;
+
+  // Headless apps time frames with a fixed step instead of the clock and
+  // take no input
+  App(int width, int height, const char *title,
+      const HeadlessSettings &headless = {});
   void Init();
   ~App();
   void Run();
-  SerializationRegistry RegisterSerializeDefaultComponents();
+  // Draws one frame of the current scene, advancing it by deltaTime
+  // seconds. Run() calls it between input and presenting; benchmarks
+  // drive it directly.
+  void Frame(float deltaTime);
+  const FrameTimings &GetFrameTimings() const { return mFrameTimings; }
+  // Rewrites a scene in the format its new extension asks for
+  bool ConvertScene(const std::string &from, const std::string &to);
+  // Splits a scene into a world of cellSize cells under directory
+  bool PartitionScene(const std::string &scene, const std::string &directory,
+                      float cellSize);
+  // Run() streams this world around the camera instead of the first scene
+  void SetWorld(const std::string &directory) { mWorldDirectory = directory; }
+  // Run() draws on a render thread that owns the context, framesInFlight
+  // frames behind the simulation at most; 0 draws on the calling thread.
+  // Fewer than 2 wouldn't overlap anything, more than
+  // RenderThread::MAX_FRAMES_IN_FLIGHT aren't kept, so it is clamped.
+  void SetRenderThread(unsigned int framesInFlight) {
+    mFramesInFlight =
+        framesInFlight == 0
+            ? 0
+            : std::clamp(framesInFlight, 2u,
+                         RenderThread::MAX_FRAMES_IN_FLIGHT);
+  }
+  // Run() prints the frame rate and the latency from simulating a frame to
+  // presenting it when it returns
+  void SetReportFrameStats(bool report) { mReportFrameStats = report; }
+  // Profiles from the start; Run() writes a Chrome trace to tracePath and
+  // prints a summary when it returns. F9 starts and stops it as well.
+  void StartProfiling(const std::string &tracePath);
+  // Components and the systems over them, as the default scenes expect
+  static void RegisterDefaultComponents(Coordinator &coordinator);
+  static SerializationRegistry RegisterSerializeDefaultComponents();
 
+  // Applied by the next frame drawn
   void UpdateViewport(int w, int h);
 
+  Coordinator &GetCoordinator() { return mCoordinator; }
+  ResourceContext &GetResources() { return mResources; }
+  SceneManager &GetSceneManager() { return *mSceneManager; }
+
 private:
   int mWidth;
   int mHeight;
 
   float mLastFrameTime;
+  std::string mTitle;
 
   static void framebuffer_size_callback(GLFWwindow *window, int width,
                                         int heiht);
 
+  // Prints the summary and writes the trace StartProfiling asked for
+  void StopProfiling();
+  // Seconds since start, simulated when headless
+  float GetTime() const;
+  // Whether the headless frame about to be simulated counts: frames only
+  // do once nothing is loading, unless waitForLoads is off
+  bool HeadlessFrameCounts();
+  // Dumps a counted headless frame, closes the window after the last one
+  void DumpOffscreenFrame(int frame);
+
+  // Frame() in two halves. Simulate runs the systems and fills packet
+  // without touching GL, Render draws it on the context thread.
+  void Simulate(float deltaTime, RenderPacket &packet);
+  void Render(RenderPacket &packet);
+  // Swaps buffers, or dumps the frame when headless
+  void Present(const RenderPacket &packet);
+  // Hands the context over to mRenderThread and back
+  void StartRenderThread();
+  void StopRenderThread();
+  // fn on the thread that has the context, for what must not race with
+  // drawing
+  void OnContextThread(const std::function<void()> &fn);
+  void ReportFrameStats() const;
+
   UniformBufferManager mUniformManager;
   std::unique_ptr<SceneManager> mSceneManager;
+  std::unique_ptr<WorldStreamer> mWorldStreamer;
+  std::string mWorldDirectory;
   SerializationRegistry mSerializeRegistry;
   GLFWwindow *mWindow;
 
+  HeadlessSettings mHeadless;
+  HeadlessContext mHeadlessContext;
+  std::unique_ptr<OffscreenTarget> mOffscreen;
+  int mHeadlessFrame = 0;
+  int mSettleFrames = 0;
+
+  FrameTimings mFrameTimings;
+  // the packet Frame() goes through
+  RenderPacket mPacket;
+  // of the newest frame drawn, for the title and the logs
+  RenderFeedback mFeedback;
+  // what the viewport was last set to, on the context thread
+  int mViewportWidth = 0;
+  int mViewportHeight = 0;
+
+  unsigned int mFramesInFlight = 0;
+  RenderThread mRenderThread;
+  bool mReportFrameStats = false;
+  // milliseconds from simulating each presented frame to presenting it,
+  // written by the thread presenting
+  std::vector<double> mFrameLatencies;
+  std::uint64_t mFirstPresent = 0;
+  std::uint64_t mLastPresent = 0;
+
+  GpuProfiler mGpuProfiler;
+  // where Run() writes the trace when profiling stops, empty when it isn't
+  std::string mTracePath;
+
   ResourceContext mResources;
   MeshManager mMeshManager;
   ShaderManager mShaderManager;
+  std::unique_ptr<PrefabManager> mPrefabManager;
+  // declared after the managers so jobs are joined before they go away
+  ThreadPool mWorkers;
 
   Coordinator mCoordinator;
 };
@@ -2,5 +2,5 @@
 #include "managers/MeshManager.h"
 
 struct MeshComponent {
-  MeshId mId;
+  MeshId mId = 0;
 };
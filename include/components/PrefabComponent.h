@@ -0,0 +1,8 @@
+#pragma once
+#include "managers/PrefabManager.h"
+
+// The prefab an entity was spawned from; JSON scenes store the entity as a
+// reference to it plus the fields that differ
+struct PrefabComponent {
+  PrefabId mId = INVALID_PREFAB;
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Dense slots of T addressed by 32-bit handles: the low INDEX_BITS pick the
+// slot, the rest are its generation, bumped when the slot is freed so old
+// handles stop resolving. Handle 0 is never valid. Slots live in fixed
+// chunks that never move, so Get needs no lock as long as the slots it
+// reads aren't being rewritten: owners allocate and free under their own
+// lock and only rewrite slots of handles nobody holds concurrently.
+template <typename T> class HandlePool {
+public:
+  using Handle = std::uint32_t;
+  static constexpr unsigned int INDEX_BITS = 20;
+  static constexpr Handle INDEX_MASK = (Handle(1) << INDEX_BITS) - 1;
+
+  static std::uint32_t Index(Handle handle) { return handle & INDEX_MASK; }
+
+  // A default T in a free slot, 0 once every slot is taken
+  Handle Allocate() {
+    std::uint32_t index;
+    if (!mFree.empty()) {
+      index = mFree.back();
+      mFree.pop_back();
+    } else {
+      if (mSize > INDEX_MASK)
+        return 0;
+      index = mSize++;
+      std::unique_ptr<Slot[]> &chunk = mChunks[index >> CHUNK_BITS];
+      if (!chunk)
+        chunk = std::make_unique<Slot[]>(CHUNK_SIZE);
+    }
+    Slot &slot = GetSlot(index);
+    slot.value = T{};
+    slot.live = true;
+    return (slot.generation << INDEX_BITS) | index;
+  }
+
+  void Free(Handle handle) {
+    if (!Get(handle))
+      return;
+    std::uint32_t index = Index(handle);
+    Slot &slot = GetSlot(index);
+    slot.value = T{};
+    slot.live = false;
+    slot.generation = NextGeneration(slot.generation);
+    mFree.push_back(index);
+  }
+
+  // nullptr for handles that are stale, freed or were never handed out
+  T *Get(Handle handle) {
+    return const_cast<T *>(static_cast<const HandlePool &>(*this).Get(handle));
+  }
+  const T *Get(Handle handle) const {
+    std::uint32_t index = Index(handle);
+    // mSize is left alone, a worker allocating may be changing it
+    const std::unique_ptr<Slot[]> &chunk = mChunks[index >> CHUNK_BITS];
+    if (!chunk)
+      return nullptr;
+    const Slot &slot = chunk[index & CHUNK_MASK];
+    if (!slot.live || slot.generation != handle >> INDEX_BITS)
+      return nullptr;
+    return &slot.value;
+  }
+
+  // Calls fn(handle, value) for every live slot
+  template <typename Fn> void ForEach(Fn fn) {
+    for (std::uint32_t index = 0; index < mSize; ++index) {
+      Slot &slot = GetSlot(index);
+      if (slot.live)
+        fn((slot.generation << INDEX_BITS) | index, slot.value);
+    }
+  }
+
+  // Frees every slot, outstanding handles all go stale
+  void Clear() {
+    mFree.clear();
+    for (std::uint32_t index = mSize; index-- > 0;) {
+      Slot &slot = GetSlot(index);
+      if (slot.live) {
+        slot.value = T{};
+        slot.live = false;
+        slot.generation = NextGeneration(slot.generation);
+      }
+      mFree.push_back(index);
+    }
+  }
+
+  size_t GetLiveCount() const { return mSize - mFree.size(); }
+
+private:
+  static constexpr unsigned int CHUNK_BITS = 10;
+  static constexpr std::uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+  static constexpr std::uint32_t CHUNK_MASK = CHUNK_SIZE - 1;
+  static constexpr std::uint32_t GENERATIONS = 1u << (32 - INDEX_BITS);
+
+  struct Slot {
+    T value{};
+    std::uint32_t generation = 1; // so no handle is 0
+    bool live = false;
+  };
+
+  static std::uint32_t NextGeneration(std::uint32_t generation) {
+    return generation + 1 < GENERATIONS ? generation + 1 : 1;
+  }
+  Slot &GetSlot(std::uint32_t index) {
+    return mChunks[index >> CHUNK_BITS][index & CHUNK_MASK];
+  }
+
+  std::array<std::unique_ptr<Slot[]>, (INDEX_MASK >> CHUNK_BITS) + 1>
+      mChunks;
+  std::uint32_t mSize = 0;
+  std::vector<std::uint32_t> mFree;
+};
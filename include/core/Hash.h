@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Fast 64-bit non-cryptographic hash for cache keys
+std::uint64_t HashBytes(const void *data, size_t size, std::uint64_t seed = 0);
+
+inline std::uint64_t HashString(const std::string &text,
+                                std::uint64_t seed = 0) {
+  return HashBytes(text.data(), text.size(), seed);
+}
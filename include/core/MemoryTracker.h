@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <string>
+
+// Where tracked memory is charged
+enum class MemoryCategory : unsigned int {
+  EcsPools,       // component arrays and their entity indices
+  MeshCpu,        // vertices and indices meshes keep after upload
+  MeshGpu,        // vertex, position and index buffers, staging ring
+  UniformBuffers, // UBO storage
+  ShaderPrograms, // program binaries as the driver reports them
+  JsonParse,      // read buffers and entity blocks of JSON scene loads
+  Count
+};
+
+struct MemoryCategoryStats {
+  size_t bytes = 0;
+  // most bytes held at once since the last ResetPeaks
+  size_t peakBytes = 0;
+  size_t allocations = 0;
+};
+
+// Bytes held per subsystem, kept up to date by the allocations themselves:
+// containers through TrackingAllocator, GL objects by whoever creates and
+// deletes them. Thread-safe and always on: freeing is one relaxed atomic
+// subtract, allocating two relaxed adds plus a load and, while the peak
+// rises, a compare-exchange loop.
+class MemoryTracker {
+public:
+  static void Allocated(MemoryCategory category, size_t bytes) {
+    Counters &counters = sCounters[size_t(category)];
+    size_t held =
+        counters.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t peak = counters.peak.load(std::memory_order_relaxed);
+    while (held > peak && !counters.peak.compare_exchange_weak(
+                              peak, held, std::memory_order_relaxed))
+      ;
+  }
+  static void Freed(MemoryCategory category, size_t bytes) {
+    sCounters[size_t(category)].bytes.fetch_sub(bytes,
+                                                std::memory_order_relaxed);
+  }
+
+  static MemoryCategoryStats Get(MemoryCategory category);
+  static const char *GetName(MemoryCategory category);
+  // Held by the categories on the GPU (true) or the CPU (false)
+  static size_t GetTotalBytes(bool gpu);
+  // One line per category with its bytes, peak and allocations
+  static std::string Report();
+  // Peaks restart from what is held now
+  static void ResetPeaks();
+
+private:
+  // zeroed as statics, before any allocation can be charged
+  struct Counters {
+    std::atomic<size_t> bytes;
+    std::atomic<size_t> peak;
+    std::atomic<size_t> allocations;
+  };
+  static inline Counters sCounters[size_t(MemoryCategory::Count)];
+};
+
+// std::allocator that charges what it hands out to Category
+template <typename T, MemoryCategory Category> class TrackingAllocator {
+public:
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = TrackingAllocator<U, Category>;
+  };
+
+  TrackingAllocator() = default;
+  template <typename U>
+  TrackingAllocator(const TrackingAllocator<U, Category> &) {}
+
+  T *allocate(size_t count) {
+    MemoryTracker::Allocated(Category, count * sizeof(T));
+    return static_cast<T *>(::operator new(count * sizeof(T)));
+  }
+  void deallocate(T *pointer, size_t count) {
+    MemoryTracker::Freed(Category, count * sizeof(T));
+    ::operator delete(pointer);
+  }
+
+  template <typename U>
+  bool operator==(const TrackingAllocator<U, Category> &) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const TrackingAllocator<U, Category> &) const {
+    return false;
+  }
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// What the render path counts per frame while the profiler is enabled
+enum class ProfileCounter : unsigned int {
+  DrawCalls,
+  Triangles,
+  ProgramBinds,
+  VaoBinds,
+  UboBytes,
+  Count
+};
+
+struct ProfileFrameCounters {
+  std::uint64_t values[size_t(ProfileCounter::Count)] = {};
+
+  std::uint64_t Get(ProfileCounter counter) const {
+    return values[size_t(counter)];
+  }
+};
+
+// Timed scopes and per-frame counters, exported as a Chrome trace_event
+// file (chrome://tracing, Perfetto) or summarized as text.
+//
+// Every thread records into a ring of its own: one writer, no locks, the
+// oldest events are overwritten once it is full. Event names are not
+// copied and must outlive the profiler, i.e. be string literals. Counters
+// belong to the GL context thread.
+//
+// Compiled in with RENDERCORE_PROFILER, off until SetEnabled(true). While
+// disabled a scope costs one relaxed load; compiled out IsEnabled() is a
+// constant and scopes only keep the timings they are asked for.
+class Profiler {
+public:
+  static constexpr size_t RING_EVENTS = size_t(1) << 16;
+  static constexpr size_t MAX_FRAMES = 4096;
+
+#ifdef RENDERCORE_PROFILER
+  static bool IsEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+#else
+  static constexpr bool IsEnabled() { return false; }
+#endif
+  static void SetEnabled(bool enabled);
+
+  // Nanoseconds on the clock events are recorded with
+  static std::uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Names the calling thread in traces
+  static void SetThreadName(const std::string &name);
+  static void Record(const char *name, std::uint64_t start, std::uint64_t end);
+  // A span on the GPU track; start is when its commands were submitted
+  static void RecordGpu(const char *name, std::uint64_t start,
+                        std::uint64_t duration);
+
+  static void Count(ProfileCounter counter, std::uint64_t amount = 1) {
+    if (IsEnabled())
+      sCounters.values[size_t(counter)] += amount;
+  }
+  // Stores the frame's counters and starts counting the next one
+  static void EndFrame();
+  static const ProfileFrameCounters &GetLastFrame() { return sLastFrame; }
+
+  // Everything still in the rings, as trace_event JSON
+  static bool WriteChromeTrace(const std::string &path);
+  // Count, total, mean and max time per scope name, and the counters
+  // averaged over the recorded frames
+  static std::string Summarize();
+  // Drops every recorded event and frame
+  static void Reset();
+
+private:
+#ifdef RENDERCORE_PROFILER
+  static inline std::atomic<bool> sEnabled{false};
+#endif
+  static inline ProfileFrameCounters sCounters;
+  static inline ProfileFrameCounters sLastFrame;
+};
+
+// Times its lifetime as an event named name while the profiler is enabled.
+// Given milliseconds, it also always stores the duration there, for
+// callers that report timings themselves.
+class ProfileScope {
+public:
+  explicit ProfileScope(const char *name, double *milliseconds = nullptr)
+      : mName(name), mMilliseconds(milliseconds),
+        mStart(milliseconds || Profiler::IsEnabled() ? Profiler::Now() : 0) {}
+  ~ProfileScope() {
+    if (!mStart)
+      return;
+    std::uint64_t end = Profiler::Now();
+    if (mMilliseconds)
+      *mMilliseconds = (end - mStart) / 1e6;
+    if (Profiler::IsEnabled())
+      Profiler::Record(mName, mStart, end);
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  const char *mName;
+  double *mMilliseconds;
+  std::uint64_t mStart;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                    \
+  ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(counter, amount)                                         \
+  Profiler::Count(ProfileCounter::counter, amount)
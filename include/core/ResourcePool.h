@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct ResourcePoolSettings {
+  // unreferenced resources are kept until they take more than this, the
+  // least recently released go first
+  size_t gpuBudget = size_t(256) << 20;
+  size_t cpuBudget = size_t(256) << 20;
+};
+
+struct ResourcePoolStats {
+  // requests answered by a pooled resource, without I/O or compilation
+  size_t hits = 0;
+  // requests that had to load the resource
+  size_t misses = 0;
+  size_t evictions = 0;
+  // what the pool holds right now
+  size_t pooled = 0;
+  size_t gpuBytes = 0;
+  size_t cpuBytes = 0;
+
+  double HitRate() const {
+    return hits + misses ? double(hits) / double(hits + misses) : 0.0;
+  }
+};
+
+// Unreferenced resources in release order, each with the memory it keeps
+// alive. Not thread-safe, the owning manager locks around it.
+template <typename Key> class ResourcePool {
+public:
+  void Add(Key key, size_t gpuBytes, size_t cpuBytes) {
+    if (mIndex.count(key))
+      return;
+    mIndex[key] = mEntries.insert(mEntries.end(), {key, gpuBytes, cpuBytes});
+    ++mStats.pooled;
+    mStats.gpuBytes += gpuBytes;
+    mStats.cpuBytes += cpuBytes;
+  }
+
+  // Takes key back out for a new reference, false if it wasn't pooled
+  bool Take(Key key) {
+    if (!Remove(key))
+      return false;
+    ++mStats.hits;
+    return true;
+  }
+
+  bool Contains(Key key) const { return mIndex.count(key) != 0; }
+
+  // Removes the oldest entries until the rest fit settings and returns
+  // them, for the owner to free
+  std::vector<Key> Evict(const ResourcePoolSettings &settings) {
+    std::vector<Key> evicted;
+    while (!mEntries.empty() && (mStats.gpuBytes > settings.gpuBudget ||
+                                 mStats.cpuBytes > settings.cpuBudget)) {
+      Key key = mEntries.front().key;
+      Remove(key);
+      evicted.push_back(key);
+      ++mStats.evictions;
+    }
+    return evicted;
+  }
+
+  // Empties the pool, returning what it held
+  std::vector<Key> TakeAll() {
+    std::vector<Key> keys;
+    keys.reserve(mEntries.size());
+    for (const Entry &entry : mEntries)
+      keys.push_back(entry.key);
+    mEntries.clear();
+    mIndex.clear();
+    mStats.pooled = mStats.gpuBytes = mStats.cpuBytes = 0;
+    return keys;
+  }
+
+  void CountMiss() { ++mStats.misses; }
+  const ResourcePoolStats &GetStats() const { return mStats; }
+  void ResetCounters() {
+    mStats.hits = mStats.misses = mStats.evictions = 0;
+  }
+
+private:
+  struct Entry {
+    Key key;
+    size_t gpuBytes;
+    size_t cpuBytes;
+  };
+
+  bool Remove(Key key) {
+    auto it = mIndex.find(key);
+    if (it == mIndex.end())
+      return false;
+    --mStats.pooled;
+    mStats.gpuBytes -= it->second->gpuBytes;
+    mStats.cpuBytes -= it->second->cpuBytes;
+    mEntries.erase(it->second);
+    mIndex.erase(it);
+    return true;
+  }
+
+  // front is the least recently released
+  std::list<Entry> mEntries;
+  std::unordered_map<Key, typename std::list<Entry>::iterator> mIndex;
+  ResourcePoolStats mStats;
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running jobs in submission order. Jobs still
+// queued when the pool is destroyed are dropped, running ones are joined.
+class ThreadPool {
+public:
+  // threads == 0 leaves one hardware thread to the caller
+  explicit ThreadPool(unsigned int threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void Submit(std::function<void()> job);
+  // Blocks until the queue is empty and no job is running
+  void WaitIdle();
+  // Runs fn(0) .. fn(count - 1) on the workers and the calling thread and
+  // returns once all are done. Workers still busy with earlier jobs don't
+  // hold it up, the caller takes over the indices they would have run.
+  // When fn throws, the indices not started yet are skipped and the first
+  // exception is rethrown here once the calls in progress returned.
+  void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+  size_t GetThreadCount() const { return mThreads.size(); }
+
+private:
+  void WorkerLoop();
+
+  std::vector<std::thread> mThreads;
+  std::deque<std::function<void()>> mJobs;
+  std::mutex mMutex;
+  std::condition_variable mJobAvailable;
+  std::condition_variable mIdle;
+  size_t mRunning = 0;
+  bool mStopping = false;
+};
@@ -1,5 +1,11 @@
 #pragma once
 #include "Types.h"
+#include "core/MemoryTracker.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
 
 class IComponentArray {
 public:
@@ -7,66 +13,153 @@ public:
   virtual void EntityDestroyed(Entity entity) = 0;
   virtual bool HasData(Entity entity) = 0;
   virtual void Clear() = 0;
+  // Makes room for count more components without reallocating
+  virtual void Reserve(size_t count) = 0;
+  // Default-constructed components for entities that have none yet
+  virtual void InsertDefaults(const Entity *entities, size_t count) = 0;
 };
 
+// Components packed in a dense array, found through a sparse array indexed
+// by entity. Both grow with the entities that actually have the component,
+// and are charged to MemoryCategory::EcsPools.
 template <typename T> class ComponentArray : public IComponentArray {
 public:
+  // Called with a component copied into the pool count times, or with one
+  // leaving it (count 1)
+  using Hook = std::function<void(const T &component, size_t count)>;
+
+  // Lets the pool hold whatever its components refer to. Default
+  // components (InsertDefaults) are assumed to refer to nothing, and
+  // neither hook sees components edited in place through GetData.
+  void SetHooks(Hook added, Hook removed) {
+    mAdded = std::move(added);
+    mRemoved = std::move(removed);
+  }
+
   void InsertData(Entity entity, T component) {
-    assert(mEntityToIndexMap.find(entity) == mEntityToIndexMap.end() &&
+    assert(!HasData(entity) &&
            "Component added to same entity more than once!!");
+    if (mAdded)
+      mAdded(component, 1);
 
-    size_t newIndex = mSize;
-    mEntityToIndexMap[entity] = newIndex;
-    mIndexToEntityMap[newIndex] = entity;
-    mComponentArray[newIndex] = component;
-    mSize++;
+    if (entity >= mEntityToIndex.size())
+      mEntityToIndex.resize(entity + 1, INVALID_INDEX);
+    mEntityToIndex[entity] = static_cast<std::uint32_t>(mComponents.size());
+    mIndexToEntity.push_back(entity);
+    mComponents.push_back(std::move(component));
   }
 
-  bool HasData(Entity entity) override {
-    return mEntityToIndexMap.find(entity) != mEntityToIndexMap.end();
+  // Copies count components stored back to back at data, the entities
+  // must not have one yet
+  void InsertData(const Entity *entities, const void *data, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Bulk insertion copies the components' bytes");
+    size_t first = mComponents.size();
+    mComponents.resize(first + count);
+    std::memcpy(static_cast<void *>(mComponents.data() + first), data,
+                count * sizeof(T));
+    if (mAdded)
+      for (size_t i = first; i < first + count; ++i)
+        mAdded(mComponents[i], 1);
+    IndexEntities(entities, first, count);
   }
 
-  void RemoveData(Entity entity) {
-    assert(mEntityToIndexMap.find(entity) != mEntityToIndexMap.end() &&
-           "Removing non-existent component!!");
+  // The same component for count entities that have none yet
+  void InsertCopies(const Entity *entities, size_t count, const T &component) {
+    size_t first = mComponents.size();
+    mComponents.resize(first + count, component);
+    if (mAdded && count > 0)
+      mAdded(component, count);
+    IndexEntities(entities, first, count);
+  }
 
-    size_t indexOfRemovedEntity = mEntityToIndexMap[entity];
-    size_t indexOfLastComponent = mSize - 1;
+  void InsertDefaults(const Entity *entities, size_t count) override {
+    // checked before the pool grows, a second default would orphan a slot
+    for (size_t i = 0; i < count; ++i)
+      assert(!HasData(entities[i]) &&
+             "Component added to same entity more than once!!");
+    size_t first = mComponents.size();
+    mComponents.resize(first + count);
+    IndexEntities(entities, first, count);
+  }
 
-    mComponentArray[indexOfRemovedEntity] =
-        mComponentArray[indexOfLastComponent];
+  bool HasData(Entity entity) override {
+    return entity < mEntityToIndex.size() &&
+           mEntityToIndex[entity] != INVALID_INDEX;
+  }
 
-    Entity entityOfLastElement = mIndexToEntityMap[indexOfLastComponent];
-    mEntityToIndexMap[entityOfLastElement] = indexOfRemovedEntity;
-    mIndexToEntityMap[indexOfRemovedEntity] = entityOfLastElement;
+  void RemoveData(Entity entity) {
+    assert(HasData(entity) && "Removing non-existent component!!");
 
-    mEntityToIndexMap.erase(entity);
-    mIndexToEntityMap.erase(indexOfLastComponent);
+    std::uint32_t indexOfRemovedEntity = mEntityToIndex[entity];
+    Entity entityOfLastElement = mIndexToEntity.back();
+    if (mRemoved)
+      mRemoved(mComponents[indexOfRemovedEntity], 1);
 
-    mSize--;
+    mComponents[indexOfRemovedEntity] = std::move(mComponents.back());
+    mIndexToEntity[indexOfRemovedEntity] = entityOfLastElement;
+    mEntityToIndex[entityOfLastElement] = indexOfRemovedEntity;
+
+    mEntityToIndex[entity] = INVALID_INDEX;
+    mComponents.pop_back();
+    mIndexToEntity.pop_back();
   }
 
   T &GetData(Entity entity) {
-    assert(mEntityToIndexMap.find(entity) != mEntityToIndexMap.end() &&
-           "Retrieving non-existent component.");
-    return mComponentArray[mEntityToIndexMap[entity]];
+    assert(HasData(entity) && "Retrieving non-existent component.");
+    return mComponents[mEntityToIndex[entity]];
   }
-  void EntityDestroyed(Entity entity) {
-    if (mEntityToIndexMap.find(entity) != mEntityToIndexMap.end()) {
+  void EntityDestroyed(Entity entity) override {
+    if (HasData(entity)) {
       RemoveData(entity);
     }
   }
 
-  void Clear() {
-    mSize = 0;
-    mEntityToIndexMap.clear();
-    mIndexToEntityMap.clear();
-    mComponentArray.fill(T{}); 
+  void Clear() override {
+    if (mRemoved)
+      for (const T &component : mComponents)
+        mRemoved(component, 1);
+    mComponents.clear();
+    mIndexToEntity.clear();
+    mEntityToIndex.clear();
+  }
+
+  // Grows geometrically, so reserving for many small batches (streamed
+  // cells) doesn't reallocate the whole array each time
+  void Reserve(size_t count) override {
+    size_t wanted = mComponents.size() + count;
+    if (wanted <= mComponents.capacity())
+      return;
+    wanted = std::max(wanted, mComponents.capacity() * 2);
+    mComponents.reserve(wanted);
+    mIndexToEntity.reserve(wanted);
   }
 
+  template <typename U>
+  using PoolVector =
+      std::vector<U, TrackingAllocator<U, MemoryCategory::EcsPools>>;
+
+  // Packed components and the entity owning each, in the same order
+  const PoolVector<T> &GetComponents() const { return mComponents; }
+  const PoolVector<Entity> &GetEntities() const { return mIndexToEntity; }
+
 private:
-  std::array<T, MAX_ENTITIES> mComponentArray;
-  std::unordered_map<Entity, size_t> mEntityToIndexMap;
-  std::unordered_map<size_t, Entity> mIndexToEntityMap;
-  size_t mSize;
+  static constexpr std::uint32_t INVALID_INDEX = ~0u;
+
+  // Components from first on belong to entities, in order
+  void IndexEntities(const Entity *entities, size_t first, size_t count) {
+    mIndexToEntity.insert(mIndexToEntity.end(), entities, entities + count);
+    for (size_t i = 0; i < count; ++i) {
+      assert(!HasData(entities[i]) &&
+             "Component added to same entity more than once!!");
+      if (entities[i] >= mEntityToIndex.size())
+        mEntityToIndex.resize(entities[i] + 1, INVALID_INDEX);
+      mEntityToIndex[entities[i]] = static_cast<std::uint32_t>(first + i);
+    }
+  }
+
+  PoolVector<T> mComponents;
+  PoolVector<Entity> mIndexToEntity;
+  PoolVector<std::uint32_t> mEntityToIndex;
+  Hook mAdded, mRemoved;
 };
@@ -21,14 +21,20 @@ public:
   ComponentType GetComponentType() {
     std::type_index typeIndex(typeid(T));
 
-    assert(mComponentTypes.find(typeIndex) != mComponentTypes.end() &&
+    return GetComponentType(typeIndex);
+  }
+
+  // Lookups only, so safe to call from several threads at once
+  ComponentType GetComponentType(std::type_index typeindex) const {
+    auto it = mComponentTypes.find(typeindex);
+    assert(it != mComponentTypes.end() &&
            "Component not registered before use!!");
-    return mComponentTypes[typeIndex];
+    return it->second;
   }
 
   template <typename T> //
   void AddComponent(Entity entity, T component) {
-    GetComponentArray<T>()->InsertData(entity, component);
+    GetComponentArray<T>()->InsertData(entity, std::move(component));
   }
 
   template <typename T> //
@@ -67,18 +73,31 @@ public:
     }
   }
 
+  void Reserve(std::type_index typeindex, size_t count) {
+    auto it = mComponentArrays.find(typeindex);
+    if (it != mComponentArrays.end())
+      it->second->Reserve(count);
+  }
+
+  void AddDefaultComponents(std::type_index typeindex, const Entity *entities,
+                            size_t count) {
+    auto it = mComponentArrays.find(typeindex);
+    assert(it != mComponentArrays.end() &&
+           "Component not registered before use!!");
+    it->second->InsertDefaults(entities, count);
+  }
+
+  template <typename T> //
+  ComponentArray<T> *GetComponentArray() {
+    auto it = mComponentArrays.find(std::type_index(typeid(T)));
+    assert(it != mComponentArrays.end() &&
+           "Component not registered before use!!");
+    return static_cast<ComponentArray<T> *>(it->second.get());
+  }
+
 private:
   std::unordered_map<std::type_index, ComponentType> mComponentTypes{};
   std::unordered_map<std::type_index, std::shared_ptr<IComponentArray>>
       mComponentArrays{};
   ComponentType mNextComponentType{};
-
-  template <typename T> //
-  std::shared_ptr<ComponentArray<T>> GetComponentArray() {
-    std::type_index typeIndex(typeid(T));
-    assert(mComponentTypes.find(typeIndex) != mComponentTypes.end() &&
-           "Component not registered before use!!");
-    return std::static_pointer_cast<ComponentArray<T>>(
-        mComponentArrays[typeIndex]);
-  }
 };
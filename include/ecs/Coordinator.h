@@ -3,6 +3,7 @@
 #include "EntityManager.h"
 #include "SystemManager.h"
 #include "ecs/Types.h"
+#include <algorithm>
 #include <typeindex>
 class Coordinator {
 public:
@@ -12,10 +13,32 @@ public:
     mSystemManager = std::make_unique<SystemManager>();
   }
 
-  Entity CreateEntity() { return mEntityManager->CreateEntity(); }
-  Entity CreateEntity(Entity id) { return mEntityManager->CreateEntity(id); }
+  Entity CreateEntity() {
+    Entity entity = mEntityManager->CreateEntity();
+    MarkChanged(entity);
+    return entity;
+  }
+  Entity CreateEntity(Entity id) {
+    Entity entity = mEntityManager->CreateEntity(id);
+    MarkChanged(entity);
+    return entity;
+  }
+  void CreateEntities(const std::vector<Entity> &ids) {
+    mEntityManager->CreateEntities(ids);
+    for (Entity entity : ids)
+      MarkChanged(entity);
+  }
+
+  void DestroyEntity(Entity entity) {
+    if (!mEntityManager->IsAlive(entity))
+      return;
+    mComponentManager->EntityDestroyed(entity);
+    mEntityManager->DestroyEntity(entity);
+    mSystemManager->EntityDestroyed(entity);
+    MarkChanged(entity);
+  }
 
-  void DestroyEntity(Entity entity) { mEntityManager->DestroyEntity(entity); }
+  bool IsAlive(Entity entity) const { return mEntityManager->IsAlive(entity); }
 
   template <typename T> //
   void RegisterComponent() {
@@ -29,13 +52,42 @@ public:
 
   template <typename T> //
   void AddComponent(Entity entity, T component) {
-    mComponentManager->AddComponent<T>(entity, component);
+    mComponentManager->AddComponent<T>(entity, std::move(component));
 
     auto signature = mEntityManager->GetSignature(entity);
     signature.set(mComponentManager->GetComponentType<T>(), true);
     mEntityManager->SetSignature(entity, signature);
 
-    mSystemManager->EntitySignatureChanged(entity, signature);
+    SignatureChanged(entity, signature);
+  }
+
+  // AddComponent for count entities, copying components stored back to back
+  // (they need not be aligned)
+  template <typename T> //
+  void AddComponents(const Entity *entities, const void *components,
+                     size_t count) {
+    mComponentManager->GetComponentArray<T>()->InsertData(entities, components,
+                                                          count);
+    ComponentType type = mComponentManager->GetComponentType<T>();
+    for (size_t i = 0; i < count; ++i) {
+      auto signature = mEntityManager->GetSignature(entities[i]);
+      signature.set(type, true);
+      mEntityManager->SetSignature(entities[i], signature);
+      SignatureChanged(entities[i], signature);
+    }
+  }
+
+  template <typename T> //
+  const ComponentArray<T> &GetComponentArray() {
+    return *mComponentManager->GetComponentArray<T>();
+  }
+
+  // See ComponentArray::SetHooks
+  template <typename T> //
+  void SetComponentHooks(typename ComponentArray<T>::Hook added,
+                         typename ComponentArray<T>::Hook removed) {
+    mComponentManager->GetComponentArray<T>()->SetHooks(std::move(added),
+                                                         std::move(removed));
   }
 
   template <typename T> //
@@ -55,7 +107,58 @@ public:
     signature.set(mComponentManager->GetComponentType<T>(), false);
     mEntityManager->SetSignature(entity, signature);
 
-    mSystemManager->EntitySignatureChanged(entity, signature);
+    SignatureChanged(entity, signature);
+  }
+
+  // AddComponent of the same value for count entities
+  template <typename T> //
+  void AddComponentCopies(const Entity *entities, size_t count,
+                          const T &component) {
+    mComponentManager->GetComponentArray<T>()->InsertCopies(entities, count,
+                                                            component);
+    ComponentType type = mComponentManager->GetComponentType<T>();
+    for (size_t i = 0; i < count; ++i) {
+      auto signature = mEntityManager->GetSignature(entities[i]);
+      signature.set(type, true);
+      mEntityManager->SetSignature(entities[i], signature);
+      SignatureChanged(entities[i], signature);
+    }
+  }
+
+  // Default-constructed components of the type registered as typeindex
+  void AddDefaultComponents(std::type_index typeindex, const Entity *entities,
+                            size_t count) {
+    mComponentManager->AddDefaultComponents(typeindex, entities, count);
+    ComponentType type = mComponentManager->GetComponentType(typeindex);
+    for (size_t i = 0; i < count; ++i) {
+      auto signature = mEntityManager->GetSignature(entities[i]);
+      signature.set(type, true);
+      mEntityManager->SetSignature(entities[i], signature);
+      SignatureChanged(entities[i], signature);
+    }
+  }
+
+  // Room for count more components of the type registered as typeindex
+  void ReserveComponents(std::type_index typeindex, size_t count) {
+    mComponentManager->Reserve(typeindex, count);
+  }
+
+  // Between BeginBatch and CommitBatch systems are not told about component
+  // changes; CommitBatch matches every touched entity against them once
+  // instead of once per component.
+  void BeginBatch() { mBatching = true; }
+
+  void CommitBatch() {
+    mBatching = false;
+    std::sort(mBatchEntities.begin(), mBatchEntities.end());
+    std::vector<Signature> signatures;
+    signatures.reserve(mBatchEntities.size());
+    for (Entity entity : mBatchEntities) {
+      mBatchMarks[entity] = false;
+      signatures.push_back(mEntityManager->GetSignature(entity));
+    }
+    mSystemManager->EntitiesSignatureChanged(mBatchEntities, signatures);
+    mBatchEntities.clear();
   }
 
   template <typename T> //
@@ -82,14 +185,78 @@ public:
     return mEntityManager->GetAllEntities();
   }
 
-  void DestroyAllEntities() { 
+  // Entities created, destroyed or given/stripped of a component since the
+  // last ClearChanges(), in no particular order. Components edited in place
+  // through GetComponent are only reported once MarkChanged is called.
+  const std::vector<Entity> &GetChangedEntities() const { return mChanged; }
+
+  void MarkChanged(Entity entity) {
+    if (entity >= mChangedMarks.size())
+      mChangedMarks.resize(entity + 1, false);
+    if (!mChangedMarks[entity]) {
+      mChangedMarks[entity] = true;
+      mChanged.push_back(entity);
+    }
+  }
+
+  void ClearChanges() {
+    for (Entity entity : mChanged)
+      mChangedMarks[entity] = false;
+    mChanged.clear();
+  }
+
+  void DestroyAllEntities() {
+    // they are gone for whoever tracks changes as well
+    for (Entity entity : mEntityManager->GetAllEntities())
+      MarkChanged(entity);
+    for (Entity entity : mBatchEntities)
+      mBatchMarks[entity] = false;
+    mBatchEntities.clear();
     mEntityManager->DestroyAllEntities();
     mComponentManager->ClearAllEntities();
     mSystemManager->Clear();
   }
 
 private:
+  void SignatureChanged(Entity entity, Signature signature) {
+    MarkChanged(entity);
+    if (!mBatching) {
+      mSystemManager->EntitySignatureChanged(entity, signature);
+      return;
+    }
+    if (entity >= mBatchMarks.size())
+      mBatchMarks.resize(entity + 1, false);
+    if (!mBatchMarks[entity]) {
+      mBatchMarks[entity] = true;
+      mBatchEntities.push_back(entity);
+    }
+  }
+
   std::unique_ptr<ComponentManager> mComponentManager;
   std::unique_ptr<EntityManager> mEntityManager;
   std::unique_ptr<SystemManager> mSystemManager;
+
+  bool mBatching = false;
+  std::vector<Entity> mBatchEntities;
+  std::vector<bool> mBatchMarks;
+
+  std::vector<Entity> mChanged;
+  std::vector<bool> mChangedMarks;
+};
+
+// BeginBatch for the lifetime of the scope, committed however it is left,
+// so a throwing deserializer doesn't leave the systems uninformed
+class CoordinatorBatch {
+public:
+  explicit CoordinatorBatch(Coordinator &coordinator)
+      : mCoordinator(coordinator) {
+    mCoordinator.BeginBatch();
+  }
+  ~CoordinatorBatch() { mCoordinator.CommitBatch(); }
+
+  CoordinatorBatch(const CoordinatorBatch &) = delete;
+  CoordinatorBatch &operator=(const CoordinatorBatch &) = delete;
+
+private:
+  Coordinator &mCoordinator;
 };
@@ -1,82 +1,87 @@
 #pragma once
 #include "Types.h"
 #include <algorithm>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <vector>
 
 class EntityManager {
 public:
-  EntityManager() {
-    for (Entity entity = 0; entity < MAX_ENTITIES; ++entity) {
-      mAvailableEntities.push(entity);
-    }
-  }
+  EntityManager() = default;
 
   Entity CreateEntity() {
     assert(mLivingEntities.size() < MAX_ENTITIES &&
            "Too many entities in existence!!");
 
-    Entity id = mAvailableEntities.front();
-    mAvailableEntities.pop();
-
-    mLivingEntities.push_back(id);
-    // mLivingEntityCount++;
+    // destroyed ids first, skipping ones claimed since by CreateEntity(id)
+    while (!mAvailableEntities.empty()) {
+      Entity id = mAvailableEntities.front();
+      mAvailableEntities.pop_front();
+      if (!IsAlive(id)) {
+        Revive(id);
+        return id;
+      }
+    }
 
+    while (IsAlive(mNextUnused))
+      ++mNextUnused;
+    assert(mNextUnused < MAX_ENTITIES && "Too many entities in existence!!");
+    Entity id = mNextUnused++;
+    Revive(id);
     return id;
   }
 
   Entity CreateEntity(Entity id) {
     assert(id < MAX_ENTITIES && "Too many entities in existence!!");
-    auto it = std::find(mLivingEntities.begin(), mLivingEntities.end(), id);
-    assert(it == mLivingEntities.end() &&
-           "Entity with this ID already exists!");
-
-    std::queue<Entity> newQueue;
-    bool found = false;
-    while (!mAvailableEntities.empty()) {
-      Entity e = mAvailableEntities.front();
-      mAvailableEntities.pop();
-
-      if (e == id) {
-        found = true;
-        continue;
-      }
-
-      newQueue.push(e);
-    }
-    assert(found && "ID not available for creation!");
-
-    mAvailableEntities = std::move(newQueue);
-
-    mLivingEntities.push_back(id);
-
-    mSignatures[id].reset();
+    assert(!IsAlive(id) && "Entity with this ID already exists!");
 
+    // a copy left in mAvailableEntities is skipped when it comes up
+    Revive(id);
     return id;
   }
 
+  // CreateEntity(id) for every id, storage reserved once up front
+  void CreateEntities(const std::vector<Entity> &ids) {
+    Entity maxId = 0;
+    for (Entity id : ids)
+      maxId = std::max(maxId, id);
+    if (!ids.empty())
+      Grow(maxId);
+    mLivingEntities.reserve(mLivingEntities.size() + ids.size());
+    for (Entity id : ids)
+      CreateEntity(id);
+  }
+
   void DestroyEntity(Entity entity) {
     assert(entity < MAX_ENTITIES && "Entity out of range!!");
+    if (!IsAlive(entity))
+      return;
     mSignatures[entity].reset();
-    mAvailableEntities.push(entity);
-
-    auto it = std::find(mLivingEntities.begin(), mLivingEntities.end(), entity);
-    if (it != mLivingEntities.end()) {
-      std::cout << "DELETE: " << entity << std::endl;
-      mLivingEntities.erase(it);
-    }
-    // mLivingEntityCount--;
+    mAvailableEntities.push_back(entity);
+
+    // swap with the last living entity
+    std::uint32_t index = mLivingIndex[entity];
+    Entity last = mLivingEntities.back();
+    mLivingEntities[index] = last;
+    mLivingIndex[last] = index;
+    mLivingEntities.pop_back();
+    mLivingIndex[entity] = NOT_LIVING;
   }
 
   void SetSignature(Entity entity, Signature signature) {
     assert(entity < MAX_ENTITIES && "Entity out of range!!");
+    Grow(entity);
     mSignatures[entity] = signature;
   }
 
   Signature GetSignature(Entity entity) {
     assert(entity < MAX_ENTITIES && "Entity out of range!!");
-    return mSignatures[entity];
+    return entity < mSignatures.size() ? mSignatures[entity] : Signature{};
+  }
+
+  bool IsAlive(Entity entity) const {
+    return entity < mLivingIndex.size() && mLivingIndex[entity] != NOT_LIVING;
   }
 
   const std::vector<Entity> &GetAllEntities() const { return mLivingEntities; }
@@ -84,15 +89,37 @@ public:
   void DestroyAllEntities() {
     for (Entity e : mLivingEntities) {
       mSignatures[e].reset();
-      mAvailableEntities.push(e);
+      mLivingIndex[e] = NOT_LIVING;
     }
     mLivingEntities.clear();
+    mAvailableEntities.clear();
+    mNextUnused = 0;
   }
 
 private:
-  std::queue<Entity> mAvailableEntities{};
-  std::array<Signature, MAX_ENTITIES> mSignatures{};
+  static constexpr std::uint32_t NOT_LIVING = ~0u;
+
+  void Grow(Entity entity) {
+    if (entity < mLivingIndex.size())
+      return;
+    size_t size = std::max<size_t>(entity + 1, mLivingIndex.size() * 2);
+    size = std::min<size_t>(size, MAX_ENTITIES);
+    mLivingIndex.resize(size, NOT_LIVING);
+    mSignatures.resize(size);
+  }
+
+  void Revive(Entity id) {
+    Grow(id);
+    mLivingIndex[id] = static_cast<std::uint32_t>(mLivingEntities.size());
+    mLivingEntities.push_back(id);
+    mSignatures[id].reset();
+  }
 
-  // uint32_t mLivingEntityCount{};
+  // destroyed ids, reused before ids that were never handed out
+  std::deque<Entity> mAvailableEntities{};
+  Entity mNextUnused = 0;
+  std::vector<Signature> mSignatures{};
+  // position in mLivingEntities, NOT_LIVING for free ids
+  std::vector<std::uint32_t> mLivingIndex;
   std::vector<Entity> mLivingEntities;
 };
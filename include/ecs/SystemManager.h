@@ -1,7 +1,9 @@
 #pragma once
 #include "Types.h"
+#include <iterator>
 #include <memory>
 #include <typeindex>
+#include <vector>
 
 class System {
 public:
@@ -59,6 +61,27 @@ public:
     }
   }
 
+  // EntitySignatureChanged for many entities, sorted by id, so each system's
+  // set is filled in order instead of searched once per entity
+  void EntitiesSignatureChanged(const std::vector<Entity> &entities,
+                                const std::vector<Signature> &signatures) {
+    for (auto const &pair : mSystems) {
+      auto const &system = pair.second;
+      auto const &systemSignature = mSignatures[pair.first];
+      auto hint = system->mEntities.begin();
+
+      for (size_t i = 0; i < entities.size(); ++i) {
+        if ((signatures[i] & systemSignature) == systemSignature) {
+          hint = std::next(system->mEntities.insert(hint, entities[i]));
+        } else if (hint != system->mEntities.end() && *hint == entities[i]) {
+          hint = system->mEntities.erase(hint);
+        } else {
+          system->mEntities.erase(entities[i]);
+        }
+      }
+    }
+  }
+
   void Clear() {
     for (auto &[_, system] : mSystems) {
       system->mEntities.clear();
@@ -11,7 +11,8 @@
 #include <unordered_map>
 
 using Entity = std::uint32_t;
-const Entity MAX_ENTITIES = 5000;
+// Upper bound on entity ids; storage grows with the ids actually used
+const Entity MAX_ENTITIES = 1u << 20;
 
 using ComponentType = std::uint8_t;
 const ComponentType MAX_COMPONENTS = 32;
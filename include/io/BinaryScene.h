@@ -0,0 +1,133 @@
+#pragma once
+#include "ecs/Types.h"
+#include "io/MappedFile.h"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// .rcscene files, all integers 32-bit:
+//
+//   header    "RCSC", format version, byte order mark, string, entity and
+//             column counts
+//   strings   length + bytes each: component names, resource paths, ...
+//   entities  every entity id of the scene
+//   columns   one per component type: name (string index), schema version,
+//             record size, count, then count entity ids and count records
+//
+// Records hold the component as laid out in memory by the build that wrote
+// the file, so files are meant for the platform they were saved on. A
+// column of record size 0 holds string indices of JSON documents instead,
+// for components without a binary layout.
+
+// Strings of a scene being written, each stored once
+class SceneStringTable {
+public:
+  std::uint32_t Intern(const std::string &value);
+  const std::vector<std::string> &GetStrings() const { return mStrings; }
+
+private:
+  std::vector<std::string> mStrings;
+  std::unordered_map<std::string, std::uint32_t> mIndices;
+};
+
+struct BinarySceneColumn {
+  std::uint32_t name; // string index
+  std::uint32_t schemaVersion;
+  std::uint32_t recordSize;
+  std::vector<Entity> entities;
+  std::vector<char> records;
+};
+
+bool WriteBinaryScene(const std::string &path,
+                      const std::vector<std::string> &strings,
+                      const std::vector<Entity> &entities,
+                      const std::vector<BinarySceneColumn> &columns);
+// The same bytes to a stream, false if it failed
+bool WriteBinaryScene(std::ostream &out,
+                      const std::vector<std::string> &strings,
+                      const std::vector<Entity> &entities,
+                      const std::vector<BinarySceneColumn> &columns);
+
+// Validated view of a mapped .rcscene file
+class BinarySceneReader {
+public:
+  struct Column {
+    std::uint32_t name;
+    std::uint32_t schemaVersion;
+    std::uint32_t recordSize;
+    std::uint32_t count;
+    const char *entities; // count ids, not necessarily aligned
+    const char *records;
+  };
+
+  // Logs why and returns false when the file is missing or malformed
+  bool Open(const std::string &path);
+  // A scene held in memory, which has to outlive the reader; name is only
+  // used in messages
+  bool Open(const char *data, size_t size, const std::string &name);
+
+  const std::vector<std::string> &GetStrings() const { return mStrings; }
+  const std::vector<Entity> &GetEntities() const { return mEntities; }
+  const std::vector<Column> &GetColumns() const { return mColumns; }
+
+private:
+  bool Parse(const char *data, size_t size, const std::string &name);
+
+  MappedFile mFile;
+  std::vector<std::string> mStrings;
+  std::vector<Entity> mEntities;
+  std::vector<Column> mColumns;
+};
+
+// Delta logs extend a scene file with what changed since it was written:
+//
+//   header   "RCDL", format version, byte order mark, then the size and
+//            modification time of the scene file the log belongs to
+//   records  one per save: destroyed entity count, scene size (64-bit),
+//            the destroyed ids, then a binary scene of the entities created
+//            or changed, each with all of its components
+//
+// A log whose stamp doesn't match its scene was left from an older one.
+
+struct SceneFileStamp {
+  std::uint64_t size = 0;
+  std::int64_t time = 0;
+
+  bool operator==(const SceneFileStamp &other) const {
+    return size == other.size && time == other.time;
+  }
+};
+
+bool ReadSceneFileStamp(const std::string &path, SceneFileStamp &stamp);
+
+// Appends one record, starting the log for base if there is none. A failed
+// append is cut off again so later records stay readable.
+bool AppendSceneDelta(const std::string &logPath, const SceneFileStamp &base,
+                      const std::vector<Entity> &destroyed,
+                      const std::vector<std::string> &strings,
+                      const std::vector<Entity> &entities,
+                      const std::vector<BinarySceneColumn> &columns);
+
+class SceneDeltaReader {
+public:
+  // False, silently, when there is no log; logs why for anything else
+  bool Open(const std::string &path);
+  const SceneFileStamp &GetBase() const { return mBase; }
+
+  // False at the end of the log, or at a torn or malformed record (left by
+  // an interrupted save), which IsTorn() tells apart. scene reads from the
+  // log, so it's valid while this reader is open.
+  bool Next(std::vector<Entity> &destroyed, BinarySceneReader &scene);
+  bool IsTorn() const { return mTorn; }
+  // Bytes up to the end of the last complete record
+  size_t GetValidSize() const { return mOffset; }
+
+private:
+  std::string mPath;
+  MappedFile mFile;
+  SceneFileStamp mBase;
+  size_t mOffset = 0;
+  bool mTorn = false;
+};
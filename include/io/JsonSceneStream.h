@@ -0,0 +1,33 @@
+#pragma once
+#include <functional>
+#include <iosfwd>
+#include <nlohmann/json.hpp>
+#include <string>
+
+// Reads and writes the "entities" array of JSON scenes one entity at a
+// time, so memory stays bounded by the largest entity instead of growing
+// with the whole document.
+
+// Calls onEntity for each element of the top-level "entities" array as soon
+// as it has been parsed; other top-level keys are skipped. On a parse error
+// returns false with the message in error, entities before it have been
+// delivered.
+bool ReadJsonSceneEntities(
+    std::istream &in, const std::function<void(nlohmann::json &)> &onEntity,
+    std::string &error);
+
+// Writes {"entities":[...]} entity by entity, the same bytes dump() gives
+// for the whole document
+class JsonSceneWriter {
+public:
+  explicit JsonSceneWriter(std::ostream &out);
+  ~JsonSceneWriter(); // closes the document if Finish() wasn't called
+
+  void WriteEntity(const nlohmann::json &entity);
+  void Finish();
+
+private:
+  std::ostream &mOut;
+  bool mFirst = true;
+  bool mFinished = false;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Memory-mapped where the platform allows
+// it, read into a buffer otherwise.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  bool IsOpen() const { return mOpen; }
+  const char *Data() const { return mData; }
+  size_t Size() const { return mSize; }
+
+private:
+  void Close();
+
+  const char *mData = nullptr;
+  size_t mSize = 0;
+  bool mOpen = false;
+  bool mMapped = false;
+  std::vector<char> mBuffer;
+};
@@ -1,27 +1,210 @@
 #pragma once
 
+#include "core/HandlePool.h"
+#include "core/ResourcePool.h"
 #include "render/Mesh.h"
+#include "render/MeshCache.h"
+#include "render/StagingUploader.h"
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+class ThreadPool;
+
+// Generational handle, see HandlePool. 0 is never a valid mesh.
 using MeshId = std::uint32_t;
 
+// What drawing needs of a mesh every frame, packed in the handle slots
+// apart from paths and reference counts
+struct MeshInfo {
+  Mesh *mesh = nullptr; // nullptr while loading
+  glm::vec3 boundsCenter{0.0f};
+  float boundsRadius = 0.0f;
+  std::uint32_t indexCount = 0; // base level
+  std::uint32_t lodCount = 0;
+  std::uint32_t vertexStride = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+};
+
+struct LodSettings {
+  // triangle budget of each generated level, relative to the base mesh
+  std::vector<float> ratios{0.5f, 0.25f, 0.125f};
+  // largest simplification error, relative to the bounding radius
+  float maxError = 0.1f;
+  // levels are not generated below this triangle count
+  size_t minTriangles = 64;
+};
+
+struct OptimizeSettings {
+  // Tipsify triangle order for the post-transform vertex cache
+  bool vertexCache = true;
+  // draws outward facing clusters first, trades a little cache efficiency
+  bool overdraw = false;
+  // tolerated ACMR increase when cutting clusters for the overdraw pass
+  float overdrawThreshold = 1.05f;
+  // vertex buffer order follows first use in the index buffer
+  bool vertexFetch = true;
+};
+
+struct MeshMemoryStats {
+  size_t meshes = 0;
+  size_t gpuBytes = 0;
+  // geometry kept on the CPU side, none once it is released after upload
+  size_t cpuBytes = 0;
+  // the same meshes as 32-byte float vertices, float position stream and
+  // 32-bit indices
+  size_t fullPrecisionBytes = 0;
+};
+
+// Ids are reference counted: each Load* call takes a reference that
+// ReleaseMesh gives back. Meshes nobody references are pooled, least
+// recently released first out once the pool exceeds its budget, so a path
+// requested again comes back without I/O.
+// Thread-safe. Methods that create or destroy GL objects (LoadMesh,
+// GetMesh, ProcessUploads, Clear) must run on the context thread. GetMesh
+// and GetInfo don't lock, they are meant for the draw path.
 class MeshManager {
 public:
   MeshManager() = default;
 
+  // Blocks until the mesh is uploaded, finishing an async request for the
+  // same path if one is in flight
   MeshId LoadMesh(const std::string& path);
-  std::shared_ptr<Mesh> GetMesh(MeshId id);
-  std::string& GetPath(MeshId id);
+  // Returns at once; the asset is loaded on a worker and uploaded by a
+  // later ProcessUploads. Requests for a path already known share its id.
+  MeshId LoadMeshAsync(const std::string &path);
+  // Starts loading like LoadMeshAsync without taking a reference, for
+  // loaders that know the mesh will be asked for soon
+  MeshId PrefetchMesh(const std::string &path);
+  // References for holders copying an id they didn't load, like component
+  // pools
+  void RetainMesh(MeshId id, unsigned int count = 1);
+  // Drops a reference; the mesh is pooled once none are left. Doesn't
+  // touch GL, evictions wait for ProcessUploads.
+  void ReleaseMesh(MeshId id);
+  // Creates meshes for finished async loads until budgetMs is spent (at
+  // least one) and streams the frame's share of large buffers, after
+  // evicting pooled meshes over budget. Returns how many meshes became
+  // ready.
+  size_t ProcessUploads(double budgetMs);
+  // The placeholder while the mesh is still loading, nullptr for ids that
+  // are 0 or stale
+  Mesh *GetMesh(MeshId id);
+  const MeshInfo *GetInfo(MeshId id);
+  bool IsReady(MeshId id) const;
+  size_t GetPendingCount() const;
+  // Empty for unknown ids
+  const std::string &GetPath(MeshId id) const;
+  // Drops every mesh, referenced or not; pending async loads are dropped
   void Clear();
+
+  // Without workers LoadMeshAsync loads on the calling thread
+  void SetWorkers(ThreadPool *workers) { mWorkers = workers; }
+
+  // Applies to meshes loaded afterwards, must not change while async loads
+  // are in flight
+  void SetLodSettings(const LodSettings &settings) { mLodSettings = settings; }
+  const LodSettings &GetLodSettings() const { return mLodSettings; }
+  void SetOptimizeSettings(const OptimizeSettings &settings) {
+    mOptimizeSettings = settings;
+  }
+  void SetVertexLayout(const VertexLayout &layout) { mVertexLayout = layout; }
+  const VertexLayout &GetVertexLayout() const { return mVertexLayout; }
+  // Meshes created afterwards keep their vertices and indices on the CPU
+  // side too (the default), or only bounds and counts
+  void SetKeepCpuGeometry(bool keep) { mKeepCpuGeometry = keep; }
+  bool GetKeepCpuGeometry() const { return mKeepCpuGeometry; }
+
+  MeshMemoryStats GetMemoryStats() const;
+
+  // Applies from the next ProcessUploads
+  void SetPoolSettings(const ResourcePoolSettings &settings);
+  ResourcePoolStats GetPoolStats() const;
+  void ResetPoolStats();
+
+  // Async loads at least minStreamBytes big are streamed through the
+  // staging uploader instead of one glBufferData per buffer
+  void SetStagingSettings(const StagingSettings &settings) {
+    mUploader.SetSettings(settings);
+  }
+  const StagingStats &GetUploadStats() const { return mUploader.GetStats(); }
+
+  // Import pipeline without the GL upload: the cache entry when it is still
+  // valid, otherwise parse, optimize, build LODs, encode and store
+  bool LoadAsset(const std::string &path, MeshAsset &asset);
+  MeshCache &GetCache() { return mCache; }
+
 private:
+  struct CompletedLoad {
+    MeshId id;
+    unsigned int generation;
+    MeshAsset asset;
+  };
+
+  // Cold side of a slot, under the lock
+  struct MeshRecord {
+    std::string path;
+    std::shared_ptr<Mesh> mesh; // owns MeshInfo::mesh
+    unsigned int refs = 0;
+  };
+
+  // A slot and record for path. Locked.
+  MeshId NewId(const std::string &path, unsigned int references);
+  MeshRecord &Record(MeshId id) {
+    return mRecords[HandlePool<MeshInfo>::Index(id)];
+  }
+
+  // LoadMeshAsync taking the given number of references
+  MeshId RequestAsync(const std::string &path, unsigned int references);
+  // Adds references to a known id, from the pool if it was there. Locked.
+  void Reference(MeshId id, unsigned int references);
+  // The mesh is ready to draw; pooled if nobody references it. Locked.
+  void MakeReady(MeshId id, std::shared_ptr<Mesh> mesh);
+  // Frees pooled meshes over budget, on the context thread
+  void EvictPooled();
+
+  std::shared_ptr<Mesh> CreateMesh(const std::string &path, MeshAsset &asset,
+                                   bool stream = false);
+  // moves meshes whose streamed upload finished to mIdToMesh
+  size_t PromoteStreamed();
+
+  mutable std::mutex mMutex;
+  std::condition_variable mLoadCompleted;
+  // loaded on a worker, waiting for ProcessUploads
+  std::deque<CompletedLoad> mCompleted;
+  std::unordered_set<MeshId> mPending;
+  // bumped by Clear() so loads started before it are discarded
+  unsigned int mGeneration = 0;
+  ThreadPool *mWorkers = nullptr;
+  // declared before the meshes, which cancel their copies when destroyed
+  StagingUploader mUploader;
+  std::shared_ptr<Mesh> mPlaceholder;
+  MeshInfo mPlaceholderInfo;
+  // created, waiting for the uploader
+  std::unordered_map<MeshId, std::shared_ptr<Mesh>> mStreaming;
+  bool mUploaderBusy = false;
+
   std::unordered_map<std::string, MeshId> mPathToId;
-  std::unordered_map<MeshId,std::string> mIdToPath;
-  std::unordered_map<MeshId, std::shared_ptr<Mesh>> mIdToMesh;
+  HandlePool<MeshInfo> mSlots;
+  // by slot index, a deque so GetPath's references stay put
+  std::deque<MeshRecord> mRecords;
+  ResourcePool<MeshId> mPool;
+  ResourcePoolSettings mPoolSettings;
+  LodSettings mLodSettings;
+  OptimizeSettings mOptimizeSettings;
+  VertexLayout mVertexLayout;
+  bool mKeepCpuGeometry = true;
+  MeshCache mCache;
 
-  void LoadOBJ(const std::string &path, std::vector<Vertex> &outVertices,
-                  std::vector<unsigned int>& outIndices);
-  MeshId mNextId = 0;
+  uint64_t GetSettingsHash() const;
+  void OptimizeMesh(const std::string &path, std::vector<Vertex> &vertices,
+                    std::vector<unsigned int> &indices);
+  // Appends simplified levels to indices, returns the whole LOD table
+  std::vector<MeshLod> BuildLods(const std::vector<Vertex> &vertices,
+                                 std::vector<unsigned int> &indices);
 };
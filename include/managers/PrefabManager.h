@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ecs/Coordinator.h"
+#include "ecs/Types.h"
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class SerializationRegistry;
+struct ResourceContext;
+
+// Handle to a prefab owned by PrefabManager
+using PrefabId = std::uint32_t;
+constexpr PrefabId INVALID_PREFAB = ~0u;
+
+// Prefabs are JSON files of component values, {"components": {...}} like a
+// scene entity without an id. Each is converted once, into a prototype
+// entity of a coordinator of its own; instances are given copies of its
+// components, so spawning never touches JSON. Not thread-safe.
+class PrefabManager {
+public:
+  PrefabManager(const SerializationRegistry &registry,
+                ResourceContext &resources);
+
+  PrefabManager(const PrefabManager &) = delete;
+  PrefabManager &operator=(const PrefabManager &) = delete;
+
+  // Loaded once per path, INVALID_PREFAB when it can't be read
+  PrefabId Load(const std::string &path);
+  // Adds the prefab's components to count entities that have none of them
+  // yet, and a PrefabComponent naming the prefab
+  void Instantiate(PrefabId id, const Entity *entities, size_t count,
+                   Coordinator &coordinator);
+
+  // The prefab's value of the component at index in the registry, as its
+  // serializer writes it; what instances override and are saved against.
+  // nullptr when the prefab doesn't have it.
+  const nlohmann::json *GetComponentData(PrefabId id, size_t index) const;
+  // Empty for unknown ids
+  const std::string &GetPath(PrefabId id) const;
+  size_t GetCount() const { return mPrefabs.size(); }
+  // Ids are handed out again from 0
+  void Clear();
+
+private:
+  struct Prefab {
+    std::string path;
+    Entity prototype;
+    // registry indices of its components
+    std::vector<size_t> components;
+    // by registry index, null where the prefab has no such component
+    std::vector<nlohmann::json> data;
+  };
+
+  const SerializationRegistry &mRegistry;
+  ResourceContext &mResources;
+  Coordinator mPrototypes;
+  std::vector<Prefab> mPrefabs;
+  // failed paths too, so their instances don't read the file again
+  std::unordered_map<std::string, PrefabId> mPathToId;
+};
@@ -3,7 +3,11 @@
 #include "managers/MeshManager.h"
 #include "managers/ShaderManager.h"
 
+class PrefabManager;
+
 struct ResourceContext {
   MeshManager* meshes;
   ShaderManager* shaders;
+  // scenes referring to prefabs need one
+  PrefabManager *prefabs = nullptr;
 };
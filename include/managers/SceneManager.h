@@ -1,21 +1,88 @@
 #pragma once
 
+#include "core/ThreadPool.h"
 #include "ecs/Coordinator.h"
+#include "io/BinaryScene.h"
 #include "managers/ResourceContext.h"
 #include "managers/SerializationRegistry.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 class SceneManager {
 public:
   SceneManager(Coordinator &coord, SerializationRegistry &reg,
                ResourceContext &resources);
 
+  // Whole scene as one JSON document
   Json SerializeScene();
   void DeserializeScene(const Json &scene);
 
-  void LoadScene(const std::string &path);
-  void SaveScene(const std::string &path);
+  // Binary for paths ending in BINARY_EXTENSION, JSON otherwise. A scene
+  // loaded into an empty world or saved becomes the delta base: what
+  // changes afterwards can be appended to it with SaveSceneDelta.
+  // LoadScene replays the delta log next to the file, SaveScene writes a
+  // full snapshot and drops the log (compaction).
+  bool LoadScene(const std::string &path);
+  bool SaveScene(const std::string &path);
+  // Appends the entities changed since the last save to the log next to
+  // path, so the cost follows the size of the change. Falls back to
+  // SaveScene when path isn't the delta base.
+  bool SaveSceneDelta(const std::string &path);
+  // Loads from into the current (emptied) world and saves it as to, so the
+  // format of each follows its extension
+  bool ConvertScene(const std::string &from, const std::string &to);
+
+  // JSON scenes are streamed, never held as a whole document
+  bool LoadJsonScene(const std::string &path);
+  bool SaveJsonScene(const std::string &path);
+  bool LoadBinaryScene(const std::string &path);
+  bool SaveBinaryScene(const std::string &path);
+
+  // Binary scene of only these entities, and the way back: the entities of
+  // reader are added under new ids, which are appended to created. For
+  // pieces of a world that come and go, e.g. streamed cells. Loading is
+  // false when a component couldn't be read, the others are still added.
+  bool SaveEntities(const std::string &path,
+                    const std::vector<Entity> &entities);
+  bool LoadEntities(const BinarySceneReader &reader,
+                    std::vector<Entity> &created);
+
+  // Components are converted on these as well when loading, if set
+  void SetWorkers(ThreadPool *workers) { mWorkers = workers; }
+
+  static constexpr const char *BINARY_EXTENSION = ".rcscene";
+  static bool IsBinaryScenePath(const std::string &path);
+  // The binary delta log of a scene (any format), path + ".delta"
+  static std::string GetDeltaLogPath(const std::string &path);
 
 private:
+  Json SerializeEntity(Entity entity);
+  // Creates the entities and their components; systems only see them at the
+  // next CommitBatch
+  void DeserializeEntities(const std::vector<const Json *> &entities,
+                           std::unordered_set<std::string> &unknown);
+  void LogLoaded(const std::string &path);
+  // False when the log doesn't belong to the base at path or a record had
+  // components that couldn't be read; a torn last record is dropped
+  bool ApplyDeltaLog(const std::string &path);
+  void SetDeltaBase(const std::string &path);
+  // Columns of every entity, or only of those listed
+  void BuildBinaryColumns(const std::vector<Entity> *only,
+                          SceneStringTable &strings,
+                          std::vector<BinarySceneColumn> &columns);
+  // Under the ids of the file, or under new ones appended to created. False
+  // when a component couldn't be read, the rest are loaded anyway.
+  bool LoadBinaryColumns(const BinarySceneReader &reader,
+                         std::vector<Entity> *created = nullptr);
+
   Coordinator &mCoordinator;
   SerializationRegistry &mRegistry;
   ResourceContext &mResourceContext;
+  ThreadPool *mWorkers = nullptr;
+
+  // file the change set of the coordinator is relative to, and its stamp
+  // then, written into its log to recognise a replaced base
+  std::string mDeltaBase;
+  SceneFileStamp mDeltaBaseStamp;
 };
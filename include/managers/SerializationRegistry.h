@@ -2,40 +2,187 @@
 
 #include "ecs/Coordinator.h"
 #include "ecs/Types.h"
+#include "io/BinaryScene.h"
 #include "managers/ResourceContext.h"
+#include <cstdint>
 #include <functional>
 #include <nlohmann/json.hpp>
+#include <string>
 #include <typeindex>
+#include <type_traits>
 #include <typeinfo>
 #include <unordered_map>
+#include <vector>
 
 using Json = nlohmann::json;
 
+// How a component type is stored in binary scenes: one fixed-size record
+// per component. Types without one are stored as JSON documents there too.
+struct BinaryColumn {
+  std::uint32_t record_size = 0;
+  // Appends the entities having the component and their records, or only
+  // those listed in the 4th argument (all of which have it) when not null
+  std::function<void(Coordinator &, ResourceContext &, SceneStringTable &,
+                     const std::vector<Entity> *, std::vector<Entity> &,
+                     std::vector<char> &)>
+      write;
+  // Adds the components of count entities from consecutive records (not
+  // necessarily aligned); strings is the scene's string table
+  std::function<void(const Entity *, const char *, size_t, Coordinator &,
+                     ResourceContext &, const std::vector<std::string> &)>
+      read;
+  // Rewrites count records saved with an older schema version and record
+  // size in the current layout. Without it such columns are skipped.
+  std::function<bool(int, std::uint32_t, const char *, size_t,
+                     std::vector<char> &)>
+      migrate;
+};
+
+struct ComponentRecord {
+  Entity entity;
+  const Json *data;
+};
+
 struct ComponentSerializer {
   int schema_version;
   std::function<Json(Entity, Coordinator &, ResourceContext&)> serialize;
   std::function<void(Entity, const Json &, Coordinator &, ResourceContext&)> deserialize;
+  BinaryColumn binary{};
+  // Requests each distinct resource the records refer to, before any of
+  // them is deserialized, so loading overlaps with the conversion
+  std::function<void(const std::vector<ComponentRecord> &, ResourceContext &)>
+      request_resources{};
+  // Sets hooks through which the component pool holds a reference to every
+  // resource its components name (see Coordinator::SetComponentHooks).
+  // deserialize then gives a component's old resource back when it
+  // replaces it.
+  std::function<void(Coordinator &, ResourceContext &)> track_references{};
+  // deserialize only fills in the entity's existing component (and calls
+  // thread-safe resource requests), so scene loads add default components
+  // up front and run it on several threads
+  bool concurrent = false;
 };
 
+// Calls fn(entity, component) for what a BinaryColumn::write covers
+template <typename T, typename Fn>
+void ForEachColumnComponent(Coordinator &c, const std::vector<Entity> *only,
+                            Fn fn) {
+  if (only) {
+    for (Entity entity : *only)
+      fn(entity, c.GetComponent<T>(entity));
+    return;
+  }
+  const ComponentArray<T> &pool = c.GetComponentArray<T>();
+  for (size_t i = 0; i < pool.GetComponents().size(); ++i)
+    fn(pool.GetEntities()[i], pool.GetComponents()[i]);
+}
+
+// Column copying the component pool as is, for plain data components
+template <typename T> BinaryColumn PodColumn() {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Only plain data components can be copied as bytes");
+  BinaryColumn column;
+  column.record_size = sizeof(T);
+  column.write = [](Coordinator &c, ResourceContext &, SceneStringTable &,
+                    const std::vector<Entity> *only,
+                    std::vector<Entity> &entities,
+                    std::vector<char> &records) {
+    if (only) {
+      ForEachColumnComponent<T>(c, only, [&](Entity entity, const T &value) {
+        entities.push_back(entity);
+        const char *bytes = reinterpret_cast<const char *>(&value);
+        records.insert(records.end(), bytes, bytes + sizeof(T));
+      });
+      return;
+    }
+    const ComponentArray<T> &pool = c.GetComponentArray<T>();
+    entities.insert(entities.end(), pool.GetEntities().begin(),
+                    pool.GetEntities().end());
+    const char *bytes =
+        reinterpret_cast<const char *>(pool.GetComponents().data());
+    records.insert(records.end(), bytes,
+                   bytes + pool.GetComponents().size() * sizeof(T));
+  };
+  column.read = [](const Entity *entities, const char *records, size_t count,
+                   Coordinator &c, ResourceContext &,
+                   const std::vector<std::string> &) {
+    c.AddComponents<T>(entities, records, count);
+  };
+  return column;
+}
+
+struct RegisteredComponent {
+  std::string name; // written to scene files
+  std::type_index type;
+  ComponentSerializer serializer;
+  // Registers the type with another coordinator
+  std::function<void(Coordinator &)> register_type;
+  // Adds copies of the component of an entity of the first coordinator to
+  // count entities of the second, without going through JSON
+  std::function<void(Coordinator &, Entity, Coordinator &, const Entity *,
+                     size_t)>
+      copy;
+};
+
+// Serializers keyed by a stable component name chosen at registration, so
+// scene files don't depend on the compiler's typeid names.
 class SerializationRegistry {
 public:
+  // Scenes written before components had stable names used the GCC/Clang
+  // typeid name, "18TransformComponent" for "TransformComponent"; that name
+  // is registered as an alias so they keep loading on any compiler.
   template<typename T>
-  void RegisterComponent(ComponentSerializer s) {
-    mSerializers[typeid(T)] = std::move(s);
+  void RegisterComponent(const std::string &name, ComponentSerializer s) {
+    std::type_index type(typeid(T));
+    auto existing = mTypeToIndex.find(type);
+    if (existing != mTypeToIndex.end()) {
+      mComponents[existing->second].serializer = std::move(s);
+      return;
+    }
+
+    size_t index = mComponents.size();
+    mComponents.push_back(
+        {name, type, std::move(s),
+         [](Coordinator &c) { c.RegisterComponent<T>(); },
+         [](Coordinator &from, Entity entity, Coordinator &to,
+            const Entity *entities, size_t count) {
+           to.AddComponentCopies(entities, count,
+                                 from.GetComponent<T>(entity));
+         }});
+    mTypeToIndex.emplace(type, index);
+    mNameToIndex[name] = index;
+    mNameToIndex.emplace(std::to_string(name.size()) + name, index);
+  }
+
+  const ComponentSerializer *Find(std::type_index typeindex) const {
+    auto it = mTypeToIndex.find(typeindex);
+    return it == mTypeToIndex.end() ? nullptr
+                                    : &mComponents[it->second].serializer;
   }
 
-  const ComponentSerializer *Find(std::type_index typeindex) {
-    auto it = mSerializers.find(typeindex);
-    return it == mSerializers.end() ? nullptr : &it->second;
+  // Component saved under name (or a legacy alias of it), nullptr if none
+  const RegisteredComponent *FindByName(const std::string &name) const {
+    auto it = mNameToIndex.find(name);
+    return it == mNameToIndex.end() ? nullptr : &mComponents[it->second];
   }
 
-  std::vector<std::type_index> AllTypes() const {
-    std::vector<std::type_index> r;
-    for (auto &p : mSerializers)
-      r.push_back(p.first);
-    return r;
+  // Lets the coordinator's pools hold references to the resources of the
+  // components that have any
+  void TrackReferences(Coordinator &c, ResourceContext &resources) const {
+    for (const RegisteredComponent &component : mComponents)
+      if (component.serializer.track_references)
+        component.serializer.track_references(c, resources);
+  }
+
+  // In registration order
+  const std::vector<RegisteredComponent> &All() const { return mComponents; }
+
+  size_t IndexOf(const RegisteredComponent &component) const {
+    return static_cast<size_t>(&component - mComponents.data());
   }
 
 private:
-  std::map<std::type_index, ComponentSerializer> mSerializers;
+  std::vector<RegisteredComponent> mComponents;
+  std::unordered_map<std::type_index, size_t> mTypeToIndex;
+  std::unordered_map<std::string, size_t> mNameToIndex;
 };
@@ -1,41 +1,222 @@
 #pragma once
 
+#include "core/HandlePool.h"
+#include "core/ResourcePool.h"
 #include "glm/ext/matrix_float4x4.hpp"
 #include "render/Mesh.h"
+#include "render/ProgramBinaryCache.h"
+#include "render/ShaderReflection.h"
 #include <cstdint>
+#include <deque>
 #include <glm/gtc/type_ptr.hpp>
+#include <map>
+#include <mutex>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 
-using ShaderId = GLuint;
+class ThreadPool;
 
+// Generational handle to a program owned by ShaderManager (see HandlePool),
+// 0 is never a valid shader
+using ShaderId = std::uint32_t;
+
+// Preprocessor defines of a shader variant (MAX_POINTS=4, INSTANCING=1),
+// inserted after the #version line of both stages
+using ShaderDefines = std::map<std::string, std::string>;
+
+struct ShaderStats {
+  // LoadShader and LoadShaderAsync calls
+  size_t requests = 0;
+  // requests answered by a program that was already linked, including ones
+  // with different paths but identical sources and defines
+  size_t shared = 0;
+  size_t compiled = 0;
+  size_t failed = 0;
+  double compileMs = 0.0;
+  // loaded from the program binary cache instead of compiled
+  size_t restored = 0;
+  double restoreMs = 0.0;
+};
+
+// Programs are cached by the hash of both sources plus the defines, so every
+// shader sharing them links once. Ids are reference counted: each Load*
+// call takes a reference that ReleaseShader gives back. Linked shaders
+// nobody references are pooled like MeshManager's meshes, so asking for
+// them again doesn't compile.
+// Thread-safe. Everything except LoadShaderAsync, PrefetchShader,
+// RetainShader, ReleaseShader, IsReady and the getters talks to GL and
+// must run on the context thread. BindShader and the uniform setters
+// don't lock.
 class ShaderManager {
 public:
   ShaderManager() = default;
-  ShaderId LoadShader(const std::string &fart, const std::string &vert);
+  // Compiles right away unless the program is cached, 0 on failure
+  ShaderId LoadShader(const std::string &fart, const std::string &vert,
+                      const ShaderDefines &defines = {});
+  // Sources are read on a worker and compiled by a later ProcessUploads,
+  // the placeholder program stands in until then (or for good if it fails).
+  // Requests for paths and defines already known share their id.
+  ShaderId LoadShaderAsync(const std::string &frag, const std::string &vert,
+                           const ShaderDefines &defines = {});
+  // Starts loading like LoadShaderAsync without taking a reference, for
+  // loaders that know the shader will be asked for soon
+  ShaderId PrefetchShader(const std::string &frag, const std::string &vert,
+                          const ShaderDefines &defines = {});
+  // References for holders copying an id they didn't load, like component
+  // pools
+  void RetainShader(ShaderId id, unsigned int count = 1);
+  // Drops a reference; the shader is pooled once none are left, its program
+  // goes when the pool evicts the last shader using it
+  void ReleaseShader(ShaderId id);
+  // Evicts pooled shaders over budget, then compiles loaded sources until
+  // budgetMs is spent (at least one)
+  size_t ProcessUploads(double budgetMs);
+  bool IsReady(ShaderId id) const;
+  size_t GetPendingCount() const;
+  // Linked programs alive, the placeholder excluded
+  size_t GetProgramCount() const;
+
+  // Programs compiled here are stored in it, later runs restore them
+  ProgramBinaryCache &GetBinaryCache() { return mBinaryCache; }
+
+  ShaderStats GetStats() const;
+  void ResetStats();
+  // Applies from the next ProcessUploads. Programs keep no CPU copy, only
+  // the GPU budget matters.
+  void SetPoolSettings(const ResourcePoolSettings &settings);
+  ResourcePoolStats GetPoolStats() const;
+  void LogStats() const;
+  // Without workers LoadShaderAsync reads on the calling thread
+  void SetWorkers(ThreadPool *workers) { mWorkers = workers; }
+
+  // Uniform blocks of programs linked afterwards are bound to the buffer
+  // the resolver names for them
+  void SetUniformBlockResolver(UniformBlockResolver resolver) {
+    mBlockResolver = std::move(resolver);
+  }
 
   void BindShader(ShaderId id);
   void UnbindShader();
 
-  void SetMat4(ShaderId id, const std::string &name, const glm::mat4 &matrix);
-  void SetVec3(ShaderId id, const std::string &name, const glm::vec3 &vec);
+  // Cheapest on the bound shader: no lock, no map lookup. Uniforms the
+  // program doesn't have are ignored.
+  void SetMat4(ShaderId id, UniformName name, const glm::mat4 &matrix);
+  void SetVec3(ShaderId id, UniformName name, const glm::vec3 &vec);
+  void SetInt(ShaderId id, UniformName name, GLint value);
 
-  GLint GetUniformLocation(ShaderId id, const std::string &name);
+  void SetMat4(ShaderId id, const std::string &name, const glm::mat4 &matrix) {
+    SetMat4(id, HashUniformName(name), matrix);
+  }
+  void SetVec3(ShaderId id, const std::string &name, const glm::vec3 &vec) {
+    SetVec3(id, HashUniformName(name), vec);
+  }
+  void SetInt(ShaderId id, const std::string &name, GLint value) {
+    SetInt(id, HashUniformName(name), value);
+  }
 
-  void InvalidateUniformCache(ShaderId id);
+  GLint GetUniformLocation(ShaderId id, UniformName name);
+  GLint GetUniformLocation(ShaderId id, const std::string &name) {
+    return GetUniformLocation(id, HashUniformName(name));
+  }
+  // Of the program id currently resolves to (the placeholder while loading)
+  const ShaderReflection &GetReflection(ShaderId id);
 
   std::pair<std::string, std::string> GetPath(ShaderId id);
+  ShaderDefines GetDefines(ShaderId id) const;
 
   ~ShaderManager();
 
+  // Drops every shader, referenced or not; pending async loads are dropped
   void Clear();
 
 private:
+  using ShaderKey = std::tuple<std::string, std::string, ShaderDefines>;
+
+  // What binding reads, in the handle slots
+  struct ShaderSlot {
+    GLuint program = 0; // 0 until linked, or if it failed to
+    const ShaderReflection *reflection = nullptr;
+  };
+
+  // Cold side of a slot, under the lock
+  struct Shader {
+    std::string vert, frag;
+    ShaderDefines defines;
+    // key into mPrograms, 0 until the program is linked
+    std::uint64_t programKey = 0;
+    unsigned int refs = 0;
+    bool pending = false;
+  };
+
+  struct Program {
+    GLuint program;
+    unsigned int refs;
+    // what a pooled shader using it is charged
+    size_t bytes;
+  };
+
+  struct LoadedSources {
+    ShaderId id;
+    unsigned int generation;
+    std::string fragSource, vertSource;
+  };
+
+  // A slot and record for the sources. Locked.
+  ShaderId NewId(const std::string &frag, const std::string &vert,
+                 const ShaderDefines &defines, unsigned int references);
+  // nullptr for stale ids. Locked.
+  Shader *FindShader(ShaderId id);
+  const Shader *FindShader(ShaderId id) const;
+  // LoadShaderAsync taking the given number of references
+  ShaderId RequestAsync(const std::string &frag, const std::string &vert,
+                        const ShaderDefines &defines, unsigned int references);
+  // Adds references to a known shader, from the pool if it was there.
+  // Locked.
+  void Reference(ShaderId id, Shader &shader, unsigned int references);
+  // The shader has nothing left referencing it. Locked.
+  void Unreferenced(ShaderId id);
+  void EvictPooled();
   std::string GetFileContext(const std::string &path);
-  std::vector<ShaderId> mIds;
+  GLuint CompileProgram(const std::string &fragSource,
+                        const std::string &vertSource,
+                        const std::string &frag, const std::string &vert,
+                        const ShaderDefines &defines = {});
+  // Links the program for the sources or takes a reference to the cached
+  // one, stores it in the shader. False if it failed to build.
+  bool AttachProgram(ShaderId id, const std::string &fragSource,
+                     const std::string &vertSource);
+  void ReleaseProgram(std::uint64_t programKey);
+  // reflects the program and binds its blocks, after linking or restoring
+  // a binary (block bindings are not part of it)
+  void SetupProgram(GLuint program);
+  void DeleteProgram(GLuint program);
+  // Program to use for id, the placeholder's while it isn't ready and a
+  // slot with program 0 for stale ids
+  const ShaderSlot &Resolve(ShaderId id);
 
-  std::unordered_map<ShaderId, std::pair<std::string, std::string>> mIdToPath;
+  mutable std::mutex mMutex;
+  HandlePool<ShaderSlot> mSlots;
+  // by slot index
+  std::deque<Shader> mShaders;
+  std::map<ShaderKey, ShaderId> mKeyToId;
+  std::unordered_map<std::uint64_t, Program> mPrograms;
+  std::deque<LoadedSources> mLoaded;
+  ShaderStats mStats;
+  ResourcePool<ShaderId> mPool;
+  ResourcePoolSettings mPoolSettings;
+  ProgramBinaryCache mBinaryCache;
+  // a scene load is being compiled, reported once it drains
+  bool mCompiling = false;
+  unsigned int mGeneration = 0;
+  ThreadPool *mWorkers = nullptr;
+  GLuint mPlaceholder = 0;
+  ShaderSlot mPlaceholderSlot;
 
-  std::unordered_map<ShaderId, std::unordered_map<std::string, GLint>>
-      mUniformLocationCache;
+  UniformBlockResolver mBlockResolver;
+  // keyed by GL program, shared by every id resolving to it
+  std::unordered_map<GLuint, ShaderReflection> mReflections;
+  // what BindShader last resolved, lets the setters skip Resolve
+  ShaderId mBoundId = 0;
+  const ShaderReflection *mBoundReflection = nullptr;
 };
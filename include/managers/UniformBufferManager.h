@@ -1,4 +1,6 @@
 #pragma once
+#include "core/MemoryTracker.h"
+#include "core/Profiler.h"
 #include <functional>
 #include <iostream>
 #include <string>
@@ -31,6 +33,7 @@ public:
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     mUBOs[name] = {ubo, binding, sizeof(T)};
+    MemoryTracker::Allocated(MemoryCategory::UniformBuffers, sizeof(T));
     std::cout << "Created UBO \"" << name << "\" at binding=" << binding
               << "\n";
   }
@@ -44,6 +47,16 @@ public:
     }
     glBindBuffer(GL_UNIFORM_BUFFER, it->second.id);
     glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(T), &data);
+    PROFILE_COUNT(UboBytes, sizeof(T));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // By buffer name from GetUBO, skips the name lookup on hot paths
+  template <typename T> //
+  void UpdateUBO(GLuint ubo, const T &data, GLintptr offset = 0) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(T), &data);
+    PROFILE_COUNT(UboBytes, sizeof(T));
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
   }
 
@@ -52,9 +65,27 @@ public:
     return (it != mUBOs.end()) ? it->second.id : 0;
   }
 
+  // Shader blocks are named after their UBO plus a "UBO" suffix, so
+  // CameraUBO reads the "Camera" buffer
+  bool ResolveBlock(const std::string &blockName, GLuint &binding,
+                    GLsizeiptr &size) const {
+    const std::string suffix = "UBO";
+    if (blockName.size() <= suffix.size() ||
+        blockName.compare(blockName.size() - suffix.size(), suffix.size(),
+                          suffix) != 0)
+      return false;
+    auto it = mUBOs.find(blockName.substr(0, blockName.size() - suffix.size()));
+    if (it == mUBOs.end())
+      return false;
+    binding = it->second.binding;
+    size = it->second.size;
+    return true;
+  }
+
   ~UniformBufferManager() {
     for (auto &[name, ubo] : mUBOs) {
       glDeleteBuffers(1, &ubo.id);
+      MemoryTracker::Freed(MemoryCategory::UniformBuffers, ubo.size);
     }
     mUBOs.clear();
     std::cout << "UniformBufferManager: all UBOs deleted\n";
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ecs/Types.h"
+#include "glm/ext/vector_float3.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Coordinator;
+class SceneManager;
+class ThreadPool;
+
+struct StreamingSettings {
+  // cells are requested once the viewer comes this close and dropped once
+  // it is farther than unloadRadius, the gap keeps border cells from
+  // loading and unloading every other frame
+  float loadRadius = 192.0f;
+  float unloadRadius = 256.0f;
+  // bytes of cell files resident or being read; nearer cells go first
+  size_t memoryBudget = size_t(256) << 20;
+  // main-thread time per Update spent adding and removing cells (at least
+  // one cell)
+  double frameBudgetMs = 2.0;
+  // cell reads queued on the workers at once
+  unsigned int maxPendingLoads = 4;
+};
+
+struct StreamingStats {
+  size_t residentCells = 0;
+  size_t residentEntities = 0;
+  size_t residentBytes = 0;
+  size_t pendingLoads = 0;
+  // cells in load range the memory budget kept out, at the last Update
+  size_t deferredLoads = 0;
+  // since Open
+  size_t cellsLoaded = 0;
+  size_t cellsUnloaded = 0;
+};
+
+// A world split into square cells on the XZ plane, one binary scene each,
+// listed in a world.json manifest. Cells around the viewer are read on the
+// workers and join the world on the main thread, a few per frame; far ones
+// are destroyed again. Entities without a transform, and cameras, are kept
+// in a global scene that stays loaded. Edits to streamed entities are not
+// written back.
+class WorldStreamer {
+public:
+  // Entities stay in the world when the streamer goes away, reads still in
+  // flight are discarded
+  WorldStreamer(Coordinator &coordinator, SceneManager &scenes);
+
+  WorldStreamer(const WorldStreamer &) = delete;
+  WorldStreamer &operator=(const WorldStreamer &) = delete;
+
+  // Writes the entities of coordinator as a world under directory
+  static bool PartitionWorld(Coordinator &coordinator, SceneManager &scenes,
+                             const std::string &directory, float cellSize);
+
+  // Reads the manifest and loads the global scene, cells follow Update
+  bool Open(const std::string &directory);
+  // Destroys every entity the world added
+  void Close();
+  bool IsOpen() const { return !mDirectory.empty(); }
+
+  // Once per frame, with the position cells are streamed around
+  void Update(const glm::vec3 &viewer);
+
+  // Without workers cells are read on the calling thread
+  void SetWorkers(ThreadPool *workers) { mWorkers = workers; }
+  void SetSettings(const StreamingSettings &settings) {
+    mSettings = settings;
+  }
+  const StreamingSettings &GetSettings() const { return mSettings; }
+  const StreamingStats &GetStats() const { return mStats; }
+
+  // Cells within radius of viewer that are not resident (yet)
+  size_t CountMissingCells(const glm::vec3 &viewer, float radius) const;
+  size_t GetCellCount() const { return mCells.size(); }
+
+private:
+  enum class CellState { Unloaded, Loading, Resident };
+
+  struct Cell {
+    int x;
+    int z;
+    std::string file;
+    size_t bytes;
+    CellState state = CellState::Unloaded;
+    std::vector<Entity> entities;
+  };
+
+  // shared with the read jobs, which may outlive the streamer
+  struct ReadQueue;
+
+  // from the viewer to the nearest point of the cell, on the XZ plane
+  float Distance(const Cell &cell, const glm::vec3 &viewer) const;
+  // Calls fn(index) for the cells whose square reaches within radius
+  template <typename Fn>
+  void ForEachCellInRange(const glm::vec3 &viewer, float radius,
+                          Fn fn) const;
+  void RequestCell(size_t index);
+  void UnloadCell(Cell &cell);
+
+  Coordinator &mCoordinator;
+  SceneManager &mScenes;
+  ThreadPool *mWorkers = nullptr;
+  StreamingSettings mSettings;
+  StreamingStats mStats;
+
+  std::string mDirectory;
+  float mCellSize = 0.0f;
+  std::vector<Cell> mCells;
+  std::unordered_map<std::uint64_t, size_t> mCellIndex;
+  std::vector<size_t> mResident;
+  std::vector<Entity> mGlobalEntities;
+  size_t mPendingBytes = 0;
+
+  std::shared_ptr<ReadQueue> mReads;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GPU time of the passes of a frame, measured with GL_TIME_ELAPSED query
+// pairs and read back LATENCY frames later so reading never waits for the
+// GPU. Passes can't nest, GL allows one elapsed-time query at a time.
+// Always measures; the spans only go to the Profiler while it is enabled.
+// Not thread-safe, every call must come from the context thread.
+class GpuProfiler {
+public:
+  static constexpr unsigned int LATENCY = 3;
+
+  GpuProfiler() = default;
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  // name must outlive the profiler, like Profiler event names
+  void Begin(const char *name);
+  void End();
+  // Closes the frame and reads back the one LATENCY frames before it
+  void EndFrame();
+
+  // Sum of the passes of the newest frame read back, negative until one
+  // has been
+  double GetLastFrameMs() const { return mLastFrameMs; }
+
+  // Deletes the queries, while the context is still current
+  void Release();
+
+private:
+  struct Pass {
+    const char *name;
+    GLuint query;
+    std::uint64_t submitted;
+  };
+
+  // passes of one frame in flight, the queries are reused by the frame
+  // LATENCY frames later
+  struct Frame {
+    std::vector<Pass> passes;
+    size_t used = 0;
+  };
+
+  Frame mFrames[LATENCY];
+  unsigned int mFrame = 0;
+  bool mOpen = false;
+  double mLastFrameMs = -1.0;
+};
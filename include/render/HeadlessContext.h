@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+
+// OpenGL context without a window or a display, for CI and render nodes.
+// Uses EGL on Mesa's surfaceless platform when it is there (llvmpipe needs
+// nothing else), otherwise a 1x1 pbuffer on the default EGL display. There
+// is no default framebuffer to draw to, render into an OffscreenTarget.
+//
+// Only built where CMake finds EGL (RENDERCORE_HEADLESS), Create() fails
+// everywhere else.
+class HeadlessContext {
+public:
+  HeadlessContext() = default;
+  ~HeadlessContext();
+
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+  // Creates a core profile context of at least major.minor and makes it
+  // current on this thread. Logs why and returns false when it can't.
+  bool Create(int major, int minor);
+  bool IsCurrent() const { return mContext != nullptr; }
+  // Moves the context between threads: release it on the one that has it,
+  // then make it current on the other
+  bool MakeCurrent();
+  void ReleaseCurrent();
+
+  // For gladLoadGLLoader and ProgramBinaryCache::Init
+  static GLADloadproc GetLoader();
+
+private:
+  void Destroy();
+
+  // EGLDisplay, EGLContext and EGLSurface, kept opaque so including this
+  // doesn't pull in the EGL headers
+  void *mDisplay = nullptr;
+  void *mContext = nullptr;
+  void *mSurface = nullptr;
+};
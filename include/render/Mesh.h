@@ -1,7 +1,12 @@
 #pragma once
+#include "render/StagingUploader.h"
+#include "render/VertexFormat.h"
 #include <glad/glad.h>
+#include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 struct Vertex {
@@ -10,19 +15,139 @@ struct Vertex {
   glm::vec2 texCoord;
 };
 
+// One level of detail: a range of the shared index buffer
+struct MeshLod {
+  unsigned int indexOffset;
+  unsigned int indexCount;
+  float error; // simplification error in mesh units, 0 for the base level
+  unsigned int vertexCount = 0; // distinct vertices the level references
+};
+
+// GPU-ready buffer contents the Mesh is created from. The pointers are only
+// read during construction and may point into a mapped cache file, unless
+// the upload is streamed: owner then keeps them alive until it completes.
+struct MeshPayload {
+  const void *vertexData = nullptr;
+  size_t vertexBytes = 0;
+  const void *positionData = nullptr; // position-only stream
+  size_t positionBytes = 0;
+  const void *indexData = nullptr;
+  size_t indexBytes = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  Dequantization dequantization;
+  glm::vec3 boundsCenter{0.0f};
+  float boundsRadius = 0.0f;
+  std::shared_ptr<const void> owner;
+};
+
+// Owning buffers behind a MeshPayload, see Mesh::Encode
+struct EncodedMesh {
+  std::vector<std::uint8_t> vertices;
+  std::vector<std::uint8_t> positions;
+  std::vector<std::uint8_t> indices;
+  GLenum indexType = GL_UNSIGNED_INT;
+  Dequantization dequantization;
+  glm::vec3 boundsCenter{0.0f};
+  float boundsRadius = 0.0f;
+
+  MeshPayload View() const;
+};
+
 class Mesh {
 public:
+  // lods index into indices; empty means a single level covering all of them
   Mesh(const std::vector<Vertex> &vertices,
-       const std::vector<unsigned int> &indices);
+       const std::vector<unsigned int> &indices,
+       const std::vector<MeshLod> &lods = {},
+       const VertexLayout &layout = {});
+  // Uploads payload as is, it must have been encoded with layout from the
+  // same vertices and indices. With an uploader the buffers are filled over
+  // the next frames, see IsUploaded; it must outlive the mesh.
+  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
+       std::vector<MeshLod> lods, const VertexLayout &layout,
+       const MeshPayload &payload, StagingUploader *uploader = nullptr);
 
-  void Draw() const;
-  inline std::vector<Vertex> getVerices() const { return mVertices; }
+  // CPU work of the first constructor, no GL calls
+  static EncodedMesh Encode(const std::vector<Vertex> &vertices,
+                            const std::vector<unsigned int> &indices,
+                            const VertexLayout &layout);
+
+  // False while streamed buffer contents are still queued
+  bool IsUploaded() const {
+    return !mUploader || mUploader->IsComplete(mUploadTicket);
+  }
+  StagingUploader::Ticket GetUploadTicket() const { return mUploadTicket; }
+
+  void Draw(size_t lod = 0) const;
+  // Draws through the position-only stream (depth pre-pass, shadows).
+  void DrawDepth(size_t lod = 0) const;
+  // The geometry the buffers were built from, empty after ReleaseCpuData
+  const std::vector<Vertex> &GetVertices() const { return mVertices; }
+  const std::vector<unsigned int> &GetIndices() const { return mIndices; }
+  bool HasCpuData() const { return !mVertices.empty(); }
+  // Frees the CPU copy of the geometry. Drawing, bounds, LODs and counts
+  // only need what was uploaded.
+  void ReleaseCpuData();
+
+  size_t GetLodCount() const { return mLods.size(); }
+  size_t GetTriangleCount(size_t lod = 0) const {
+    return mLods[lod].indexCount / 3;
+  }
+  // GL_UNSIGNED_SHORT when every vertex fits, GL_UNSIGNED_INT otherwise
+  GLenum GetIndexType() const { return mIndexType; }
+  const glm::vec3 &GetBoundsCenter() const { return mBoundsCenter; }
+  float GetBoundsRadius() const { return mBoundsRadius; }
+
+  const VertexFormat &GetVertexFormat() const { return mFormat; }
+  // Maps quantized positions back to mesh space, fold it into the model
+  // matrix before drawing
+  const glm::mat4 &GetDequantizeMatrix() const { return mDequantize; }
+  size_t GetVertexCount(size_t lod = 0) const {
+    return mLods[lod].vertexCount;
+  }
+  // vertex, position-stream and index buffers
+  size_t GetGpuBytes() const { return mGpuBytes; }
+  // the vertices and indices kept on the CPU side
+  size_t GetCpuBytes() const {
+    return mVertices.size() * sizeof(Vertex) +
+           mIndices.size() * sizeof(unsigned int);
+  }
+  // what the same buffers take as float Vertex, vec3 positions and 32-bit
+  // indices
+  size_t GetFullPrecisionBytes() const {
+    return mVertexCount * (sizeof(Vertex) + sizeof(glm::vec3)) +
+           mIndexCount * sizeof(unsigned int);
+  }
   ~Mesh();
 
 private:
   std::vector<Vertex> mVertices;
   std::vector<unsigned int> mIndices;
+  std::vector<MeshLod> mLods;
+  // of the uploaded geometry, kept when the CPU copy is released
+  size_t mVertexCount = 0;
+  size_t mIndexCount = 0;
+  VertexFormat mFormat;
+  glm::mat4 mDequantize{1.0f};
+  size_t mGpuBytes = 0;
   GLuint mVAO, mVBO, mEBO;
+  GLenum mIndexType = GL_UNSIGNED_INT;
+  size_t mIndexSize = sizeof(unsigned int);
+
+  // Positions alone in mFormat's encoding, sharing mEBO
+  GLuint mDepthVAO, mPositionVBO;
+
+  glm::vec3 mBoundsCenter{0.0f};
+  float mBoundsRadius = 0.0f;
+
+  StagingUploader *mUploader = nullptr;
+  StagingUploader::Ticket mUploadTicket = 0;
 
-  void SetupMesh();
+  void Upload(const MeshPayload &payload);
+  void SetupMesh(const MeshPayload &payload);
+  void SetupDepthStream(const MeshPayload &payload);
+  // glBufferData, or empty storage filled through mUploader
+  void FillBuffer(GLenum target, GLuint buffer, const void *data,
+                  size_t size, const MeshPayload &payload);
+  void CountLodVertices();
 };
@@ -0,0 +1,47 @@
+#pragma once
+#include "io/MappedFile.h"
+#include "render/Mesh.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU side of an imported mesh, everything the Mesh constructor needs.
+// payload points into either encoded (fresh import) or mapping (cache hit).
+struct MeshAsset {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<MeshLod> lods;
+  VertexLayout layout;
+  MeshPayload payload;
+  EncodedMesh encoded;
+  MappedFile mapping;
+  bool fromCache = false;
+};
+
+// On-disk cache of imported meshes, one .rcmesh file per source. Files hold
+// a header, the LOD table, the CPU vertices and the GPU payloads, each
+// section 64-byte aligned so a mapped file feeds glBufferData directly.
+// An entry is valid while the source keeps its size and mtime, or failing
+// the mtime, its content hash. settingsHash covers the import settings.
+// Multi-byte fields are stored in host (little-endian) order.
+class MeshCache {
+public:
+  explicit MeshCache(std::string directory = "cache/meshes");
+
+  void SetDirectory(const std::string &directory) { mDirectory = directory; }
+  void SetEnabled(bool enabled) { mEnabled = enabled; }
+  bool IsEnabled() const { return mEnabled; }
+
+  // Maps the entry for sourcePath into asset, false on a miss
+  bool Load(const std::string &sourcePath, std::uint64_t settingsHash,
+            MeshAsset &asset) const;
+  // sourceHash is HashBytes over the source file contents
+  bool Store(const std::string &sourcePath, std::uint64_t settingsHash,
+             std::uint64_t sourceHash, const MeshAsset &asset) const;
+
+  std::string GetEntryPath(const std::string &sourcePath) const;
+
+private:
+  std::string mDirectory;
+  bool mEnabled = true;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include "render/Mesh.h"
+#include <cstddef>
+#include <vector>
+
+struct VertexCacheStats {
+  float acmr; // transformed vertices per triangle, 0.5 is the ideal
+  float atvr; // transformed vertices per referenced vertex, 1.0 is the ideal
+};
+
+// Import-time triangle and vertex reordering. Index functions work in place
+// on a range so each level of detail can be processed on its own.
+class MeshOptimizer {
+public:
+  static constexpr unsigned int CACHE_SIZE = 16;
+
+  // Tipsify (Sander, Nehab, Barczak 2007)
+  static void OptimizeVertexCache(unsigned int *indices, size_t indexCount,
+                                  size_t vertexCount,
+                                  unsigned int cacheSize = CACHE_SIZE);
+
+  // Splits the cache-ordered triangles into clusters and draws the outward
+  // facing ones first. threshold is the tolerated ACMR increase (1.05 = 5%).
+  static void OptimizeOverdraw(const std::vector<Vertex> &vertices,
+                               unsigned int *indices, size_t indexCount,
+                               float threshold,
+                               unsigned int cacheSize = CACHE_SIZE);
+
+  // Reorders vertices by first use in indices and drops unused ones
+  static void OptimizeVertexFetch(std::vector<Vertex> &vertices,
+                                  std::vector<unsigned int> &indices);
+
+  // FIFO post-transform cache simulation
+  static VertexCacheStats AnalyzeVertexCache(const unsigned int *indices,
+                                             size_t indexCount,
+                                             size_t vertexCount,
+                                             unsigned int cacheSize = CACHE_SIZE);
+};
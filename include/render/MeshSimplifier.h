@@ -0,0 +1,18 @@
+#pragma once
+#include "render/Mesh.h"
+#include <cstddef>
+#include <vector>
+
+// Quadric error metric edge-collapse simplifier (Garland & Heckbert).
+// Vertices are never moved or created: collapses snap one endpoint onto the
+// other, so every level of detail indexes the same vertex buffer.
+class MeshSimplifier {
+public:
+  // Collapses edges until at most targetIndexCount indices remain or the next
+  // collapse would exceed maxError (distance, in mesh units). outError
+  // receives the largest error actually introduced.
+  static std::vector<unsigned int>
+  Simplify(const std::vector<Vertex> &vertices,
+           const std::vector<unsigned int> &indices, size_t targetIndexCount,
+           float maxError, float *outError = nullptr);
+};
@@ -0,0 +1,20 @@
+#pragma once
+#include "render/Mesh.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ geometry: v, vt, vn and f (triangles and n-gons, which are
+// fanned, with positive or negative indices). Everything else is skipped.
+class ObjParser {
+public:
+  // threads == 0 uses std::thread::hardware_concurrency(), small inputs are
+  // parsed on the calling thread regardless
+  static bool Parse(const std::string &path, std::vector<Vertex> &outVertices,
+                    std::vector<unsigned int> &outIndices,
+                    unsigned int threads = 0);
+  static bool Parse(const char *data, size_t size,
+                    std::vector<Vertex> &outVertices,
+                    std::vector<unsigned int> &outIndices,
+                    unsigned int threads = 0);
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Framebuffer object with an RGBA8 color and a 24-bit depth renderbuffer,
+// what headless frames are drawn into. Needs a current context.
+class OffscreenTarget {
+public:
+  OffscreenTarget() = default;
+  ~OffscreenTarget();
+
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  // (Re)creates the attachments at this size, false if the framebuffer
+  // isn't complete
+  bool Create(int width, int height);
+  // Binds it for drawing and reading
+  void Bind() const;
+
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+
+  // The color attachment as tightly packed RGB, top row first
+  std::vector<std::uint8_t> ReadPixels() const;
+  // Writes ReadPixels() as a binary PPM (P6)
+  bool WritePpm(const std::string &path) const;
+
+private:
+  void Release();
+
+  GLuint mFramebuffer = 0;
+  GLuint mColor = 0;
+  GLuint mDepth = 0;
+  int mWidth = 0;
+  int mHeight = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// On-disk cache of linked GL programs, one .rcprog file per program key.
+// Entries are only valid for the driver that wrote them: vendor, renderer
+// and version strings are part of the file name and header. A binary the
+// driver refuses (e.g. after an update keeping the same strings) is
+// deleted and the caller compiles from source.
+//
+// glGetProgramBinary and glProgramBinary are core in GL 4.1 while the
+// loader is generated for 3.3, so Init() fetches them itself.
+class ProgramBinaryCache {
+public:
+  explicit ProgramBinaryCache(std::string directory = "cache/programs");
+
+  // Needs a current context. Returns false, and the cache stays disabled,
+  // when the driver offers no program binary format.
+  bool Init(GLADloadproc load);
+  bool IsAvailable() const { return mAvailable && mEnabled; }
+
+  void SetDirectory(const std::string &directory) { mDirectory = directory; }
+  void SetEnabled(bool enabled) { mEnabled = enabled; }
+
+  // Program restored from the entry for key, 0 on a miss
+  GLuint Load(std::uint64_t key) const;
+  // Call between glCreateProgram and glLinkProgram of programs to Store
+  void PrepareLink(GLuint program) const;
+  bool Store(std::uint64_t key, GLuint program) const;
+  // Size of the program's binary, the closest thing to its driver memory
+  // GL reports; 0 when binaries aren't available
+  size_t GetProgramSize(GLuint program) const;
+
+  std::string GetEntryPath(std::uint64_t key) const;
+
+private:
+  using GetProgramBinaryProc = void(APIENTRYP)(GLuint, GLsizei, GLsizei *,
+                                               GLenum *, void *);
+  using ProgramBinaryProc = void(APIENTRYP)(GLuint, GLenum, const void *,
+                                            GLsizei);
+  using ProgramParameteriProc = void(APIENTRYP)(GLuint, GLenum, GLint);
+
+  std::string mDirectory;
+  bool mEnabled = true;
+  bool mAvailable = false;
+  std::uint64_t mDriverHash = 0;
+
+  GetProgramBinaryProc mGetProgramBinary = nullptr;
+  ProgramBinaryProc mProgramBinary = nullptr;
+  ProgramParameteriProc mProgramParameteri = nullptr;
+};
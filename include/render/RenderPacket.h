@@ -0,0 +1,93 @@
+#pragma once
+#include "components/MaterialComponent.h"
+#include "ecs/Types.h"
+#include "managers/MeshManager.h"
+#include "managers/ShaderManager.h"
+#include "render/uniforms/CameraUBO.h"
+#include "render/uniforms/DirectionalLightUBO.h"
+#include "render/uniforms/PointLightUBO.h"
+#include "render/uniforms/SpotLightUBO.h"
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstdint>
+#include <vector>
+
+struct DepthPrepassStats {
+  // fragments that passed the GL_LESS depth-only pass, i.e. what the main
+  // pass would have shaded without the pre-pass
+  GLuint depthFragments = 0;
+  // fragments that actually ran the main fragment shader
+  GLuint shadedFragments = 0;
+
+  float Savings() const {
+    return depthFragments == 0
+               ? 0.0f
+               : 1.0f - (float)shadedFragments / (float)depthFragments;
+  }
+};
+
+struct RenderStats {
+  size_t drawCalls = 0;
+  size_t triangles = 0;
+  // what the same frame would have cost with every mesh at its base level
+  size_t trianglesFullDetail = 0;
+  // vertex data fetched by the main pass, counting every vertex a drawn
+  // level references once
+  size_t vertexBytes = 0;
+  // the same vertices as 32-byte float Vertex
+  size_t vertexBytesFullPrecision = 0;
+};
+
+// An entity to draw, copied out of its components
+struct RenderItem {
+  Entity entity; // keys the level of detail picked last time
+  MeshId mesh;
+  ShaderId shader;
+  glm::vec3 objectColor;
+  glm::mat4 model;
+  glm::vec3 scale;
+  bool hasMaterial;
+  MaterialComponent material;
+};
+
+// What rendering produced for a packet, read by the simulation when the
+// packet comes back to it
+struct RenderFeedback {
+  bool rendered = false;
+  RenderStats stats;
+  DepthPrepassStats depthPrepass;
+  // milliseconds, like FrameTimings
+  double uploads = 0.0;
+  double render = 0.0;
+  double gpu = -1.0;
+  size_t uploadBytesQueued = 0;
+};
+
+// Everything drawing a frame needs, so it can be drawn without reading
+// the ECS: written by the simulation, then only read by the renderer until
+// it is done with it.
+struct RenderPacket {
+  int width = 0;
+  int height = 0;
+
+  bool hasCamera = false;
+  CameraUBO camera;
+  DirectionalLightUBO directionalLights;
+  PointLightUBO pointLights;
+  SpotLightUBO spotLights;
+
+  // picks the levels of detail
+  glm::vec3 cameraPosition{0.0f};
+  float cameraFovY = 0.0f;
+  bool depthPrepass = false;
+  // in entity order
+  std::vector<RenderItem> items;
+
+  // Profiler::Now() when simulating the frame started
+  std::uint64_t simulationStart = 0;
+  // number of the headless frame to dump, negative while it doesn't count
+  int headlessFrame = -1;
+
+  RenderFeedback feedback;
+};
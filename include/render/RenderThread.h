@@ -0,0 +1,77 @@
+#pragma once
+#include "render/RenderPacket.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct RenderThreadStats {
+  std::uint64_t frames = 0;
+  // the simulation waiting for a packet the renderer still had
+  double simulationWaitMs = 0.0;
+  // the renderer waiting for the simulation to submit a packet
+  double renderWaitMs = 0.0;
+};
+
+// Draws frames on a thread of its own that owns the GL context, while the
+// calling thread simulates the next ones. Packets go round a ring of
+// framesInFlight (2 is double, 3 triple buffered): BeginPacket hands out
+// the oldest once it has been drawn, blocking while none is, so the
+// simulation runs at most framesInFlight - 1 frames ahead and whatever the
+// renderer wrote into a packet comes back with it.
+//
+// One thread simulates: BeginPacket, SubmitPacket, Invoke and Stop must
+// all be called from it.
+class RenderThread {
+public:
+  using PacketFn = std::function<void(RenderPacket &packet)>;
+
+  static constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 4;
+
+  RenderThread() = default;
+  ~RenderThread();
+
+  RenderThread(const RenderThread &) = delete;
+  RenderThread &operator=(const RenderThread &) = delete;
+
+  // Runs attach on the new thread (make the context current there), then
+  // render for every submitted packet, and detach before it exits. The
+  // caller must have released the context first.
+  void Start(unsigned int framesInFlight, std::function<void()> attach,
+             PacketFn render, std::function<void()> detach);
+  bool IsRunning() const { return mThread.joinable(); }
+
+  // The packet to fill for the next frame
+  RenderPacket &BeginPacket();
+  // Hands the packet from BeginPacket over to the renderer
+  void SubmitPacket();
+  // Runs fn on the render thread once the packets submitted so far are
+  // drawn, and waits for it
+  void Invoke(const std::function<void()> &fn);
+  // Draws what was submitted, runs detach and joins. The context can be
+  // made current on the calling thread again afterwards.
+  void Stop();
+
+  // Complete once the thread is stopped
+  RenderThreadStats GetStats() const;
+
+private:
+  void Loop(std::function<void()> attach, std::function<void()> detach);
+
+  std::thread mThread;
+  PacketFn mRender;
+  std::vector<RenderPacket> mPackets;
+
+  mutable std::mutex mMutex;
+  // the renderer has something to do
+  std::condition_variable mWork;
+  // the renderer finished a packet or a task
+  std::condition_variable mDone;
+  std::uint64_t mSubmitted = 0;
+  std::uint64_t mRendered = 0;
+  const std::function<void()> *mTask = nullptr;
+  bool mStopping = false;
+  RenderThreadStats mStats;
+};
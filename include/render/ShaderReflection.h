@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <glad/glad.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Uniforms are addressed by a hash of their name, computed at compile time
+// for constants: constexpr UniformName MODEL = HashUniformName("uModel");
+using UniformName = std::uint32_t;
+
+// 32-bit FNV-1a
+constexpr UniformName HashUniformName(std::string_view name) {
+  std::uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+struct UniformInfo {
+  UniformName name;
+  GLint location;
+  GLenum type;
+  GLint count; // array length, 1 for plain uniforms
+};
+
+struct UniformBlockInfo {
+  std::string name;
+  GLuint index;
+  GLint size;
+  GLuint binding;
+};
+
+// Binding point and size of the uniform buffer a block named like it should
+// read, false when there is none
+using UniformBlockResolver =
+    std::function<bool(const std::string &blockName, GLuint &binding,
+                       GLsizeiptr &size)>;
+
+// Table of the active uniforms and uniform blocks of a linked program,
+// built once so setting a uniform never touches a string.
+class ShaderReflection {
+public:
+  ShaderReflection() = default;
+  // Blocks the resolver knows are bound to its binding point, the others
+  // keep the binding the shader declares
+  ShaderReflection(GLuint program, const UniformBlockResolver &resolver);
+
+  // -1 when the program has no such uniform (or the compiler dropped it)
+  GLint GetLocation(UniformName name) const {
+    for (const UniformInfo &uniform : mUniforms)
+      if (uniform.name == name)
+        return uniform.location;
+    return -1;
+  }
+
+  const std::vector<UniformInfo> &GetUniforms() const { return mUniforms; }
+  const std::vector<UniformBlockInfo> &GetBlocks() const { return mBlocks; }
+
+private:
+  std::vector<UniformInfo> mUniforms;
+  std::vector<UniformBlockInfo> mBlocks;
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+struct StagingSettings {
+  // size of the staging ring, the largest single copy is this big
+  size_t stagingBytes = 16u << 20;
+  // bytes copied into destination buffers per Process(), i.e. per frame
+  size_t frameBudgetBytes = 8u << 20;
+  // MeshManager streams meshes at least this big, smaller ones go straight
+  // through glBufferData
+  size_t minStreamBytes = 1u << 20;
+};
+
+struct StagingStats {
+  size_t bytesUploaded = 0;
+  size_t bytesLastFrame = 0;
+  size_t bytesQueued = 0;
+  size_t copies = 0;
+  // frames that copied anything
+  size_t frames = 0;
+  // ring storage replaced because the GPU was still reading the next range
+  size_t orphans = 0;
+  // CPU time spent mapping, copying and issuing the GPU copies
+  double seconds = 0.0;
+
+  double ThroughputMBps() const {
+    return seconds > 0.0 ? bytesUploaded / (1024.0 * 1024.0) / seconds : 0.0;
+  }
+};
+
+// Streams buffer contents to the GPU a budgeted amount per frame. Data is
+// written into a ring of staging memory (mapped unsynchronized) and moved
+// into the destination with glCopyBufferSubData; a fence per copy tells
+// when its ring range can be written again. If the range the ring wraps
+// onto is still in use the storage is orphaned instead of waiting.
+// Not thread-safe, every call must come from the context thread.
+class StagingUploader {
+public:
+  using Ticket = std::uint64_t;
+
+  explicit StagingUploader(const StagingSettings &settings = {});
+  ~StagingUploader();
+
+  StagingUploader(const StagingUploader &) = delete;
+  StagingUploader &operator=(const StagingUploader &) = delete;
+
+  void SetSettings(const StagingSettings &settings);
+  const StagingSettings &GetSettings() const { return mSettings; }
+
+  // Queues size bytes of data for buffer at offset; buffer must already
+  // have its storage. owner keeps data alive until it has been copied.
+  Ticket Enqueue(GLuint buffer, GLintptr offset, const void *data,
+                 size_t size, std::shared_ptr<const void> owner = nullptr);
+  // Copies up to the frame budget, call once per frame
+  void Process();
+  // Copies everything up to and including ticket right away
+  void Finish(Ticket ticket);
+  // Drops queued copies into buffer, call before deleting it
+  void Cancel(GLuint buffer);
+
+  // Later draws see the data once its ticket is complete
+  bool IsComplete(Ticket ticket) const { return ticket <= mCompleted; }
+  bool IsIdle() const { return mRequests.empty(); }
+  const StagingStats &GetStats() const { return mStats; }
+
+private:
+  struct Request {
+    GLuint buffer;
+    GLintptr offset;
+    const char *data;
+    size_t size;
+    size_t copied;
+    Ticket ticket;
+    std::shared_ptr<const void> owner;
+  };
+
+  // ring range read by a copy that may still be executing
+  struct Segment {
+    size_t begin, end;
+    GLsync fence;
+  };
+
+  size_t Copy(size_t budget);
+  // ring offset for size bytes, orphaning the storage when it is busy
+  size_t Reserve(size_t size);
+  void RetireSegments();
+  void ReleaseRing();
+  void UpdateCompleted();
+
+  StagingSettings mSettings;
+  StagingStats mStats;
+  std::deque<Request> mRequests;
+  std::deque<Segment> mSegments;
+  GLuint mRing = 0;
+  size_t mRingSize = 0;
+  size_t mHead = 0;
+  Ticket mNextTicket = 1;
+  Ticket mCompleted = 0;
+};
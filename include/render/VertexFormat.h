@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+#include <vector>
+
+struct Vertex;
+
+enum class PositionEncoding : std::uint8_t {
+  Float32, // 12 bytes
+  Half,    // 8 bytes, 4th component is padding
+  Snorm16, // 8 bytes, 4th component is padding
+};
+
+enum class NormalEncoding : std::uint8_t {
+  None,
+  Float32,       // 12 bytes
+  Int2_10_10_10, // 4 bytes, GL_INT_2_10_10_10_REV
+  Octahedral16,  // 4 bytes, decoded in the vertex shader
+};
+
+enum class TexCoordEncoding : std::uint8_t {
+  None,
+  Float32, // 8 bytes
+  Half,    // 4 bytes, keeps tiling UVs outside [0, 1]
+  Unorm16, // 4 bytes, clamps to [0, 1]
+};
+
+// Which encoding each Vertex attribute gets on the GPU. The default drops
+// texCoord: no shader in resources/shaders reads location 2.
+struct VertexLayout {
+  PositionEncoding position = PositionEncoding::Snorm16;
+  NormalEncoding normal = NormalEncoding::Int2_10_10_10;
+  TexCoordEncoding texCoord = TexCoordEncoding::None;
+};
+
+// Quantized positions are stored as (position - offset) / scale. The scale
+// is uniform so it can be folded into the model matrix without skewing the
+// normal matrix.
+struct Dequantization {
+  glm::vec3 offset{0.0f};
+  float scale = 1.0f;
+};
+
+struct VertexAttribute {
+  GLuint location;
+  GLint components;
+  GLenum type;
+  GLboolean normalized;
+  GLuint offset;
+};
+
+class VertexFormat {
+public:
+  VertexFormat() = default;
+  explicit VertexFormat(const VertexLayout &layout);
+
+  const VertexLayout &GetLayout() const { return mLayout; }
+  GLsizei GetStride() const { return mStride; }
+  // stride of the position-only stream, same encoding as the main one
+  GLsizei GetPositionStride() const { return mPositionStride; }
+  const std::vector<VertexAttribute> &GetAttributes() const {
+    return mAttributes;
+  }
+
+  // Points the attributes at the currently bound GL_ARRAY_BUFFER
+  void Apply() const;
+  void ApplyPositionOnly() const;
+
+  Dequantization ComputeDequantization(const std::vector<Vertex> &vertices) const;
+  void Encode(const std::vector<Vertex> &vertices, const Dequantization &dq,
+              std::vector<std::uint8_t> &out) const;
+  void EncodePositions(const std::vector<Vertex> &vertices,
+                       const Dequantization &dq,
+                       std::vector<std::uint8_t> &out) const;
+
+private:
+  VertexLayout mLayout;
+  std::vector<VertexAttribute> mAttributes;
+  GLsizei mStride = 0;
+  GLsizei mPositionStride = 0;
+};
@@ -2,12 +2,16 @@
 #include "ecs/Coordinator.h"
 #include "ecs/SystemManager.h"
 #include "glm/ext/matrix_float4x4.hpp"
-#include "managers/UniformBufferManager.h"
+#include "render/uniforms/CameraUBO.h"
 class CameraSystem : public System {
 public:
   void Update(Coordinator& coordinator, float deltaTime);
-  void UploadToUBO(Coordinator& coordinator, UniformBufferManager &uboManager, float aspectRation);
+  // The active camera's matrices, false and data untouched without one
+  bool BuildUBO(Coordinator &coordinator, float aspectRatio, CameraUBO &data);
   // glm::mat4 GetView(Coordinator& coordinator);
   // glm::mat4 GetProjection(Coordinator& coordinator, float aspectRatio);
   void ToggleCamera(Coordinator& coordinator);
+  // Position and vertical fov (radians) of the active camera, false if none
+  bool GetActiveView(Coordinator &coordinator, glm::vec3 &position,
+                     float &fovY);
 };
@@ -1,11 +1,12 @@
 #pragma once
 #include "ecs/Coordinator.h"
 #include "ecs/SystemManager.h"
-#include "managers/UniformBufferManager.h"
 #include "components/PointLightComponent.h"
 #include "components/TransformComponent.h"
+#include "render/uniforms/PointLightUBO.h"
 
 class PointLightSystem : public System {
   public:
-    void Update(Coordinator &coordinator, UniformBufferManager &uboManager);
+    // Gathers the lights into uboData, uploading it is up to the caller
+    void Update(Coordinator &coordinator, PointLightUBO &uboData);
 };
@@ -10,11 +10,79 @@
 #include "managers/ResourceContext.h"
 #include "managers/ShaderManager.h"
 #include "managers/UniformBufferManager.h"
+#include "render/GpuProfiler.h"
+#include "render/RenderPacket.h"
+
+struct LodSelection {
+  // level i + 1 is used once the projected bounding radius, as a fraction of
+  // the viewport half-height, drops below screenSizes[i]
+  std::vector<float> screenSizes{0.25f, 0.12f, 0.06f};
+  // relative band around each threshold that has to be crossed before the
+  // level changes again, avoids popping back and forth at the boundary
+  float hysteresis = 0.1f;
+};
 
 class RenderSystem : public System {
 public:
-  glm::mat4 GetTransformMatrix(TransformComponent transform);
+  ~RenderSystem();
+
+  glm::mat4 GetTransformMatrix(TransformComponent transform) const;
   void SetMaterial(UniformBufferManager &uboManager, MaterialComponent material);
-  void Update(Coordinator &coordinator, ResourceContext& resoruces,
-              UniformBufferManager& uboManager);
+  // Copies what the frame draws out of the ECS, along with the settings
+  // below, no GL calls
+  void Extract(Coordinator &coordinator, RenderPacket &packet) const;
+  // Draws an extracted frame, on the context thread
+  void Submit(const RenderPacket &packet, ResourceContext &resources,
+              UniformBufferManager &uboManager);
+
+  void SetDepthPrepass(bool enabled) { mDepthPrepass = enabled; }
+  bool IsDepthPrepassEnabled() const { return mDepthPrepass; }
+  const DepthPrepassStats &GetDepthPrepassStats() const { return mStats; }
+
+  void SetCamera(const glm::vec3 &position, float fovY) {
+    mCameraPosition = position;
+    mCameraFovY = fovY;
+  }
+  void SetLodSelection(const LodSelection &selection) {
+    mLodSelection = selection;
+  }
+  // Of the last Submit, read them on the context thread
+  const RenderStats &GetFrameStats() const { return mFrameStats; }
+  // Times the depth pre-pass and the main pass on the GPU
+  void SetGpuProfiler(GpuProfiler *profiler) { mGpuProfiler = profiler; }
+
+private:
+  struct DrawItem {
+    const RenderItem *item;
+    Mesh *mesh;
+    size_t lod;
+    glm::mat4 model; // includes the mesh's dequantization
+  };
+
+  void BuildDrawList(const RenderPacket &packet, ResourceContext &resources);
+  size_t SelectLod(const RenderPacket &packet, const RenderItem &item,
+                   const MeshInfo &mesh);
+  void DepthPrepass(ResourceContext &resources);
+  void ReadQueries();
+
+  // of the packet being submitted
+  std::vector<DrawItem> mDrawList;
+  // last level picked for each entity, needed for the hysteresis
+  std::vector<uint8_t> mEntityLod;
+  LodSelection mLodSelection;
+  glm::vec3 mCameraPosition{0.0f};
+  float mCameraFovY = 0.0f;
+  RenderStats mFrameStats;
+
+  bool mDepthPrepass = false;
+  ShaderId mDepthShader = 0;
+  GpuProfiler *mGpuProfiler = nullptr;
+  GLuint mMaterialUBO = 0;
+
+  // GL_SAMPLES_PASSED queries, double buffered so the result of frame N is
+  // read during frame N+1 without stalling: [frame][0 = depth, 1 = main]
+  GLuint mQueries[2][2] = {};
+  bool mQueryPending[2][2] = {};
+  int mQueryFrame = 0;
+  DepthPrepassStats mStats;
 };
@@ -1,11 +1,12 @@
 #pragma once
 #include "ecs/Coordinator.h"
 #include "ecs/SystemManager.h"
-#include "managers/UniformBufferManager.h"
 #include "components/SpotLightComponent.h"
 #include "components/TransformComponent.h"
+#include "render/uniforms/SpotLightUBO.h"
 
 class SpotLightSystem : public System {
   public:
-    void Update(Coordinator &coordinator, UniformBufferManager &uboManager);
+    // Gathers the lights into uboData, uploading it is up to the caller
+    void Update(Coordinator &coordinator, SpotLightUBO &uboData);
 };
@@ -5,9 +5,16 @@ in vec3 outPos;
 in vec3 outNormal;
 in vec3 outCameraPos;
 
+// may be lowered per variant (ShaderDefines), never above the UBO sizes
+#ifndef MAX_DIRECTIONALS
 #define MAX_DIRECTIONALS 4
+#endif
+#ifndef MAX_POINTS
 #define MAX_POINTS 16
+#endif
+#ifndef MAX_SPOTS
 #define MAX_SPOTS 16
+#endif
 
 struct DirectionalLightData {
   vec3 direction;
@@ -134,13 +141,13 @@ void main() {
   vec3 viewDir = normalize(outCameraPos - outPos);
 
   vec3 result = vec3(0.0);
-  for(int i = 0; i < DirectionalLights.size; ++i) {
+  for(int i = 0; i < min(DirectionalLights.size, MAX_DIRECTIONALS); ++i) {
     result += CalcDirectionalLight(DirectionalLights.data[i], norm, viewDir);
   }
-  for(int i = 0; i < PointLights.size; ++i) {
+  for(int i = 0; i < min(PointLights.size, MAX_POINTS); ++i) {
     result += CalcPointLight(PointLights.data[i], norm, outPos, viewDir);
   }
-  for(int i = 0; i < SpotLights.size; ++i) {
+  for(int i = 0; i < min(SpotLights.size, MAX_SPOTS); ++i) {
     result += CalcSpotLight(SpotLights.data[i], norm, outPos, viewDir);
   }
 
@@ -9,17 +9,30 @@ layout(std140, binding = 0) uniform CameraUBO {
 } camera;
 
 uniform mat4 uModel;
+// aNormal.xy holds an octahedral encoded normal, see VertexFormat.cpp
+uniform bool uOctahedralNormals;
 
 out vec3 outPos;
 out vec3 outNormal;
 out vec3 outCameraPos;
 
+invariant gl_Position;
+
+vec3 DecodeOctahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return n;
+}
+
 void main() {
   vec4 worldPos = uModel * vec4(aPos, 1.0);
   outPos = worldPos.xyz;
 
   mat3 normalMatrix = transpose(inverse(mat3(uModel)));
-  outNormal = normalize(normalMatrix * aNormal);
+  vec3 normal = uOctahedralNormals ? DecodeOctahedral(aNormal.xy) : aNormal;
+  outNormal = normalize(normalMatrix * normal);
 
   outCameraPos = camera.cameraPos;
 
@@ -0,0 +1,4 @@
+#version 420 core
+
+void main() {
+}
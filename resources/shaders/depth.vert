@@ -0,0 +1,18 @@
+#version 420 core
+layout (location = 0) in vec3 aPos;
+
+layout(std140, binding = 0) uniform CameraUBO {
+  mat4 view;
+  mat4 projection;
+  vec3 cameraPos;
+} camera;
+
+uniform mat4 uModel;
+
+// must match default.vert bit for bit, the main pass tests with GL_EQUAL
+invariant gl_Position;
+
+void main() {
+  vec4 worldPos = uModel * vec4(aPos, 1.0);
+  gl_Position = camera.projection * camera.view * worldPos;
+}
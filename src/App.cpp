@@ -5,15 +5,19 @@
 #include "components/MaterialComponent.h"
 #include "components/MeshComponent.h"
 #include "components/PointLightComponent.h"
+#include "components/PrefabComponent.h"
 #include "components/ShaderComponent.h"
 #include "components/SpotLightComponent.h"
 #include "components/TransformComponent.h"
+#include "core/MemoryTracker.h"
+#include "core/Profiler.h"
 #include "ecs/Coordinator.h"
 #include "ecs/Types.h"
 #include "glm/ext/matrix_transform.hpp"
 #include "glm/ext/vector_float3.hpp"
 #include "glm/trigonometric.hpp"
 #include "managers/MeshManager.h"
+#include "managers/PrefabManager.h"
 #include "managers/ResourceContext.h"
 #include "managers/SceneManager.h"
 #include "managers/SerializationRegistry.h"
@@ -32,34 +36,308 @@
 #include <X11/X.h>
 #include <X11/XKBlib.h>
 #include <X11/Xlib.h>
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <sys/ucontext.h>
 #include <utility>
 
-App::App(int width, int height, const char *title)
-    : mWidth(width), mHeight(height), mLastFrameTime(0) {
+namespace {
+
+// main-thread time per frame spent turning finished async loads into GL
+// objects; a scene load spreads over several frames instead of stalling one
+constexpr double SHADER_UPLOAD_BUDGET_MS = 1.0;
+constexpr double MESH_UPLOAD_BUDGET_MS = 2.0;
+
+// the world is appended to the autosave's delta log this often, and folded
+// into a new snapshot once the log outgrows it
+constexpr float AUTOSAVE_INTERVAL_S = 30.0f;
+constexpr const char *AUTOSAVE_PATH = "saves/autosave.rcscene";
+
+// simulated frame time of headless runs, so frame N always looks the same
+constexpr float HEADLESS_FRAME_TIME_S = 1.0f / 60.0f;
+// a headless run waiting for loads gives up and starts counting after this
+// many frames
+constexpr int MAX_SETTLE_FRAMES = 6000;
+
+// where F9 writes the trace of what it profiled
+constexpr const char *TRACE_PATH = "profiles/trace.json";
+
+constexpr std::uint32_t NO_STRING = ~0u;
+
+// Binary scene records of the components referring to resources, which
+// store string table indices instead of handles
+struct MeshRecord {
+  std::uint32_t path;
+};
+
+struct PrefabRecord {
+  std::uint32_t path;
+};
+
+struct ShaderRecord {
+  std::uint32_t fragmentPath;
+  std::uint32_t vertexPath;
+  std::uint32_t defines; // JSON object, NO_STRING without defines
+  float color[3];
+};
+
+// Scene load phase 1: each distinct mesh and shader is requested once
+// fragment, vertex, defines (null when absent)
+using ShaderRequest =
+    std::tuple<std::string_view, std::string_view, const Json *>;
+
+struct ShaderRequestLess {
+  bool operator()(const ShaderRequest &a, const ShaderRequest &b) const {
+    return std::forward_as_tuple(std::get<0>(a), std::get<1>(a),
+                                 *std::get<2>(a)) <
+           std::forward_as_tuple(std::get<0>(b), std::get<1>(b),
+                                 *std::get<2>(b));
+  }
+};
+
+// Both look at the strings in place, only distinct resources are copied
+void RequestMeshes(const std::vector<ComponentRecord> &records,
+                   ResourceContext &rm) {
+  std::unordered_set<std::string_view> paths;
+  for (const ComponentRecord &record : records)
+    paths.insert((*record.data)["path"].get_ref<const std::string &>());
+  for (std::string_view path : paths)
+    rm.meshes->PrefetchMesh(std::string(path));
+}
+
+void RequestShaders(const std::vector<ComponentRecord> &records,
+                    ResourceContext &rm) {
+  static const Json NO_DEFINES;
+  std::set<ShaderRequest, ShaderRequestLess> shaders;
+  for (const ComponentRecord &record : records) {
+    const Json &j = *record.data;
+    auto defines = j.find("defines");
+    shaders.emplace(j["fragment_path"].get_ref<const std::string &>(),
+                    j["vertex_path"].get_ref<const std::string &>(),
+                    defines != j.end() ? &*defines : &NO_DEFINES);
+  }
+  for (const auto &[frag, vert, defines] : shaders)
+    rm.shaders->PrefetchShader(
+        std::string(frag), std::string(vert),
+        defines->is_null() ? ShaderDefines{} : defines->get<ShaderDefines>());
+}
+
+BinaryColumn MeshColumn() {
+  BinaryColumn column;
+  column.record_size = sizeof(MeshRecord);
+  column.write = [](Coordinator &c, ResourceContext &rm,
+                    SceneStringTable &strings, const std::vector<Entity> *only,
+                    std::vector<Entity> &entities,
+                    std::vector<char> &records) {
+    ForEachColumnComponent<MeshComponent>(
+        c, only, [&](Entity entity, const MeshComponent &mesh) {
+          MeshRecord record{strings.Intern(rm.meshes->GetPath(mesh.mId))};
+          const char *bytes = reinterpret_cast<const char *>(&record);
+          entities.push_back(entity);
+          records.insert(records.end(), bytes, bytes + sizeof(record));
+        });
+  };
+  column.read = [](const Entity *entities, const char *records, size_t count,
+                   Coordinator &c, ResourceContext &rm,
+                   const std::vector<std::string> &strings) {
+    // one request per distinct path rather than per entity, the pool takes
+    // the references
+    std::unordered_map<std::uint32_t, MeshId> ids;
+    for (size_t i = 0; i < count; ++i) {
+      MeshRecord record;
+      std::memcpy(&record, records + i * sizeof(record), sizeof(record));
+      if (record.path >= strings.size())
+        continue;
+      auto it = ids.find(record.path);
+      if (it == ids.end())
+        it = ids.emplace(record.path,
+                         rm.meshes->PrefetchMesh(strings[record.path]))
+                 .first;
+      c.AddComponent(entities[i], MeshComponent{it->second});
+    }
+  };
+  return column;
+}
+
+BinaryColumn PrefabColumn() {
+  BinaryColumn column;
+  column.record_size = sizeof(PrefabRecord);
+  column.write = [](Coordinator &c, ResourceContext &rm,
+                    SceneStringTable &strings, const std::vector<Entity> *only,
+                    std::vector<Entity> &entities,
+                    std::vector<char> &records) {
+    if (!rm.prefabs)
+      return;
+    ForEachColumnComponent<PrefabComponent>(
+        c, only, [&](Entity entity, const PrefabComponent &prefab) {
+          const std::string &path = rm.prefabs->GetPath(prefab.mId);
+          if (path.empty())
+            return;
+          PrefabRecord record{strings.Intern(path)};
+          const char *bytes = reinterpret_cast<const char *>(&record);
+          entities.push_back(entity);
+          records.insert(records.end(), bytes, bytes + sizeof(record));
+        });
+  };
+  // only the link, the components themselves have columns of their own
+  column.read = [](const Entity *entities, const char *records, size_t count,
+                   Coordinator &c, ResourceContext &rm,
+                   const std::vector<std::string> &strings) {
+    if (!rm.prefabs)
+      return;
+    for (size_t i = 0; i < count; ++i) {
+      PrefabRecord record;
+      std::memcpy(&record, records + i * sizeof(record), sizeof(record));
+      if (record.path >= strings.size())
+        continue;
+      PrefabId id = rm.prefabs->Load(strings[record.path]);
+      if (id != INVALID_PREFAB)
+        c.AddComponent(entities[i], PrefabComponent{id});
+    }
+  };
+  return column;
+}
+
+BinaryColumn ShaderColumn() {
+  BinaryColumn column;
+  column.record_size = sizeof(ShaderRecord);
+  column.write = [](Coordinator &c, ResourceContext &rm,
+                    SceneStringTable &strings, const std::vector<Entity> *only,
+                    std::vector<Entity> &entities,
+                    std::vector<char> &records) {
+    std::unordered_map<ShaderId, ShaderRecord> cache;
+    ForEachColumnComponent<ShaderComponent>(
+        c, only, [&](Entity entity, const ShaderComponent &shader) {
+          auto it = cache.find(shader.mId);
+          if (it == cache.end()) {
+            auto paths = rm.shaders->GetPath(shader.mId);
+            ShaderDefines defines = rm.shaders->GetDefines(shader.mId);
+            ShaderRecord record{
+                strings.Intern(paths.second), strings.Intern(paths.first),
+                defines.empty() ? NO_STRING
+                                : strings.Intern(Json(defines).dump()),
+                {}};
+            it = cache.emplace(shader.mId, record).first;
+          }
+          ShaderRecord record = it->second;
+          record.color[0] = shader.mObjectColor.r;
+          record.color[1] = shader.mObjectColor.g;
+          record.color[2] = shader.mObjectColor.b;
+          const char *bytes = reinterpret_cast<const char *>(&record);
+          entities.push_back(entity);
+          records.insert(records.end(), bytes, bytes + sizeof(record));
+        });
+  };
+  column.read = [](const Entity *entities, const char *records, size_t count,
+                   Coordinator &c, ResourceContext &rm,
+                   const std::vector<std::string> &strings) {
+    std::map<std::tuple<std::uint32_t, std::uint32_t, std::uint32_t>, ShaderId>
+        ids;
+    for (size_t i = 0; i < count; ++i) {
+      ShaderRecord record;
+      std::memcpy(&record, records + i * sizeof(record), sizeof(record));
+      if (record.fragmentPath >= strings.size() ||
+          record.vertexPath >= strings.size())
+        continue;
+      auto key = std::make_tuple(record.fragmentPath, record.vertexPath,
+                                 record.defines);
+      auto it = ids.find(key);
+      if (it == ids.end()) {
+        ShaderDefines defines;
+        if (record.defines < strings.size()) {
+          Json json = Json::parse(strings[record.defines], nullptr, false);
+          if (json.is_object())
+            defines = json.get<ShaderDefines>();
+        }
+        it = ids.emplace(key, rm.shaders->PrefetchShader(
+                                  strings[record.fragmentPath],
+                                  strings[record.vertexPath], defines))
+                 .first;
+      }
+      c.AddComponent(entities[i],
+                     ShaderComponent{it->second,
+                                     glm::vec3(record.color[0],
+                                               record.color[1],
+                                               record.color[2])});
+    }
+  };
+  return column;
+}
+
+void LogPoolStats(const char *resources, const ResourcePoolStats &stats) {
+  std::cout << "[App] Scene " << resources << ": " << stats.hits
+            << " from the pool, " << stats.misses << " loaded, "
+            << stats.pooled << " unused kept ("
+            << stats.gpuBytes / 1024 << " KB GPU, " << stats.cpuBytes / 1024
+            << " KB CPU)" << std::endl;
+}
+
+} // namespace
+
+App::App(int width, int height, const char *title,
+         const HeadlessSettings &headless)
+    : mWidth(width), mHeight(height), mLastFrameTime(0), mTitle(title),
+      mHeadless(headless) {
+  Profiler::SetThreadName("main");
+  // the null platform needs no display; its window only carries the
+  // close flag and the (never pressed) keys Run() asks about
+  if (mHeadless.enabled)
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
   if (!glfwInit()) {
     throw std::runtime_error("Couldn't init glfw");
   }
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  if (mHeadless.enabled) {
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  } else {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  }
 
   mWindow = glfwCreateWindow(width, height, title, NULL, NULL);
   if (!mWindow) {
     throw std::runtime_error("Couldn't create a window");
   }
 
-  glfwMakeContextCurrent(mWindow);
+  GLADloadproc load = (GLADloadproc)glfwGetProcAddress;
+  if (mHeadless.enabled) {
+    if (!mHeadlessContext.Create(3, 3))
+      throw std::runtime_error("Couldn't create a headless GL context");
+    load = HeadlessContext::GetLoader();
+  } else {
+    glfwMakeContextCurrent(mWindow);
+  }
 
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+  if (!gladLoadGLLoader(load)) {
     throw std::runtime_error("Couldn't load GLAD");
   }
+  if (!mShaderManager.GetBinaryCache().Init(load))
+    std::cout << "[ShaderManager] No program binary support, shaders are "
+                 "compiled on every run"
+              << std::endl;
+  if (mHeadless.enabled) {
+    mOffscreen = std::make_unique<OffscreenTarget>();
+    if (!mOffscreen->Create(width, height))
+      throw std::runtime_error("Couldn't create the offscreen framebuffer");
+    mOffscreen->Bind();
+    std::cout << "[App] Headless on " << glGetString(GL_RENDERER)
+              << std::endl;
+  }
   UpdateViewport(mWidth, mHeight);
 
   glfwSetWindowUserPointer(mWindow, this);
@@ -73,7 +351,6 @@ App::App(int width, int height, const char *title)
 void App::UpdateViewport(int w, int h) {
   this->mWidth = w;
   this->mHeight = h;
-  glViewport(0, 0, w, h);
 }
 
 void App::framebuffer_size_callback(GLFWwindow *window, int width, int height) {
@@ -88,58 +365,96 @@ void App::Init() {
   mUniformManager.CreateUBO<PointLightUBO>("PointLight", 2);
   mUniformManager.CreateUBO<SpotLightUBO>("SpotLight", 3);
   mUniformManager.CreateUBO<MaterialUBO>("Material", 4);
+  mShaderManager.SetUniformBlockResolver(
+      [this](const std::string &block, GLuint &binding, GLsizeiptr &size) {
+        return mUniformManager.ResolveBlock(block, binding, size);
+      });
+
+  RegisterDefaultComponents(mCoordinator);
+  mCoordinator.GetSystem<RenderSystem>()->SetGpuProfiler(&mGpuProfiler);
+
+  // ======= RESOURCES =======
 
-  mCoordinator.Init();
-  mCoordinator.RegisterComponent<MeshComponent>();
-  mCoordinator.RegisterComponent<ShaderComponent>();
-  mCoordinator.RegisterComponent<TransformComponent>();
-  mCoordinator.RegisterComponent<CameraComponent>();
-  mCoordinator.RegisterComponent<MaterialComponent>();
+  mResources.meshes = &mMeshManager;
+  mResources.shaders = &mShaderManager;
+  mMeshManager.SetWorkers(&mWorkers);
+  mShaderManager.SetWorkers(&mWorkers);
+
+  mSerializeRegistry = RegisterSerializeDefaultComponents();
+  mPrefabManager =
+      std::make_unique<PrefabManager>(mSerializeRegistry, mResources);
+  mResources.prefabs = mPrefabManager.get();
+  mSerializeRegistry.TrackReferences(mCoordinator, mResources);
+  mSceneManager = std::make_unique<SceneManager>(
+      SceneManager{mCoordinator, mSerializeRegistry, mResources});
+  mSceneManager->SetWorkers(&mWorkers);
+  mWorldStreamer =
+      std::make_unique<WorldStreamer>(mCoordinator, *mSceneManager);
+  mWorldStreamer->SetWorkers(&mWorkers);
+}
 
-  mCoordinator.RegisterComponent<DirectionalLightComponent>();
-  mCoordinator.RegisterComponent<PointLightComponent>();
-  mCoordinator.RegisterComponent<SpotLightComponent>();
+void App::StartProfiling(const std::string &tracePath) {
+  mTracePath = tracePath;
+  Profiler::Reset();
+  Profiler::SetEnabled(true);
+}
+
+bool App::ConvertScene(const std::string &from, const std::string &to) {
+  return mSceneManager->ConvertScene(from, to);
+}
 
-  mCoordinator.RegisterSystem<RenderSystem>();
+bool App::PartitionScene(const std::string &scene,
+                         const std::string &directory, float cellSize) {
+  mCoordinator.DestroyAllEntities();
+  return mSceneManager->LoadScene(scene) &&
+         WorldStreamer::PartitionWorld(mCoordinator, *mSceneManager,
+                                       directory, cellSize);
+}
+
+void App::RegisterDefaultComponents(Coordinator &coordinator) {
+  coordinator.Init();
+  coordinator.RegisterComponent<MeshComponent>();
+  coordinator.RegisterComponent<ShaderComponent>();
+  coordinator.RegisterComponent<TransformComponent>();
+  coordinator.RegisterComponent<CameraComponent>();
+  coordinator.RegisterComponent<MaterialComponent>();
+
+  coordinator.RegisterComponent<DirectionalLightComponent>();
+  coordinator.RegisterComponent<PointLightComponent>();
+  coordinator.RegisterComponent<SpotLightComponent>();
+  coordinator.RegisterComponent<PrefabComponent>();
+
+  coordinator.RegisterSystem<RenderSystem>();
   Signature RenderSignature;
-  RenderSignature.set(mCoordinator.GetComponentType<MeshComponent>());
-  RenderSignature.set(mCoordinator.GetComponentType<ShaderComponent>());
-  RenderSignature.set(mCoordinator.GetComponentType<TransformComponent>());
-  mCoordinator.SetSystemSignature<RenderSystem>(RenderSignature);
+  RenderSignature.set(coordinator.GetComponentType<MeshComponent>());
+  RenderSignature.set(coordinator.GetComponentType<ShaderComponent>());
+  RenderSignature.set(coordinator.GetComponentType<TransformComponent>());
+  coordinator.SetSystemSignature<RenderSystem>(RenderSignature);
 
-  mCoordinator.RegisterSystem<CameraSystem>();
+  coordinator.RegisterSystem<CameraSystem>();
   Signature CameraSignature;
-  CameraSignature.set(mCoordinator.GetComponentType<CameraComponent>());
-  CameraSignature.set(mCoordinator.GetComponentType<TransformComponent>());
-  mCoordinator.SetSystemSignature<CameraSystem>(CameraSignature);
+  CameraSignature.set(coordinator.GetComponentType<CameraComponent>());
+  CameraSignature.set(coordinator.GetComponentType<TransformComponent>());
+  coordinator.SetSystemSignature<CameraSystem>(CameraSignature);
 
-  mCoordinator.RegisterSystem<DirectionalLightSystem>();
+  coordinator.RegisterSystem<DirectionalLightSystem>();
   Signature DirectionalLightSignature;
   DirectionalLightSignature.set(
-      mCoordinator.GetComponentType<DirectionalLightComponent>());
-  mCoordinator.SetSystemSignature<DirectionalLightSystem>(
+      coordinator.GetComponentType<DirectionalLightComponent>());
+  coordinator.SetSystemSignature<DirectionalLightSystem>(
       DirectionalLightSignature);
 
-  mCoordinator.RegisterSystem<PointLightSystem>();
+  coordinator.RegisterSystem<PointLightSystem>();
   Signature PointLightSignature;
-  PointLightSignature.set(mCoordinator.GetComponentType<PointLightComponent>());
-  PointLightSignature.set(mCoordinator.GetComponentType<TransformComponent>());
-  mCoordinator.SetSystemSignature<PointLightSystem>(PointLightSignature);
+  PointLightSignature.set(coordinator.GetComponentType<PointLightComponent>());
+  PointLightSignature.set(coordinator.GetComponentType<TransformComponent>());
+  coordinator.SetSystemSignature<PointLightSystem>(PointLightSignature);
 
-  mCoordinator.RegisterSystem<SpotLightSystem>();
+  coordinator.RegisterSystem<SpotLightSystem>();
   Signature SpotLightSignature;
-  SpotLightSignature.set(mCoordinator.GetComponentType<SpotLightComponent>());
-  SpotLightSignature.set(mCoordinator.GetComponentType<TransformComponent>());
-  mCoordinator.SetSystemSignature<SpotLightSystem>(SpotLightSignature);
-
-  // ======= RESOURCES =======
-
-  mResources.meshes = &mMeshManager;
-  mResources.shaders = &mShaderManager;
-
-  mSerializeRegistry = RegisterSerializeDefaultComponents();
-  mSceneManager = std::make_unique<SceneManager>(
-      SceneManager{mCoordinator, mSerializeRegistry, mResources});
+  SpotLightSignature.set(coordinator.GetComponentType<SpotLightComponent>());
+  SpotLightSignature.set(coordinator.GetComponentType<TransformComponent>());
+  coordinator.SetSystemSignature<SpotLightSystem>(SpotLightSignature);
 }
 
 SerializationRegistry App::RegisterSerializeDefaultComponents() {
@@ -147,6 +462,7 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
 
   // --- TransformComponent ---
   registry.RegisterComponent<TransformComponent>(
+      "TransformComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &) -> Json {
          const auto &t = c.GetComponent<TransformComponent>(e);
@@ -170,10 +486,13 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              t.mScale.x = j["scale_x"];
              t.mScale.y = j["scale_y"];
              t.mScale.z = j["scale_z"];
-           }});
+           },
+       .binary = PodColumn<TransformComponent>(),
+       .concurrent = true});
 
   // --- CameraComponent ---
   registry.RegisterComponent<CameraComponent>(
+      "CameraComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &) -> Json {
          const auto &cam = c.GetComponent<CameraComponent>(e);
@@ -213,10 +532,13 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              cam.mFov = j["fov"];
              cam.mNearPlane = j["nearPlane"];
              cam.mFarPlane = j["farPlane"];
-           }});
+           },
+       .binary = PodColumn<CameraComponent>(),
+       .concurrent = true});
 
   // --- DirectionalLightComponent ---
   registry.RegisterComponent<DirectionalLightComponent>(
+      "DirectionalLightComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &) -> Json {
          const auto &l = c.GetComponent<DirectionalLightComponent>(e);
@@ -237,10 +559,13 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              l.lightColor.g = j["color_g"];
              l.lightColor.b = j["color_b"];
              l.intensity = j["intensity"];
-           }});
+           },
+       .binary = PodColumn<DirectionalLightComponent>(),
+       .concurrent = true});
 
   // --- MaterialComponent ---
   registry.RegisterComponent<MaterialComponent>(
+      "MaterialComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &) -> Json {
          const auto &m = c.GetComponent<MaterialComponent>(e);
@@ -265,10 +590,13 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              m.specular.g = j["specular_g"];
              m.specular.b = j["specular_b"];
              m.shininess = j["shininess"];
-           }});
+           },
+       .binary = PodColumn<MaterialComponent>(),
+       .concurrent = true});
 
   // --- MeshComponent ---
   registry.RegisterComponent<MeshComponent>(
+      "MeshComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &rm) -> Json {
          const auto &m = c.GetComponent<MeshComponent>(e);
@@ -279,11 +607,28 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              if (!c.HasComponent<MeshComponent>(e))
                c.AddComponent(e, MeshComponent{});
              auto &m = c.GetComponent<MeshComponent>(e);
-             m.mId = rm.meshes->LoadMesh(j["path"]);
-           }});
+             MeshId old = m.mId;
+             m.mId = rm.meshes->LoadMeshAsync(j["path"]);
+             rm.meshes->ReleaseMesh(old);
+           },
+       .binary = MeshColumn(),
+       .request_resources = RequestMeshes,
+       .track_references =
+           [](Coordinator &c, ResourceContext &rm) {
+             MeshManager *meshes = rm.meshes;
+             c.SetComponentHooks<MeshComponent>(
+                 [meshes](const MeshComponent &m, size_t count) {
+                   meshes->RetainMesh(m.mId, static_cast<unsigned>(count));
+                 },
+                 [meshes](const MeshComponent &m, size_t) {
+                   meshes->ReleaseMesh(m.mId);
+                 });
+           },
+       .concurrent = true});
 
   // --- PointLightComponent ---
   registry.RegisterComponent<PointLightComponent>(
+      "PointLightComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &) -> Json {
          const auto &p = c.GetComponent<PointLightComponent>(e);
@@ -304,34 +649,61 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              p.linear = j["linear"];
              p.constant = j["constant"];
              p.quadratic = j["quadratic"];
-           }});
+           },
+       .binary = PodColumn<PointLightComponent>(),
+       .concurrent = true});
 
   // --- ShaderComponent ---
   registry.RegisterComponent<ShaderComponent>(
+      "ShaderComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &rm) -> Json {
          const auto &s = c.GetComponent<ShaderComponent>(e);
          std::pair<std::string, std::string> paths = rm.shaders->GetPath(s.mId);
-         return {{"vertex_path", paths.first},
-                 {"fragment_path", paths.second},
-                 {"color_r", s.mObjectColor.r},
-                 {"color_g", s.mObjectColor.g},
-                 {"color_b", s.mObjectColor.b}};
+         Json json = {{"vertex_path", paths.first},
+                      {"fragment_path", paths.second},
+                      {"color_r", s.mObjectColor.r},
+                      {"color_g", s.mObjectColor.g},
+                      {"color_b", s.mObjectColor.b}};
+         ShaderDefines defines = rm.shaders->GetDefines(s.mId);
+         if (!defines.empty())
+           json["defines"] = defines;
+         return json;
        },
        .deserialize =
            [](Entity e, const Json &j, Coordinator &c, ResourceContext &rm) {
              if (!c.HasComponent<ShaderComponent>(e))
                c.AddComponent(e, ShaderComponent{});
              auto &s = c.GetComponent<ShaderComponent>(e);
-             s.mId =
-                 rm.shaders->LoadShader(j["fragment_path"], j["vertex_path"]);
+             ShaderDefines defines;
+             if (j.contains("defines"))
+               defines = j["defines"].get<ShaderDefines>();
+             ShaderId old = s.mId;
+             s.mId = rm.shaders->LoadShaderAsync(j["fragment_path"],
+                                                 j["vertex_path"], defines);
+             rm.shaders->ReleaseShader(old);
              s.mObjectColor.r = j["color_r"];
              s.mObjectColor.g = j["color_g"];
              s.mObjectColor.b = j["color_b"];
-           }});
+           },
+       .binary = ShaderColumn(),
+       .request_resources = RequestShaders,
+       .track_references =
+           [](Coordinator &c, ResourceContext &rm) {
+             ShaderManager *shaders = rm.shaders;
+             c.SetComponentHooks<ShaderComponent>(
+                 [shaders](const ShaderComponent &s, size_t count) {
+                   shaders->RetainShader(s.mId, static_cast<unsigned>(count));
+                 },
+                 [shaders](const ShaderComponent &s, size_t) {
+                   shaders->ReleaseShader(s.mId);
+                 });
+           },
+       .concurrent = true});
 
   // --- SpotLightComponent ---
   registry.RegisterComponent<SpotLightComponent>(
+      "SpotLightComponent",
       {.schema_version = 1,
        .serialize = [](Entity e, Coordinator &c, ResourceContext &) -> Json {
          const auto &s = c.GetComponent<SpotLightComponent>(e);
@@ -359,12 +731,40 @@ SerializationRegistry App::RegisterSerializeDefaultComponents() {
              s.linear = j["linear"];
              s.constant = j["constant"];
              s.quadratic = j["quadratic"];
-           }});
+           },
+       .binary = PodColumn<SpotLightComponent>(),
+       .concurrent = true});
+
+  // --- PrefabComponent ---
+  // JSON scenes write it as the entity's "prefab", this is for binary ones
+  registry.RegisterComponent<PrefabComponent>(
+      "PrefabComponent",
+      {.schema_version = 1,
+       .serialize = [](Entity e, Coordinator &c, ResourceContext &rm) -> Json {
+         const auto &p = c.GetComponent<PrefabComponent>(e);
+         return {{"path", rm.prefabs ? rm.prefabs->GetPath(p.mId) : ""}};
+       },
+       .deserialize =
+           [](Entity e, const Json &j, Coordinator &c, ResourceContext &rm) {
+             if (!rm.prefabs)
+               return;
+             PrefabId id = rm.prefabs->Load(j["path"]);
+             if (id == INVALID_PREFAB)
+               return;
+             if (!c.HasComponent<PrefabComponent>(e))
+               c.AddComponent(e, PrefabComponent{});
+             c.GetComponent<PrefabComponent>(e).mId = id;
+           },
+       .binary = PrefabColumn()});
 
   return registry;
 }
 
 App::~App() {
+  StopRenderThread();
+  // GL objects go while their context is still current
+  mGpuProfiler.Release();
+  mOffscreen.reset();
   if (mWindow)
     glfwDestroyWindow(mWindow);
   glfwTerminate();
@@ -375,11 +775,6 @@ void App::Run() {
   auto renderer = mCoordinator.GetSystem<RenderSystem>();
   auto cameraSystem = mCoordinator.GetSystem<CameraSystem>();
 
-  auto directionalLightSystem =
-      mCoordinator.GetSystem<DirectionalLightSystem>();
-  auto pointLightSystem = mCoordinator.GetSystem<PointLightSystem>();
-  auto spotLightSystem = mCoordinator.GetSystem<SpotLightSystem>();
-
   // auto shader = mResources.shaders->LoadShader(
   //     "resources/shaders/default.frag", "resources/shaders/default.vert");
   // auto lightShader = mResources.shaders->LoadShader(
@@ -711,28 +1106,52 @@ void App::Run() {
   //
   // mSceneManager->SaveScene("resources/scenes/scene3.json");
 
-  mSceneManager->LoadScene("resources/scenes/scene1.json");
+  if (mWorldDirectory.empty() || !mWorldStreamer->Open(mWorldDirectory))
+    mSceneManager->LoadScene("resources/scenes/scene1.json");
   static bool spaceWasPressed = false;
+  static bool prepassWasPressed = false;
+  static bool profileWasPressed = false;
+  static bool memoryWasPressed = false;
   static bool keyWasPressed[10] = {false};
+  float lastStatsTime = 0.0f;
+  float lastTitleTime = 0.0f;
+  float lastAutosaveTime = 0.0f;
+
+  const bool threaded = mFramesInFlight > 0;
+  if (threaded)
+    StartRenderThread();
 
   while (!glfwWindowShouldClose(mWindow)) {
-    float currentTime = glfwGetTime();
+    // decided before the frame is simulated, which a counted frame does at
+    // its number's time
+    int headlessFrame = -1;
+    if (mHeadless.enabled && HeadlessFrameCounts())
+      headlessFrame = mHeadlessFrame;
+    float currentTime = GetTime();
     float deltaTime = currentTime - mLastFrameTime;
     mLastFrameTime = currentTime;
 
-    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
     for (int i = 0; i <= 9; ++i) {
       if (glfwGetKey(mWindow, GLFW_KEY_0 + i) == GLFW_PRESS) {
         if (!keyWasPressed[i]) {
+          // a converted binary copy of the scene wins over the JSON
           std::string filename =
-              "resources/scenes/scene" + std::to_string(i) + ".json";
+              "resources/scenes/scene" + std::to_string(i) +
+              SceneManager::BINARY_EXTENSION;
+          if (!std::filesystem::exists(filename))
+            filename = "resources/scenes/scene" + std::to_string(i) + ".json";
+          // the old scene's resources go to the pools, what the new one
+          // shares with it comes back without loading
+          PROFILE_SCOPE("SwitchScene");
+          mWorldStreamer->Close();
           mCoordinator.DestroyAllEntities();
-          mResources.meshes->Clear();
-          mResources.shaders->Clear();
+          mResources.prefabs->Clear();
+          mResources.meshes->ResetPoolStats();
+          mResources.shaders->ResetStats();
 
           mSceneManager->LoadScene(filename);
+          LogPoolStats("meshes", mResources.meshes->GetPoolStats());
+          LogPoolStats("shaders", mResources.shaders->GetPoolStats());
           keyWasPressed[i] = true;
         }
       } else {
@@ -740,14 +1159,22 @@ void App::Run() {
       }
     }
 
-    directionalLightSystem->Update(mCoordinator, mUniformManager);
-    pointLightSystem->Update(mCoordinator, mUniformManager);
-    spotLightSystem->Update(mCoordinator, mUniformManager);
-
-    cameraSystem->Update(mCoordinator, deltaTime);
-    cameraSystem->UploadToUBO(mCoordinator, mUniformManager,
-                              (float)mWidth / mHeight);
-    renderer->Update(mCoordinator, mResources, mUniformManager);
+    if (threaded) {
+      // the packet back from the renderer tells how its last frame went
+      RenderPacket &packet = mRenderThread.BeginPacket();
+      if (packet.feedback.rendered)
+        mFeedback = packet.feedback;
+      {
+        ProfileScope scope("Simulate", &mFrameTimings.cpu);
+        Simulate(deltaTime, packet);
+      }
+      packet.headlessFrame = headlessFrame;
+      mRenderThread.SubmitPacket();
+    } else {
+      mPacket.headlessFrame = headlessFrame;
+      Frame(deltaTime);
+      mFeedback = mPacket.feedback;
+    }
 
     if (glfwGetKey(mWindow, GLFW_KEY_SPACE) == GLFW_PRESS) {
       if (!spaceWasPressed) {
@@ -758,7 +1185,341 @@ void App::Run() {
       spaceWasPressed = false;
     }
 
-    glfwSwapBuffers(mWindow);
+    if (glfwGetKey(mWindow, GLFW_KEY_P) == GLFW_PRESS) {
+      if (!prepassWasPressed) {
+        renderer->SetDepthPrepass(!renderer->IsDepthPrepassEnabled());
+        std::cout << "Depth pre-pass: "
+                  << (renderer->IsDepthPrepassEnabled() ? "ON" : "OFF")
+                  << std::endl;
+        prepassWasPressed = true;
+      }
+    } else {
+      prepassWasPressed = false;
+    }
+
+    if (glfwGetKey(mWindow, GLFW_KEY_F9) == GLFW_PRESS) {
+      if (!profileWasPressed) {
+        // not while the renderer is recording
+        OnContextThread([this] {
+          if (Profiler::IsEnabled())
+            StopProfiling();
+          else
+            StartProfiling(TRACE_PATH);
+        });
+        std::cout << "Profiler: " << (Profiler::IsEnabled() ? "ON" : "OFF")
+                  << std::endl;
+        profileWasPressed = true;
+      }
+    } else {
+      profileWasPressed = false;
+    }
+
+    if (glfwGetKey(mWindow, GLFW_KEY_F10) == GLFW_PRESS) {
+      if (!memoryWasPressed) {
+        std::cout << MemoryTracker::Report() << std::flush;
+        memoryWasPressed = true;
+      }
+    } else {
+      memoryWasPressed = false;
+    }
+
+    if (renderer->IsDepthPrepassEnabled() &&
+        currentTime - lastStatsTime > 2.0f) {
+      const DepthPrepassStats &stats = mFeedback.depthPrepass;
+      std::cout << "Depth pre-pass: shaded " << stats.shadedFragments << " of "
+                << stats.depthFragments << " fragments ("
+                << stats.Savings() * 100.0f << "% saved)" << std::endl;
+      lastStatsTime = currentTime;
+    }
+
+    if (currentTime - lastTitleTime > 0.5f) {
+      const RenderStats &stats = mFeedback.stats;
+      std::string title = mTitle + " | " + std::to_string(stats.drawCalls) +
+                          " draws | " + std::to_string(stats.triangles) +
+                          " tris (full detail " +
+                          std::to_string(stats.trianglesFullDetail) +
+                          ") | " + std::to_string(stats.vertexBytes / 1024) +
+                          " KB vertices (float " +
+                          std::to_string(stats.vertexBytesFullPrecision / 1024) +
+                          " KB)";
+      size_t pending = mResources.meshes->GetPendingCount() +
+                       mResources.shaders->GetPendingCount();
+      if (pending > 0)
+        title += " | loading " + std::to_string(pending);
+      size_t streaming = mFeedback.uploadBytesQueued;
+      if (streaming > 0)
+        title += " (" + std::to_string(streaming / 1024) + " KB to upload)";
+      if (mWorldStreamer->IsOpen())
+        title += " | " +
+                 std::to_string(mWorldStreamer->GetStats().residentCells) +
+                 " cells";
+      glfwSetWindowTitle(mWindow, title.c_str());
+      lastTitleTime = currentTime;
+    }
+
+    // a streamed world is only partly resident, there is nothing whole to
+    // save
+    if (!mWorldStreamer->IsOpen() &&
+        currentTime - lastAutosaveTime > AUTOSAVE_INTERVAL_S) {
+      PROFILE_SCOPE("Autosave");
+      std::error_code error;
+      std::filesystem::create_directories(
+          std::filesystem::path(AUTOSAVE_PATH).parent_path(), error);
+      std::uintmax_t logBytes = std::filesystem::file_size(
+          SceneManager::GetDeltaLogPath(AUTOSAVE_PATH), error);
+      if (!error &&
+          logBytes > std::filesystem::file_size(AUTOSAVE_PATH, error))
+        mSceneManager->SaveScene(AUTOSAVE_PATH);
+      else
+        mSceneManager->SaveSceneDelta(AUTOSAVE_PATH);
+      lastAutosaveTime = currentTime;
+    }
+
+    if (!threaded)
+      Present(mPacket);
+    // threaded, the window only closes once the renderer dumped the last
+    // frame, there is nothing to simulate past it meanwhile
+    if (headlessFrame >= 0 && ++mHeadlessFrame >= mHeadless.frames &&
+        threaded)
+      break;
     glfwPollEvents();
   }
+  StopRenderThread();
+  if (mReportFrameStats)
+    ReportFrameStats();
+  if (Profiler::IsEnabled())
+    StopProfiling();
+}
+
+void App::StopProfiling() {
+  Profiler::SetEnabled(false);
+  std::cout << Profiler::Summarize();
+  if (mTracePath.empty())
+    return;
+  std::error_code error;
+  auto parent = std::filesystem::path(mTracePath).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent, error);
+  Profiler::WriteChromeTrace(mTracePath);
+}
+
+void App::Frame(float deltaTime) {
+  ProfileScope frame("Frame", &mFrameTimings.cpu);
+  Simulate(deltaTime, mPacket);
+  Render(mPacket);
+  mFrameTimings.uploads = mPacket.feedback.uploads;
+  mFrameTimings.render = mPacket.feedback.render;
+  mFrameTimings.gpu = mPacket.feedback.gpu;
+}
+
+void App::Simulate(float deltaTime, RenderPacket &packet) {
+  auto renderer = mCoordinator.GetSystem<RenderSystem>();
+  auto cameraSystem = mCoordinator.GetSystem<CameraSystem>();
+  auto directionalLightSystem =
+      mCoordinator.GetSystem<DirectionalLightSystem>();
+  auto pointLightSystem = mCoordinator.GetSystem<PointLightSystem>();
+  auto spotLightSystem = mCoordinator.GetSystem<SpotLightSystem>();
+
+  packet.simulationStart = Profiler::Now();
+  packet.width = mWidth;
+  packet.height = mHeight;
+  {
+    ProfileScope scope("LightSystems", &mFrameTimings.lights);
+    directionalLightSystem->Update(mCoordinator, packet.directionalLights);
+    pointLightSystem->Update(mCoordinator, packet.pointLights);
+    spotLightSystem->Update(mCoordinator, packet.spotLights);
+  }
+
+  glm::vec3 cameraPosition;
+  float cameraFov;
+  bool hasView;
+  {
+    ProfileScope scope("CameraSystem", &mFrameTimings.camera);
+    cameraSystem->Update(mCoordinator, deltaTime);
+    packet.hasCamera = cameraSystem->BuildUBO(
+        mCoordinator, (float)mWidth / mHeight, packet.camera);
+    hasView =
+        cameraSystem->GetActiveView(mCoordinator, cameraPosition, cameraFov);
+  }
+  {
+    ProfileScope scope("WorldStreamer", &mFrameTimings.streaming);
+    if (hasView) {
+      renderer->SetCamera(cameraPosition, cameraFov);
+      mWorldStreamer->Update(cameraPosition);
+    }
+  }
+  {
+    ProfileScope scope("ExtractRender", &mFrameTimings.extract);
+    renderer->Extract(mCoordinator, packet);
+  }
+}
+
+void App::Render(RenderPacket &packet) {
+  auto renderer = mCoordinator.GetSystem<RenderSystem>();
+  RenderFeedback &feedback = packet.feedback;
+
+  if (packet.width != mViewportWidth || packet.height != mViewportHeight) {
+    glViewport(0, 0, packet.width, packet.height);
+    mViewportWidth = packet.width;
+    mViewportHeight = packet.height;
+  }
+  glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  // finished async loads replace their placeholders
+  {
+    ProfileScope scope("ProcessUploads", &feedback.uploads);
+    mResources.shaders->ProcessUploads(SHADER_UPLOAD_BUDGET_MS);
+    mResources.meshes->ProcessUploads(MESH_UPLOAD_BUDGET_MS);
+  }
+  {
+    ProfileScope scope("RenderSystem", &feedback.render);
+    if (packet.hasCamera)
+      mUniformManager.UpdateUBO("Camera", packet.camera);
+    mUniformManager.UpdateUBO("DirectionalLight", packet.directionalLights);
+    mUniformManager.UpdateUBO("PointLight", packet.pointLights);
+    mUniformManager.UpdateUBO("SpotLight", packet.spotLights);
+    renderer->Submit(packet, mResources, mUniformManager);
+  }
+
+  mGpuProfiler.EndFrame();
+  feedback.gpu = mGpuProfiler.GetLastFrameMs();
+  feedback.stats = renderer->GetFrameStats();
+  feedback.depthPrepass = renderer->GetDepthPrepassStats();
+  feedback.uploadBytesQueued = mResources.meshes->GetUploadStats().bytesQueued;
+  feedback.rendered = true;
+  Profiler::EndFrame();
+}
+
+void App::Present(const RenderPacket &packet) {
+  if (mHeadless.enabled) {
+    if (packet.headlessFrame >= 0)
+      DumpOffscreenFrame(packet.headlessFrame);
+  } else {
+    PROFILE_SCOPE("SwapBuffers");
+    glfwSwapBuffers(mWindow);
+  }
+
+  // frames still loading don't say anything about the steady state
+  if (mReportFrameStats && (!mHeadless.enabled || packet.headlessFrame >= 0)) {
+    std::uint64_t now = Profiler::Now();
+    mFrameLatencies.push_back((now - packet.simulationStart) / 1e6);
+    if (mFirstPresent == 0)
+      mFirstPresent = now;
+    mLastPresent = now;
+  }
+}
+
+float App::GetTime() const {
+  if (mHeadless.enabled)
+    return mHeadlessFrame * HEADLESS_FRAME_TIME_S;
+  return glfwGetTime();
+}
+
+bool App::HeadlessFrameCounts() {
+  // a streamed mesh stays pending until its upload completes, so this
+  // doesn't have to ask the renderer about its queue
+  bool loading = mResources.meshes->GetPendingCount() > 0 ||
+                 mResources.shaders->GetPendingCount() > 0;
+  if (!mHeadless.waitForLoads || !loading)
+    return true;
+  if (++mSettleFrames < MAX_SETTLE_FRAMES)
+    return false;
+  if (mSettleFrames == MAX_SETTLE_FRAMES)
+    std::cerr << "[App] Resources still loading after " << mSettleFrames
+              << " frames, counting frames anyway" << std::endl;
+  return true;
+}
+
+void App::DumpOffscreenFrame(int frame) {
+  if (!mHeadless.dumpDirectory.empty()) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%04d.ppm", frame);
+    std::error_code error;
+    std::filesystem::create_directories(mHeadless.dumpDirectory, error);
+    mOffscreen->WritePpm(
+        (std::filesystem::path(mHeadless.dumpDirectory) / name).string());
+  }
+  if (frame + 1 >= mHeadless.frames)
+    glfwSetWindowShouldClose(mWindow, GLFW_TRUE);
+}
+
+void App::StartRenderThread() {
+  // the context follows the thread drawing, until StopRenderThread
+  if (mHeadless.enabled)
+    mHeadlessContext.ReleaseCurrent();
+  else
+    glfwMakeContextCurrent(nullptr);
+  mRenderThread.Start(
+      mFramesInFlight,
+      [this] {
+        if (mHeadless.enabled)
+          mHeadlessContext.MakeCurrent();
+        else
+          glfwMakeContextCurrent(mWindow);
+      },
+      [this](RenderPacket &packet) {
+        PROFILE_SCOPE("RenderFrame");
+        Render(packet);
+        Present(packet);
+      },
+      [this] {
+        if (mHeadless.enabled)
+          mHeadlessContext.ReleaseCurrent();
+        else
+          glfwMakeContextCurrent(nullptr);
+      });
+  std::cout << "[App] Rendering on its own thread, " << mFramesInFlight
+            << " frames in flight" << std::endl;
+}
+
+void App::StopRenderThread() {
+  if (!mRenderThread.IsRunning())
+    return;
+  mRenderThread.Stop();
+  if (mHeadless.enabled)
+    mHeadlessContext.MakeCurrent();
+  else
+    glfwMakeContextCurrent(mWindow);
+}
+
+void App::OnContextThread(const std::function<void()> &fn) {
+  if (mRenderThread.IsRunning())
+    mRenderThread.Invoke(fn);
+  else
+    fn();
+}
+
+void App::ReportFrameStats() const {
+  if (mFrameLatencies.empty())
+    return;
+  std::vector<double> latencies = mFrameLatencies;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              size_t(p * latencies.size()))];
+  };
+  double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0) /
+                latencies.size();
+  double seconds = (mLastPresent - mFirstPresent) / 1e9;
+  double fps = seconds > 0.0 ? (latencies.size() - 1) / seconds : 0.0;
+
+  char line[192];
+  std::snprintf(line, sizeof(line),
+                "[App] %zu frames at %.1f fps, latency mean %.2f ms, p50 "
+                "%.2f ms, p95 %.2f ms, max %.2f ms",
+                latencies.size(), fps, mean, percentile(0.5),
+                percentile(0.95), latencies.back());
+  std::cout << line << std::endl;
+  if (mFramesInFlight == 0)
+    return;
+  RenderThreadStats stats = mRenderThread.GetStats();
+  if (stats.frames == 0)
+    return;
+  std::snprintf(line, sizeof(line),
+                "[App] %u frames in flight, simulation waited %.3f ms and "
+                "renderer %.3f ms per frame",
+                mFramesInFlight, stats.simulationWaitMs / stats.frames,
+                stats.renderWaitMs / stats.frames);
+  std::cout << line << std::endl;
 }
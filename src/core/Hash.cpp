@@ -0,0 +1,34 @@
+#include "core/Hash.h"
+#include <cstring>
+
+namespace {
+
+inline std::uint64_t Rotl(std::uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+} // namespace
+
+std::uint64_t HashBytes(const void *data, size_t size, std::uint64_t seed) {
+  const std::uint64_t k0 = 0x9e3779b97f4a7c15ull, k1 = 0xff51afd7ed558ccdull,
+                      k2 = 0x87c37b91114253d5ull;
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  std::uint64_t h = seed ^ (size * k0);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    h = Rotl(h ^ (Rotl(word * k2, 31) * k0), 27) * k1;
+  }
+  if (i < size) {
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    h ^= Rotl(tail * k2, 31) * k0;
+  }
+
+  h ^= h >> 33;
+  h *= k1;
+  h ^= h >> 33;
+  return h;
+}
@@ -0,0 +1,66 @@
+#include "core/MemoryTracker.h"
+#include <cstdio>
+#include <iterator>
+
+namespace {
+
+const char *const CATEGORY_NAMES[] = {"ECS pools",       "mesh CPU data",
+                                      "mesh GPU buffers", "uniform buffers",
+                                      "shader programs", "JSON parsing"};
+static_assert(std::size(CATEGORY_NAMES) == size_t(MemoryCategory::Count));
+
+bool IsGpu(MemoryCategory category) {
+  return category == MemoryCategory::MeshGpu ||
+         category == MemoryCategory::UniformBuffers ||
+         category == MemoryCategory::ShaderPrograms;
+}
+
+} // namespace
+
+MemoryCategoryStats MemoryTracker::Get(MemoryCategory category) {
+  const Counters &counters = sCounters[size_t(category)];
+  MemoryCategoryStats stats;
+  stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+  stats.peakBytes = counters.peak.load(std::memory_order_relaxed);
+  stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+  return stats;
+}
+
+const char *MemoryTracker::GetName(MemoryCategory category) {
+  return CATEGORY_NAMES[size_t(category)];
+}
+
+size_t MemoryTracker::GetTotalBytes(bool gpu) {
+  size_t total = 0;
+  for (size_t i = 0; i < size_t(MemoryCategory::Count); ++i)
+    if (IsGpu(MemoryCategory(i)) == gpu)
+      total += Get(MemoryCategory(i)).bytes;
+  return total;
+}
+
+std::string MemoryTracker::Report() {
+  std::string report;
+  char line[160];
+  std::snprintf(line, sizeof(line), "[MemoryTracker] %zu KB CPU, %zu KB GPU\n",
+                GetTotalBytes(false) / 1024, GetTotalBytes(true) / 1024);
+  report += line;
+  std::snprintf(line, sizeof(line), "  %-20s %4s %12s %12s %12s\n",
+                "category", "", "KB", "peak KB", "allocations");
+  report += line;
+  for (size_t i = 0; i < size_t(MemoryCategory::Count); ++i) {
+    MemoryCategory category = MemoryCategory(i);
+    MemoryCategoryStats stats = Get(category);
+    std::snprintf(line, sizeof(line), "  %-20s %4s %12zu %12zu %12zu\n",
+                  GetName(category), IsGpu(category) ? "GPU" : "CPU",
+                  stats.bytes / 1024, stats.peakBytes / 1024,
+                  stats.allocations);
+    report += line;
+  }
+  return report;
+}
+
+void MemoryTracker::ResetPeaks() {
+  for (Counters &counters : sCounters)
+    counters.peak.store(counters.bytes.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+}
@@ -0,0 +1,298 @@
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+struct Event {
+  const char *name;
+  std::uint64_t start;
+  std::uint64_t duration;
+};
+
+// Written by one thread only; readers copy it and drop what the writer
+// lapped in the meantime
+struct ThreadRing {
+  std::uint32_t id = 0;
+  std::string name;
+  std::unique_ptr<Event[]> events{new Event[Profiler::RING_EVENTS]};
+  std::atomic<std::uint64_t> head{0};
+  // events before this were dropped by Reset()
+  std::atomic<std::uint64_t> floor{0};
+};
+
+struct FrameRecord {
+  std::uint64_t end;
+  ProfileFrameCounters counters;
+};
+
+const char *const COUNTER_NAMES[] = {"draw calls", "triangles",
+                                     "program binds", "VAO binds",
+                                     "UBO bytes"};
+static_assert(std::size(COUNTER_NAMES) == size_t(ProfileCounter::Count));
+
+std::mutex gRingsMutex;
+// never freed, events of finished threads stay exportable
+std::vector<std::unique_ptr<ThreadRing>> gRings;
+thread_local ThreadRing *tRing = nullptr;
+// for the ring the thread gets with its first event
+thread_local std::string tName;
+// a track of its own in traces, written from the GL context thread
+ThreadRing *gGpuRing = nullptr;
+
+// the context thread's, like the counters
+std::vector<FrameRecord> gFrames;
+size_t gFrameCount = 0;
+
+ThreadRing *NewRing(std::string name) {
+  std::lock_guard<std::mutex> lock(gRingsMutex);
+  auto ring = std::make_unique<ThreadRing>();
+  ring->id = std::uint32_t(gRings.size());
+  ring->name = name.empty() ? "thread " + std::to_string(ring->id) : name;
+  gRings.push_back(std::move(ring));
+  return gRings.back().get();
+}
+
+ThreadRing &GetRing() {
+  if (!tRing)
+    tRing = NewRing(tName);
+  return *tRing;
+}
+
+ThreadRing &GetGpuRing() {
+  if (!gGpuRing)
+    gGpuRing = NewRing("GPU");
+  return *gGpuRing;
+}
+
+void Push(ThreadRing &ring, const Event &event) {
+  std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+  ring.events[head % Profiler::RING_EVENTS] = event;
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<Event> Snapshot(const ThreadRing &ring) {
+  std::uint64_t head = ring.head.load(std::memory_order_acquire);
+  std::uint64_t first = head > Profiler::RING_EVENTS
+                            ? head - Profiler::RING_EVENTS
+                            : 0;
+  first = std::max(first, ring.floor.load(std::memory_order_relaxed));
+  std::vector<Event> events;
+  events.reserve(head - std::min(head, first));
+  for (std::uint64_t i = first; i < head; ++i)
+    events.push_back(ring.events[i % Profiler::RING_EVENTS]);
+
+  // the writer may have overwritten the oldest ones while they were copied,
+  // and may be halfway through event after, whose slot is the same as
+  // after - RING_EVENTS
+  std::atomic_thread_fence(std::memory_order_acquire);
+  std::uint64_t after = ring.head.load(std::memory_order_relaxed);
+  if (after >= Profiler::RING_EVENTS) {
+    std::uint64_t valid = after - Profiler::RING_EVENTS + 1;
+    if (valid > first)
+      events.erase(events.begin(),
+                   events.begin() +
+                       std::min<std::uint64_t>(valid - first, events.size()));
+  }
+  return events;
+}
+
+struct RingSnapshot {
+  std::uint32_t id;
+  std::string name;
+  std::vector<Event> events;
+};
+
+std::vector<RingSnapshot> SnapshotAll() {
+  std::lock_guard<std::mutex> lock(gRingsMutex);
+  std::vector<RingSnapshot> rings;
+  for (const auto &ring : gRings)
+    rings.push_back({ring->id, ring->name, Snapshot(*ring)});
+  return rings;
+}
+
+std::vector<FrameRecord> RecordedFrames() {
+  std::vector<FrameRecord> frames;
+  size_t count = std::min(gFrameCount, gFrames.size());
+  for (size_t i = gFrameCount - count; i < gFrameCount; ++i)
+    frames.push_back(gFrames[i % gFrames.size()]);
+  return frames;
+}
+
+std::string Escape(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
+
+} // namespace
+
+void Profiler::SetEnabled(bool enabled) {
+#ifdef RENDERCORE_PROFILER
+  if (enabled && gFrames.empty())
+    gFrames.resize(MAX_FRAMES);
+  sEnabled.store(enabled, std::memory_order_relaxed);
+  sCounters = {};
+#else
+  if (enabled)
+    std::cerr << "[Profiler] Built without RENDERCORE_PROFILER, nothing is "
+                 "recorded"
+              << std::endl;
+#endif
+}
+
+void Profiler::SetThreadName(const std::string &name) {
+  tName = name;
+  if (!tRing)
+    return;
+  std::lock_guard<std::mutex> lock(gRingsMutex);
+  tRing->name = name;
+}
+
+void Profiler::Record(const char *name, std::uint64_t start,
+                      std::uint64_t end) {
+  Push(GetRing(), {name, start, end - start});
+}
+
+void Profiler::RecordGpu(const char *name, std::uint64_t start,
+                         std::uint64_t duration) {
+  Push(GetGpuRing(), {name, start, duration});
+}
+
+void Profiler::EndFrame() {
+  if (!IsEnabled())
+    return;
+  sLastFrame = sCounters;
+  sCounters = {};
+  gFrames[gFrameCount++ % gFrames.size()] = {Now(), sLastFrame};
+}
+
+bool Profiler::WriteChromeTrace(const std::string &path) {
+  std::vector<RingSnapshot> rings = SnapshotAll();
+  std::vector<FrameRecord> frames = RecordedFrames();
+
+  std::uint64_t origin = ~std::uint64_t(0);
+  for (const RingSnapshot &ring : rings)
+    for (const Event &event : ring.events)
+      origin = std::min(origin, event.start);
+  for (const FrameRecord &frame : frames)
+    origin = std::min(origin, frame.end);
+  // trace_event wants microseconds
+  auto micros = [&](std::uint64_t ns) { return (ns - origin) / 1e3; };
+
+  std::ofstream file(path);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  auto separate = [&] {
+    if (!first)
+      file << ",\n";
+    first = false;
+  };
+  char line[128];
+  for (const RingSnapshot &ring : rings) {
+    separate();
+    file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+         << ring.id << ",\"args\":{\"name\":\"" << Escape(ring.name)
+         << "\"}}";
+    for (const Event &event : ring.events) {
+      separate();
+      std::snprintf(line, sizeof(line),
+                    "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                    "\"dur\":%.3f}",
+                    ring.id, micros(event.start), event.duration / 1e3);
+      file << "{\"name\":\"" << Escape(event.name) << line;
+    }
+  }
+  for (const FrameRecord &frame : frames) {
+    separate();
+    std::snprintf(line, sizeof(line), "%.3f", micros(frame.end));
+    file << "{\"ph\":\"C\",\"name\":\"frame\",\"pid\":1,\"ts\":" << line
+         << ",\"args\":{";
+    for (size_t i = 0; i < size_t(ProfileCounter::Count); ++i)
+      file << (i ? "," : "") << "\"" << COUNTER_NAMES[i]
+           << "\":" << frame.counters.values[i];
+    file << "}}";
+  }
+  file << "\n]}\n";
+  if (!file) {
+    std::cerr << "[Profiler] Couldn't write " << path << std::endl;
+    return false;
+  }
+  std::cout << "[Profiler] Trace written to " << path << std::endl;
+  return true;
+}
+
+std::string Profiler::Summarize() {
+  struct Totals {
+    size_t count = 0;
+    std::uint64_t total = 0;
+    std::uint64_t max = 0;
+  };
+  // GPU spans apart from CPU ones of the same name
+  std::map<std::string, Totals> scopes;
+  size_t events = 0;
+  for (const RingSnapshot &ring : SnapshotAll()) {
+    for (const Event &event : ring.events) {
+      Totals &totals = scopes[(ring.name == "GPU" ? "gpu: " : "") +
+                              std::string(event.name)];
+      ++totals.count;
+      totals.total += event.duration;
+      totals.max = std::max(totals.max, event.duration);
+      ++events;
+    }
+  }
+  std::vector<std::pair<std::string, Totals>> sorted(scopes.begin(),
+                                                     scopes.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.total > b.second.total;
+  });
+
+  std::vector<FrameRecord> frames = RecordedFrames();
+  std::ostringstream out;
+  out << "[Profiler] " << events << " events, " << frames.size()
+      << " frames\n";
+  char line[160];
+  std::snprintf(line, sizeof(line), "  %-28s %8s %10s %9s %9s\n", "scope",
+                "count", "total ms", "mean ms", "max ms");
+  out << line;
+  for (const auto &[name, totals] : sorted) {
+    std::snprintf(line, sizeof(line), "  %-28s %8zu %10.3f %9.3f %9.3f\n",
+                  name.c_str(), totals.count, totals.total / 1e6,
+                  totals.total / 1e6 / totals.count, totals.max / 1e6);
+    out << line;
+  }
+  if (!frames.empty()) {
+    out << "  per frame:";
+    for (size_t i = 0; i < size_t(ProfileCounter::Count); ++i) {
+      std::uint64_t sum = 0;
+      for (const FrameRecord &frame : frames)
+        sum += frame.counters.values[i];
+      out << (i ? ", " : " ") << sum / frames.size() << " "
+          << COUNTER_NAMES[i];
+    }
+    out << "\n";
+  }
+  return out.str();
+}
+
+void Profiler::Reset() {
+  {
+    std::lock_guard<std::mutex> lock(gRingsMutex);
+    for (const auto &ring : gRings)
+      ring->floor.store(ring->head.load(std::memory_order_acquire),
+                        std::memory_order_relaxed);
+  }
+  gFrameCount = 0;
+}
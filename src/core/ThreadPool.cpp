@@ -0,0 +1,108 @@
+#include "core/ThreadPool.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  if (threads == 0)
+    threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+  for (unsigned int i = 0; i < threads; ++i)
+    mThreads.emplace_back([this, i] {
+      Profiler::SetThreadName("worker " + std::to_string(i));
+      WorkerLoop();
+    });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+    mJobs.clear();
+  }
+  mJobAvailable.notify_all();
+  for (auto &thread : mThreads)
+    thread.join();
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mJobs.push_back(std::move(job));
+  }
+  mJobAvailable.notify_one();
+}
+
+void ThreadPool::WaitIdle() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mIdle.wait(lock, [this] { return mJobs.empty() && mRunning == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count,
+                             const std::function<void(size_t)> &fn) {
+  struct State {
+    std::atomic<size_t> next{0};
+    size_t done = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  // shared with helpers that may only start once everything is done
+  auto state = std::make_shared<State>();
+  auto work = [state, count, &fn] {
+    size_t ran = 0;
+    std::exception_ptr error;
+    for (size_t i; (i = state->next.fetch_add(1)) < count;) {
+      ++ran;
+      try {
+        fn(i);
+      } catch (...) {
+        error = std::current_exception();
+        // nobody gets the indices not handed out yet, they count as done
+        size_t next = state->next.exchange(count);
+        if (next < count)
+          ran += count - next;
+        break;
+      }
+    }
+    if (ran == 0)
+      return;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (error && !state->error)
+      state->error = error;
+    state->done += ran;
+    if (state->done == count)
+      state->finished.notify_all();
+  };
+
+  size_t helpers = std::min(mThreads.size(), count > 0 ? count - 1 : 0);
+  for (size_t i = 0; i < helpers; ++i)
+    Submit(work);
+  work();
+
+  // fn must outlive every call still running, even when one threw
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&] { return state->done == count; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+void ThreadPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mJobAvailable.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+    if (mStopping)
+      return;
+
+    std::function<void()> job = std::move(mJobs.front());
+    mJobs.pop_front();
+    ++mRunning;
+    lock.unlock();
+    job();
+    lock.lock();
+    --mRunning;
+    if (mJobs.empty() && mRunning == 0)
+      mIdle.notify_all();
+  }
+}
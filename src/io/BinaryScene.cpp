@@ -0,0 +1,375 @@
+#include "io/BinaryScene.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char MAGIC[4] = {'R', 'C', 'S', 'C'};
+constexpr char DELTA_MAGIC[4] = {'R', 'C', 'D', 'L'};
+constexpr std::uint32_t VERSION = 1;
+constexpr std::uint32_t DELTA_VERSION = 1;
+constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint32_t stringCount;
+  std::uint32_t entityCount;
+  std::uint32_t columnCount;
+};
+
+struct ColumnHeader {
+  std::uint32_t name;
+  std::uint32_t schemaVersion;
+  std::uint32_t recordSize;
+  std::uint32_t count;
+};
+
+struct DeltaHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint32_t reserved;
+  std::uint64_t baseSize;
+  std::int64_t baseTime;
+};
+
+struct DeltaRecordHeader {
+  std::uint32_t destroyedCount;
+  std::uint32_t reserved;
+  std::uint64_t sceneSize;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<ColumnHeader>);
+static_assert(std::is_trivially_copyable_v<DeltaHeader>);
+static_assert(std::is_trivially_copyable_v<DeltaRecordHeader>);
+static_assert(sizeof(Entity) == sizeof(std::uint32_t));
+
+// Bounds-checked cursor over the mapped file
+class Cursor {
+public:
+  Cursor(const char *data, size_t size) : mData(data), mSize(size) {}
+
+  template <typename T> bool Read(T &value) {
+    if (mSize - mOffset < sizeof(T))
+      return false;
+    std::memcpy(&value, mData + mOffset, sizeof(T));
+    mOffset += sizeof(T);
+    return true;
+  }
+
+  // Pointer to the next size bytes, nullptr when the file is shorter
+  const char *Skip(size_t size) {
+    if (mSize - mOffset < size)
+      return nullptr;
+    const char *data = mData + mOffset;
+    mOffset += size;
+    return data;
+  }
+
+  size_t GetOffset() const { return mOffset; }
+
+private:
+  const char *mData;
+  size_t mSize;
+  size_t mOffset = 0;
+};
+
+} // namespace
+
+std::uint32_t SceneStringTable::Intern(const std::string &value) {
+  auto [it, inserted] = mIndices.try_emplace(
+      value, static_cast<std::uint32_t>(mStrings.size()));
+  if (inserted)
+    mStrings.push_back(value);
+  return it->second;
+}
+
+bool WriteBinaryScene(std::ostream &out,
+                      const std::vector<std::string> &strings,
+                      const std::vector<Entity> &entities,
+                      const std::vector<BinarySceneColumn> &columns) {
+  Header header{};
+  std::memcpy(header.magic, MAGIC, 4);
+  header.version = VERSION;
+  header.byteOrder = BYTE_ORDER_MARK;
+  header.stringCount = static_cast<std::uint32_t>(strings.size());
+  header.entityCount = static_cast<std::uint32_t>(entities.size());
+  header.columnCount = static_cast<std::uint32_t>(columns.size());
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const std::string &value : strings) {
+    std::uint32_t length = static_cast<std::uint32_t>(value.size());
+    out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    out.write(value.data(), length);
+  }
+  out.write(reinterpret_cast<const char *>(entities.data()),
+            entities.size() * sizeof(Entity));
+
+  for (const BinarySceneColumn &column : columns) {
+    ColumnHeader columnHeader{column.name, column.schemaVersion,
+                              column.recordSize,
+                              static_cast<std::uint32_t>(
+                                  column.entities.size())};
+    out.write(reinterpret_cast<const char *>(&columnHeader),
+              sizeof(columnHeader));
+    out.write(reinterpret_cast<const char *>(column.entities.data()),
+              column.entities.size() * sizeof(Entity));
+    out.write(column.records.data(), column.records.size());
+  }
+  return static_cast<bool>(out);
+}
+
+bool WriteBinaryScene(const std::string &path,
+                      const std::vector<std::string> &strings,
+                      const std::vector<Entity> &entities,
+                      const std::vector<BinarySceneColumn> &columns) {
+  // written aside and renamed so a crash never leaves a torn scene
+  std::string tempPath = path + ".tmp";
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "[BinaryScene] Failed to create " << tempPath << std::endl;
+      return false;
+    }
+    if (!WriteBinaryScene(out, strings, entities, columns)) {
+      std::cerr << "[BinaryScene] Failed to write " << tempPath << std::endl;
+      return false;
+    }
+  }
+
+  std::error_code error;
+  fs::rename(tempPath, path, error);
+  if (error) {
+    std::cerr << "[BinaryScene] Failed to replace " << path << ": "
+              << error.message() << std::endl;
+    fs::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
+
+bool BinarySceneReader::Open(const std::string &path) {
+  mFile = MappedFile(path);
+  if (!mFile.IsOpen()) {
+    std::cerr << "[BinaryScene] Failed to open " << path << std::endl;
+    mStrings.clear();
+    mEntities.clear();
+    mColumns.clear();
+    return false;
+  }
+  return Parse(mFile.Data(), mFile.Size(), path);
+}
+
+bool BinarySceneReader::Open(const char *data, size_t size,
+                             const std::string &name) {
+  mFile = MappedFile();
+  return Parse(data, size, name);
+}
+
+bool BinarySceneReader::Parse(const char *data, size_t size,
+                              const std::string &name) {
+  mStrings.clear();
+  mEntities.clear();
+  mColumns.clear();
+
+  auto malformed = [&](const char *what) {
+    std::cerr << "[BinaryScene] " << name << ": " << what << std::endl;
+    mStrings.clear();
+    mEntities.clear();
+    mColumns.clear();
+    return false;
+  };
+
+  Cursor cursor(data, size);
+  Header header;
+  if (!cursor.Read(header) || std::memcmp(header.magic, MAGIC, 4) != 0)
+    return malformed("not a binary scene");
+  if (header.version != VERSION)
+    return malformed("unsupported format version");
+  if (header.byteOrder != BYTE_ORDER_MARK)
+    return malformed("written with another byte order");
+
+  mStrings.reserve(header.stringCount);
+  for (std::uint32_t i = 0; i < header.stringCount; ++i) {
+    std::uint32_t length;
+    const char *data;
+    if (!cursor.Read(length) || !(data = cursor.Skip(length)))
+      return malformed("truncated string table");
+    mStrings.emplace_back(data, length);
+  }
+
+  const char *entities =
+      cursor.Skip(size_t(header.entityCount) * sizeof(Entity));
+  if (!entities)
+    return malformed("truncated entity list");
+  mEntities.resize(header.entityCount);
+  std::memcpy(mEntities.data(), entities, mEntities.size() * sizeof(Entity));
+
+  // the ids index the entity manager's arrays directly, so a corrupt file
+  // must not get them there: 0 is an id not in the list, 1 one in it, and
+  // column i marks the ids it has seen with i + 2
+  Entity maxId = 0;
+  for (Entity entity : mEntities) {
+    if (entity >= MAX_ENTITIES)
+      return malformed("entity id out of range");
+    maxId = std::max(maxId, entity);
+  }
+  std::vector<std::uint32_t> seen(mEntities.empty() ? 0 : maxId + 1, 0);
+  for (Entity entity : mEntities) {
+    if (seen[entity] != 0)
+      return malformed("duplicate entity id");
+    seen[entity] = 1;
+  }
+
+  for (std::uint32_t i = 0; i < header.columnCount; ++i) {
+    ColumnHeader columnHeader;
+    if (!cursor.Read(columnHeader))
+      return malformed("truncated column");
+    if (columnHeader.name >= mStrings.size())
+      return malformed("column name out of range");
+
+    // JSON columns hold one string index per component
+    size_t recordSize = columnHeader.recordSize ? columnHeader.recordSize
+                                                : sizeof(std::uint32_t);
+    Column column{columnHeader.name, columnHeader.schemaVersion,
+                  columnHeader.recordSize, columnHeader.count, nullptr,
+                  nullptr};
+    column.entities = cursor.Skip(size_t(columnHeader.count) * sizeof(Entity));
+    column.records = column.entities
+                         ? cursor.Skip(size_t(columnHeader.count) * recordSize)
+                         : nullptr;
+    if (!column.records && columnHeader.count > 0)
+      return malformed("truncated column");
+    for (std::uint32_t k = 0; k < columnHeader.count; ++k) {
+      Entity entity;
+      std::memcpy(&entity, column.entities + k * sizeof(Entity),
+                  sizeof(Entity));
+      if (entity >= seen.size() || seen[entity] == 0)
+        return malformed("component of an entity not in the scene");
+      if (seen[entity] == i + 2)
+        return malformed("duplicate component");
+      seen[entity] = i + 2;
+    }
+    mColumns.push_back(column);
+  }
+  return true;
+}
+
+bool ReadSceneFileStamp(const std::string &path, SceneFileStamp &stamp) {
+  std::error_code error;
+  stamp.size = fs::file_size(path, error);
+  if (error)
+    return false;
+  stamp.time = fs::last_write_time(path, error).time_since_epoch().count();
+  return !error;
+}
+
+bool AppendSceneDelta(const std::string &logPath, const SceneFileStamp &base,
+                      const std::vector<Entity> &destroyed,
+                      const std::vector<std::string> &strings,
+                      const std::vector<Entity> &entities,
+                      const std::vector<BinarySceneColumn> &columns) {
+  std::ostringstream scene(std::ios::binary);
+  WriteBinaryScene(scene, strings, entities, columns);
+  std::string image = scene.str();
+
+  std::error_code error;
+  std::uintmax_t previousSize = fs::file_size(logPath, error);
+  if (error)
+    previousSize = 0;
+  {
+    std::ofstream out(logPath, std::ios::binary | std::ios::app);
+    if (!out.is_open()) {
+      std::cerr << "[BinaryScene] Failed to open " << logPath << std::endl;
+      return false;
+    }
+    if (previousSize == 0) {
+      DeltaHeader header{};
+      std::memcpy(header.magic, DELTA_MAGIC, 4);
+      header.version = DELTA_VERSION;
+      header.byteOrder = BYTE_ORDER_MARK;
+      header.baseSize = base.size;
+      header.baseTime = base.time;
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+    DeltaRecordHeader record{static_cast<std::uint32_t>(destroyed.size()), 0,
+                             image.size()};
+    out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    out.write(reinterpret_cast<const char *>(destroyed.data()),
+              destroyed.size() * sizeof(Entity));
+    out.write(image.data(), image.size());
+    out.flush();
+    if (out)
+      return true;
+  }
+
+  std::cerr << "[BinaryScene] Failed to write " << logPath << std::endl;
+  fs::resize_file(logPath, previousSize, error);
+  return false;
+}
+
+bool SceneDeltaReader::Open(const std::string &path) {
+  mPath = path;
+  mOffset = 0;
+  mTorn = false;
+  mFile = MappedFile(path);
+  if (!mFile.IsOpen())
+    return false;
+
+  DeltaHeader header;
+  Cursor cursor(mFile.Data(), mFile.Size());
+  if (!cursor.Read(header) || std::memcmp(header.magic, DELTA_MAGIC, 4) != 0 ||
+      header.version != DELTA_VERSION ||
+      header.byteOrder != BYTE_ORDER_MARK) {
+    std::cerr << "[BinaryScene] " << path << ": not a delta log this build "
+              << "can read" << std::endl;
+    mFile = MappedFile();
+    return false;
+  }
+  mBase = {header.baseSize, header.baseTime};
+  mOffset = cursor.GetOffset();
+  return true;
+}
+
+bool SceneDeltaReader::Next(std::vector<Entity> &destroyed,
+                            BinarySceneReader &scene) {
+  if (!mFile.IsOpen() || mTorn || mOffset == mFile.Size())
+    return false;
+
+  Cursor cursor(mFile.Data() + mOffset, mFile.Size() - mOffset);
+  DeltaRecordHeader record;
+  const char *ids = nullptr;
+  const char *image = nullptr;
+  if (!cursor.Read(record) ||
+      !(ids = cursor.Skip(size_t(record.destroyedCount) * sizeof(Entity))) ||
+      record.sceneSize > mFile.Size() ||
+      !(image = cursor.Skip(static_cast<size_t>(record.sceneSize))) ||
+      !scene.Open(image, static_cast<size_t>(record.sceneSize), mPath)) {
+    mTorn = true;
+    return false;
+  }
+
+  destroyed.resize(record.destroyedCount);
+  std::memcpy(destroyed.data(), ids, destroyed.size() * sizeof(Entity));
+  if (std::any_of(destroyed.begin(), destroyed.end(),
+                  [](Entity e) { return e >= MAX_ENTITIES; })) {
+    std::cerr << "[BinaryScene] " << mPath
+              << ": destroyed entity id out of range" << std::endl;
+    mTorn = true;
+    return false;
+  }
+  mOffset += cursor.GetOffset();
+  return true;
+}
@@ -0,0 +1,203 @@
+#include "io/JsonSceneStream.h"
+#include "core/MemoryTracker.h"
+#include <cstddef>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <vector>
+
+using Json = nlohmann::json;
+
+namespace {
+
+// Builds a DOM only for the elements of "entities", hands each one over
+// when its closing brace is read and starts over for the next.
+class EntitySaxHandler : public nlohmann::json_sax<Json> {
+public:
+  explicit EntitySaxHandler(const std::function<void(Json &)> &onEntity)
+      : mOnEntity(onEntity) {}
+
+  bool null() override { return Value(nullptr); }
+  bool boolean(bool value) override { return Value(value); }
+  bool number_integer(number_integer_t value) override { return Value(value); }
+  bool number_unsigned(number_unsigned_t value) override {
+    return Value(value);
+  }
+  bool number_float(number_float_t value, const string_t &) override {
+    return Value(value);
+  }
+  bool string(string_t &value) override { return Value(std::move(value)); }
+  bool binary(binary_t &value) override { return Value(std::move(value)); }
+
+  bool start_object(std::size_t) override { return Open(Json::object()); }
+  bool start_array(std::size_t) override {
+    // {"entities": [ at depth 1 starts the stream
+    if (mStack.empty() && mDepth == 1 && mKey == "entities") {
+      ++mDepth;
+      mInEntities = true;
+      return true;
+    }
+    return Open(Json::array());
+  }
+
+  bool key(string_t &value) override {
+    mKey = std::move(value);
+    return true;
+  }
+
+  bool end_object() override { return Close(); }
+  bool end_array() override {
+    if (mStack.empty() && mInEntities && mDepth == 2) {
+      --mDepth;
+      mInEntities = false;
+      return true;
+    }
+    return Close();
+  }
+
+  bool parse_error(std::size_t, const std::string &,
+                   const nlohmann::detail::exception &ex) override {
+    mError = ex.what();
+    return false;
+  }
+
+  const std::string &GetError() const { return mError; }
+
+private:
+  // Element of an entity being built, or something outside "entities"
+  // that is only counted
+  template <typename T> bool Value(T &&value) {
+    if (!mStack.empty())
+      Insert(Json(std::forward<T>(value)));
+    return true;
+  }
+
+  bool Open(Json &&container) {
+    if (!mStack.empty()) {
+      mStack.push_back(Insert(std::move(container)));
+    } else if (mInEntities && mDepth == 2) {
+      mEntity = std::move(container);
+      mStack.push_back(&mEntity);
+    }
+    ++mDepth;
+    return true;
+  }
+
+  bool Close() {
+    --mDepth;
+    if (mStack.empty())
+      return true;
+    mStack.pop_back();
+    if (mStack.empty()) {
+      mOnEntity(mEntity);
+      mEntity = Json();
+    }
+    return true;
+  }
+
+  Json *Insert(Json &&value) {
+    Json &parent = *mStack.back();
+    if (parent.is_array()) {
+      parent.push_back(std::move(value));
+      return &parent.back();
+    }
+    Json &slot = parent[mKey];
+    slot = std::move(value);
+    return &slot;
+  }
+
+  const std::function<void(Json &)> &mOnEntity;
+  std::vector<Json *> mStack;
+  Json mEntity;
+  std::string mKey;
+  std::string mError;
+  size_t mDepth = 0;
+  bool mInEntities = false;
+};
+
+// Reads the stream a large block at a time. The parser's istream adapter
+// goes through the streambuf for every character, which made it the
+// slowest part of loading a scene.
+class ChunkedInput {
+public:
+  explicit ChunkedInput(std::istream &in) : mIn(in), mBuffer(1 << 20) {}
+
+  bool AtEnd() {
+    if (mPosition == mSize) {
+      mIn.read(mBuffer.data(), static_cast<std::streamsize>(mBuffer.size()));
+      mSize = static_cast<size_t>(mIn.gcount());
+      mPosition = 0;
+    }
+    return mSize == 0;
+  }
+  const char &Current() const { return mBuffer[mPosition]; }
+  void Advance() { ++mPosition; }
+
+  // Single-pass iterator over the stream, default constructed as the end
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char *;
+    using reference = const char &;
+
+    Iterator() = default;
+    explicit Iterator(ChunkedInput *input) : mInput(input) {}
+
+    reference operator*() const { return mInput->Current(); }
+    Iterator &operator++() {
+      mInput->Advance();
+      return *this;
+    }
+    bool operator==(const Iterator &other) const {
+      return AtEnd() == other.AtEnd();
+    }
+    bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+  private:
+    bool AtEnd() const { return !mInput || mInput->AtEnd(); }
+
+    ChunkedInput *mInput = nullptr;
+  };
+
+private:
+  std::istream &mIn;
+  std::vector<char, TrackingAllocator<char, MemoryCategory::JsonParse>> mBuffer;
+  size_t mSize = 0;
+  size_t mPosition = 0;
+};
+
+} // namespace
+
+bool ReadJsonSceneEntities(std::istream &in,
+                           const std::function<void(Json &)> &onEntity,
+                           std::string &error) {
+  EntitySaxHandler handler(onEntity);
+  ChunkedInput input(in);
+  bool ok = Json::sax_parse(ChunkedInput::Iterator(&input),
+                            ChunkedInput::Iterator(), &handler);
+  if (!ok)
+    error = handler.GetError().empty() ? "parse error" : handler.GetError();
+  return ok;
+}
+
+JsonSceneWriter::JsonSceneWriter(std::ostream &out) : mOut(out) {
+  mOut << "{\"entities\":[";
+}
+
+JsonSceneWriter::~JsonSceneWriter() { Finish(); }
+
+void JsonSceneWriter::WriteEntity(const Json &entity) {
+  if (!mFirst)
+    mOut << ',';
+  mFirst = false;
+  mOut << entity;
+}
+
+void JsonSceneWriter::Finish() {
+  if (mFinished)
+    return;
+  mFinished = true;
+  mOut << "]}";
+}
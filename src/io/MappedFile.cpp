@@ -0,0 +1,77 @@
+#include "io/MappedFile.h"
+#include <fstream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RC_HAS_MMAP 1
+#endif
+
+MappedFile::MappedFile(const std::string &path) {
+#ifdef RC_HAS_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd != -1) {
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      mSize = static_cast<size_t>(st.st_size);
+      mOpen = true;
+      if (mSize > 0) {
+        void *data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+          madvise(data, mSize, MADV_SEQUENTIAL);
+          mData = static_cast<const char *>(data);
+          mMapped = true;
+        }
+      }
+    }
+    close(fd);
+    if (mMapped || (mOpen && mSize == 0))
+      return;
+    mOpen = false;
+    mSize = 0;
+  }
+#endif
+
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    return;
+  mBuffer.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(mBuffer.data(), static_cast<std::streamsize>(mBuffer.size()));
+  mData = mBuffer.data();
+  mSize = mBuffer.size();
+  mOpen = true;
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this == &other)
+    return *this;
+  Close();
+  mBuffer = std::move(other.mBuffer);
+  mData = other.mMapped ? other.mData : mBuffer.data();
+  mSize = other.mSize;
+  mOpen = other.mOpen;
+  mMapped = other.mMapped;
+  other.mData = nullptr;
+  other.mSize = 0;
+  other.mOpen = other.mMapped = false;
+  return *this;
+}
+
+void MappedFile::Close() {
+#ifdef RC_HAS_MMAP
+  if (mMapped)
+    munmap(const_cast<char *>(mData), mSize);
+#endif
+  mData = nullptr;
+  mSize = 0;
+  mOpen = mMapped = false;
+  mBuffer.clear();
+}
@@ -1,9 +1,13 @@
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/vec3.hpp>
 
 #include "App.h"
+#include "core/MemoryTracker.h"
 #include "render/Mesh.h"
 #include "ecs/Coordinator.h"
 #include "glm/detail/qualifier.hpp"
@@ -15,9 +19,81 @@
 // 4. Add READ ME file
 // 5. Look at the code, and maybe make refactoring
 
+// Engine                               runs the demo
+// Engine --convert-scene <from> <to>   converts between .json and .rcscene
+// Engine --partition-scene <scene> <dir> <cell size>
+//                                      splits a scene into a streamed world
+// Engine --world <dir>                 streams that world around the camera
+//
+// Any of them also take, before or after:
+// --headless                           renders offscreen, without a display
+// --frames <n>                         headless, stops after n frames
+// --dump <dir>                         headless, writes frames as PPM there
+// --profile <trace.json>               profiles the whole run, writes a
+//                                      Chrome trace and prints a summary
+// --release-geometry                   frees meshes' CPU copies after upload
+// --memory                             prints tracked memory when done
+// --render-thread <n>                  draws on a thread of its own, n (2 to
+//                                      4) frames behind the simulation
+// --frame-stats                        prints frame rate and latency
 int main (int argc, char *argv[]) {
-  App app = App(800, 800, "ECS");
+  HeadlessSettings headless;
+  std::string tracePath;
+  bool keepGeometry = true;
+  bool reportMemory = false;
+  unsigned int framesInFlight = 0;
+  bool frameStats = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--headless") {
+      headless.enabled = true;
+    } else if (arg == "--frames" && i + 1 < argc) {
+      headless.enabled = true;
+      headless.frames = std::stoi(argv[++i]);
+    } else if (arg == "--dump" && i + 1 < argc) {
+      headless.enabled = true;
+      headless.dumpDirectory = argv[++i];
+    } else if (arg == "--profile" && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (arg == "--release-geometry") {
+      keepGeometry = false;
+    } else if (arg == "--memory") {
+      reportMemory = true;
+    } else if (arg == "--render-thread" && i + 1 < argc) {
+      const char *value = argv[++i];
+      char *end;
+      long frames = std::strtol(value, &end, 10);
+      if (end == value || *end != '\0' || frames < 2 ||
+          frames > long(RenderThread::MAX_FRAMES_IN_FLIGHT)) {
+        std::cerr << "--render-thread takes 2 to "
+                  << RenderThread::MAX_FRAMES_IN_FLIGHT
+                  << " frames in flight, not " << value << std::endl;
+        return 1;
+      }
+      framesInFlight = static_cast<unsigned int>(frames);
+    } else if (arg == "--frame-stats") {
+      frameStats = true;
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  App app = App(800, 800, "ECS", headless);
   app.Init();
+  app.GetResources().meshes->SetKeepCpuGeometry(keepGeometry);
+  app.SetRenderThread(framesInFlight);
+  app.SetReportFrameStats(frameStats);
+  if (!tracePath.empty())
+    app.StartProfiling(tracePath);
+  if (args.size() == 3 && args[0] == "--convert-scene")
+    return app.ConvertScene(args[1], args[2]) ? 0 : 1;
+  if (args.size() == 4 && args[0] == "--partition-scene")
+    return app.PartitionScene(args[1], args[2], std::stof(args[3])) ? 0 : 1;
+  if (args.size() == 2 && args[0] == "--world")
+    app.SetWorld(args[1]);
   app.Run();
+  if (reportMemory)
+    std::cout << MemoryTracker::Report() << std::flush;
   return 0;
 }
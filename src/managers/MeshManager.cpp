@@ -1,139 +1,526 @@
 #include "managers/MeshManager.h"
+#include "core/Hash.h"
+#include "core/Profiler.h"
+#include "core/ThreadPool.h"
+#include "glm/common.hpp"
 #include "glm/ext/vector_float2.hpp"
 #include "glm/ext/vector_float3.hpp"
+#include "glm/geometric.hpp"
 #include "render/Mesh.h"
+#include "render/MeshOptimizer.h"
+#include "render/MeshSimplifier.h"
+#include "render/ObjParser.h"
 #include <algorithm>
-#include <fstream>
+#include <chrono>
 #include <iostream>
-#include <map>
 #include <memory>
-#include <sstream>
 #include <string>
 #include <vector>
 
-MeshId MeshManager::LoadMesh(const std::string &path) {
-  if (mPathToId.find(path) != mPathToId.end()) {
-    return mPathToId[path];
-  }
+namespace {
+
+// Unit cube shown in place of meshes that are still loading
+std::shared_ptr<Mesh> CreatePlaceholderMesh() {
   std::vector<Vertex> vertices;
   std::vector<unsigned int> indices;
-  LoadOBJ(path, vertices, indices);
+  for (int axis = 0; axis < 3; ++axis) {
+    for (float sign : {-1.0f, 1.0f}) {
+      glm::vec3 normal(0.0f);
+      normal[axis] = sign;
+      glm::vec3 u(0.0f), v(0.0f);
+      u[(axis + 1) % 3] = 1.0f;
+      v[(axis + 2) % 3] = sign;
 
-  auto mesh = std::make_shared<Mesh>(vertices, indices);
+      unsigned int base = static_cast<unsigned int>(vertices.size());
+      for (glm::vec2 corner : {glm::vec2(-1, -1), glm::vec2(1, -1),
+                               glm::vec2(1, 1), glm::vec2(-1, 1)}) {
+        Vertex vertex{};
+        vertex.position = (normal + corner.x * u + corner.y * v) * 0.5f;
+        vertex.normal = normal;
+        vertex.texCoord = corner * 0.5f + 0.5f;
+        vertices.push_back(vertex);
+      }
+      for (unsigned int k : {0u, 1u, 2u, 0u, 2u, 3u})
+        indices.push_back(base + k);
+    }
+  }
+  return std::make_shared<Mesh>(vertices, indices);
+}
 
-  MeshId id = mNextId++;
-  mPathToId[path] = id;
-  mIdToPath[id] = path;
-  mIdToMesh[id] = mesh;
+MeshInfo Describe(Mesh &mesh) {
+  MeshInfo info;
+  info.mesh = &mesh;
+  info.boundsCenter = mesh.GetBoundsCenter();
+  info.boundsRadius = mesh.GetBoundsRadius();
+  info.indexCount = static_cast<std::uint32_t>(mesh.GetTriangleCount() * 3);
+  info.lodCount = static_cast<std::uint32_t>(mesh.GetLodCount());
+  info.vertexStride = mesh.GetVertexFormat().GetStride();
+  info.indexType = mesh.GetIndexType();
+  return info;
+}
+
+} // namespace
+
+MeshId MeshManager::LoadMesh(const std::string &path) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto it = mPathToId.find(path);
+  if (it != mPathToId.end()) {
+    MeshId id = it->second;
+    Reference(id, 1);
+    if (mPending.count(id) == 0)
+      return id;
+
+    auto streaming = mStreaming.find(id);
+    if (streaming != mStreaming.end()) {
+      mUploader.Finish(streaming->second->GetUploadTicket());
+      MakeReady(id, streaming->second);
+      mStreaming.erase(streaming);
+      return id;
+    }
 
+    // an async load of the same path is in flight, finish it here
+    auto found = mCompleted.end();
+    mLoadCompleted.wait(lock, [&] {
+      found = std::find_if(mCompleted.begin(), mCompleted.end(),
+                           [&](const CompletedLoad &load) {
+                             return load.id == id &&
+                                    load.generation == mGeneration;
+                           });
+      return found != mCompleted.end();
+    });
+    MeshAsset asset = std::move(found->asset);
+    mCompleted.erase(found);
+    lock.unlock();
+
+    auto mesh = CreateMesh(path, asset);
+    lock.lock();
+    MakeReady(id, std::move(mesh));
+    return id;
+  }
+
+  MeshId id = NewId(path, 1);
+  if (id == 0)
+    return 0;
+  lock.unlock();
+
+  MeshAsset asset;
+  LoadAsset(path, asset);
+  auto mesh = CreateMesh(path, asset);
+
+  lock.lock();
+  MakeReady(id, std::move(mesh));
   return id;
 }
 
-std::shared_ptr<Mesh> MeshManager::GetMesh(MeshId id) {
-  auto it = mIdToMesh.find(id);
-  if (it == mIdToMesh.end())
-    return nullptr;
-  return it->second;
+MeshId MeshManager::LoadMeshAsync(const std::string &path) {
+  return RequestAsync(path, 1);
 }
 
-std::string &MeshManager::GetPath(MeshId id) { return mIdToPath[id]; }
+MeshId MeshManager::PrefetchMesh(const std::string &path) {
+  return RequestAsync(path, 0);
+}
 
-void MeshManager::LoadOBJ(const std::string &path,
-                          std::vector<Vertex> &outVertices,
-                          std::vector<unsigned int> &outIndices) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open OBJ file: " << path << std::endl;
+MeshId MeshManager::RequestAsync(const std::string &path,
+                                 unsigned int references) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto it = mPathToId.find(path);
+  if (it != mPathToId.end()) {
+    Reference(it->second, references);
+    return it->second;
+  }
+
+  MeshId id = NewId(path, references);
+  if (id == 0)
+    return 0;
+  mPending.insert(id);
+  const unsigned int generation = mGeneration;
+  lock.unlock();
+
+  auto job = [this, path, id, generation] {
+    {
+      std::lock_guard<std::mutex> guard(mMutex);
+      if (generation != mGeneration)
+        return;
+    }
+    MeshAsset asset;
+    LoadAsset(path, asset);
+    {
+      std::lock_guard<std::mutex> guard(mMutex);
+      if (generation != mGeneration)
         return;
+      mCompleted.push_back({id, generation, std::move(asset)});
+    }
+    mLoadCompleted.notify_all();
+  };
+
+  if (mWorkers)
+    mWorkers->Submit(std::move(job));
+  else
+    job();
+  return id;
+}
+
+MeshId MeshManager::NewId(const std::string &path, unsigned int references) {
+  MeshId id = mSlots.Allocate();
+  if (id == 0) {
+    std::cerr << "[MeshManager] Out of mesh handles, " << path
+              << " not loaded" << std::endl;
+    return 0;
+  }
+  size_t index = HandlePool<MeshInfo>::Index(id);
+  if (index >= mRecords.size())
+    mRecords.resize(index + 1);
+  mRecords[index] = {path, nullptr, references};
+  mPathToId[path] = id;
+  mPool.CountMiss();
+  return id;
+}
+
+void MeshManager::RetainMesh(MeshId id, unsigned int count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mSlots.Get(id))
+    Reference(id, count);
+}
+
+void MeshManager::ReleaseMesh(MeshId id) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (!mSlots.Get(id))
+    return;
+  MeshRecord &record = Record(id);
+  if (record.refs == 0 || --record.refs > 0)
+    return;
+  // one still loading is pooled by MakeReady
+  if (record.mesh)
+    mPool.Add(id, record.mesh->GetGpuBytes(), record.mesh->GetCpuBytes());
+}
+
+void MeshManager::Reference(MeshId id, unsigned int references) {
+  if (references == 0)
+    return;
+  mPool.Take(id);
+  Record(id).refs += references;
+}
+
+void MeshManager::MakeReady(MeshId id, std::shared_ptr<Mesh> mesh) {
+  MeshInfo *info = mSlots.Get(id);
+  if (!info)
+    return;
+  MeshRecord &record = Record(id);
+  if (record.refs == 0)
+    mPool.Add(id, mesh->GetGpuBytes(), mesh->GetCpuBytes());
+  *info = Describe(*mesh);
+  record.mesh = std::move(mesh);
+  mPending.erase(id);
+}
+
+void MeshManager::EvictPooled() {
+  std::vector<std::shared_ptr<Mesh>> evicted;
+  ResourcePoolStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (MeshId id : mPool.Evict(mPoolSettings)) {
+      MeshRecord &record = Record(id);
+      evicted.push_back(std::move(record.mesh));
+      mPathToId.erase(record.path);
+      record = {};
+      mSlots.Free(id);
     }
+    stats = mPool.GetStats();
+  }
+  if (evicted.empty())
+    return;
+  // the buffers go with the last reference, outside the lock
+  evicted.clear();
+  std::cout << "[MeshManager] Evicted unused meshes, " << stats.pooled
+            << " left in the pool (" << stats.gpuBytes / (1024 * 1024)
+            << " MB GPU, " << stats.cpuBytes / (1024 * 1024) << " MB CPU)"
+            << std::endl;
+}
+
+void MeshManager::SetPoolSettings(const ResourcePoolSettings &settings) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mPoolSettings = settings;
+}
 
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> texCoords;
-    std::map<std::string, unsigned int> uniqueVertexMap;
-
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream ss(line);
-        std::string type;
-        ss >> type;
-
-        if (type == "v") {
-            glm::vec3 pos;
-            ss >> pos.x >> pos.y >> pos.z;
-            positions.push_back(pos);
-        } 
-        else if (type == "vt") {
-            glm::vec2 uv;
-            ss >> uv.x >> uv.y;
-            texCoords.push_back(uv);
-        } 
-        else if (type == "vn") {
-            glm::vec3 normal;
-            ss >> normal.x >> normal.y >> normal.z;
-            normals.push_back(normal);
-        } 
-        else if (type == "f") {
-            std::vector<std::string> faceVertices;
-            std::string vertexData;
-
-            while (ss >> vertexData) {
-                faceVertices.push_back(vertexData);
-            }
-
-            if (faceVertices.size() < 3) continue;
-
-            auto processVertex = [&](const std::string& vData) -> unsigned int {
-                if (uniqueVertexMap.count(vData))
-                    return uniqueVertexMap[vData];
-
-                std::string temp = vData;
-                std::replace(temp.begin(), temp.end(), '/', ' ');
-
-                std::istringstream vs(temp);
-                int vi = 0, ti = 0, ni = 0;
-                vs >> vi >> ti >> ni;
-
-                Vertex vertex{};
-                vertex.position = positions[vi - 1];
-
-                if (ti > 0)
-                    vertex.texCoord = texCoords[ti - 1];
-
-                if (ni > 0)
-                    vertex.normal = normals[ni - 1];
-
-                unsigned int idx = outVertices.size();
-                uniqueVertexMap[vData] = idx;
-                outVertices.push_back(vertex);
-                return idx;
-            };
-
-            if (faceVertices.size() == 3) {
-                for (int i = 0; i < 3; i++)
-                    outIndices.push_back(processVertex(faceVertices[i]));
-            }
-            else if (faceVertices.size() == 4) {
-                unsigned int v0 = processVertex(faceVertices[0]);
-                unsigned int v1 = processVertex(faceVertices[1]);
-                unsigned int v2 = processVertex(faceVertices[2]);
-                unsigned int v3 = processVertex(faceVertices[3]);
-
-                outIndices.push_back(v0);
-                outIndices.push_back(v1);
-                outIndices.push_back(v2);
-
-                outIndices.push_back(v0);
-                outIndices.push_back(v2);
-                outIndices.push_back(v3);
-            }
-        }
+ResourcePoolStats MeshManager::GetPoolStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPool.GetStats();
+}
+
+void MeshManager::ResetPoolStats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mPool.ResetCounters();
+}
+
+size_t MeshManager::ProcessUploads(double budgetMs) {
+  auto start = std::chrono::steady_clock::now();
+  size_t uploaded = 0;
+  EvictPooled();
+
+  while (true) {
+    CompletedLoad load;
+    std::string path;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mCompleted.empty())
+        break;
+      load = std::move(mCompleted.front());
+      mCompleted.pop_front();
+      if (load.generation != mGeneration || !mSlots.Get(load.id))
+        continue;
+      path = Record(load.id).path;
     }
+
+    const MeshPayload &payload = load.asset.payload;
+    bool stream = payload.vertexBytes + payload.positionBytes +
+                      payload.indexBytes >=
+                  mUploader.GetSettings().minStreamBytes;
+    auto mesh = CreateMesh(path, load.asset, stream);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mesh->IsUploaded()) {
+        MakeReady(load.id, mesh);
+        ++uploaded;
+      } else {
+        mStreaming[load.id] = mesh;
+      }
+    }
+
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (elapsed.count() >= budgetMs)
+      break;
+  }
+
+  mUploader.Process();
+  uploaded += PromoteStreamed();
+
+  if (!mUploader.IsIdle()) {
+    mUploaderBusy = true;
+  } else if (mUploaderBusy) {
+    mUploaderBusy = false;
+    const StagingStats &stats = mUploader.GetStats();
+    std::cout << "[MeshManager] Uploads done, streamed "
+              << stats.bytesUploaded / (1024 * 1024) << " MB in "
+              << stats.frames << " frames so far (" << stats.ThroughputMBps()
+              << " MB/s, " << stats.orphans << " staging orphans)"
+              << std::endl;
+  }
+  return uploaded;
+}
+
+size_t MeshManager::PromoteStreamed() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  size_t promoted = 0;
+  for (auto it = mStreaming.begin(); it != mStreaming.end();) {
+    if (it->second->IsUploaded()) {
+      MakeReady(it->first, it->second);
+      it = mStreaming.erase(it);
+      ++promoted;
+    } else {
+      ++it;
+    }
+  }
+  return promoted;
+}
+
+std::shared_ptr<Mesh> MeshManager::CreateMesh(const std::string &path,
+                                              MeshAsset &asset, bool stream) {
+  PROFILE_SCOPE("CreateMesh");
+  const bool fromCache = asset.fromCache;
+  std::shared_ptr<Mesh> mesh;
+  if (stream) {
+    // the payload has to outlive this call, the asset moves into its owner
+    auto owner = std::make_shared<MeshAsset>(std::move(asset));
+    MeshPayload payload = owner->payload;
+    payload.owner = owner;
+    mesh = std::make_shared<Mesh>(
+        std::move(owner->vertices), std::move(owner->indices),
+        std::move(owner->lods), owner->layout, payload, &mUploader);
+  } else {
+    mesh = std::make_shared<Mesh>(
+        std::move(asset.vertices), std::move(asset.indices),
+        std::move(asset.lods), asset.layout, asset.payload);
+  }
+  if (!mKeepCpuGeometry)
+    mesh->ReleaseCpuData();
+
+  std::cout << "[MeshManager] " << path << ": " << mesh->GetTriangleCount();
+  for (size_t lod = 1; lod < mesh->GetLodCount(); ++lod)
+    std::cout << "/" << mesh->GetTriangleCount(lod);
+  std::cout << " triangles, " << mesh->GetVertexFormat().GetStride()
+            << "-byte vertices" << (fromCache ? " (cached)" : "")
+            << std::endl;
+  return mesh;
+}
+
+Mesh *MeshManager::GetMesh(MeshId id) {
+  const MeshInfo *info = GetInfo(id);
+  return info ? info->mesh : nullptr;
+}
+
+const MeshInfo *MeshManager::GetInfo(MeshId id) {
+  const MeshInfo *info = mSlots.Get(id);
+  if (!info || info->mesh)
+    return info;
+
+  if (!mPlaceholder) {
+    mPlaceholder = CreatePlaceholderMesh();
+    mPlaceholderInfo = Describe(*mPlaceholder);
+  }
+  return &mPlaceholderInfo;
+}
+
+bool MeshManager::IsReady(MeshId id) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const MeshInfo *info = mSlots.Get(id);
+  return info && info->mesh;
+}
+
+size_t MeshManager::GetPendingCount() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPending.size();
+}
+
+const std::string &MeshManager::GetPath(MeshId id) const {
+  static const std::string NONE;
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (!mSlots.Get(id))
+    return NONE;
+  return mRecords[HandlePool<MeshInfo>::Index(id)].path;
+}
+
+MeshMemoryStats MeshManager::GetMemoryStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  MeshMemoryStats stats;
+  for (const MeshRecord &record : mRecords) {
+    if (!record.mesh)
+      continue;
+    ++stats.meshes;
+    stats.gpuBytes += record.mesh->GetGpuBytes();
+    stats.cpuBytes += record.mesh->GetCpuBytes();
+    stats.fullPrecisionBytes += record.mesh->GetFullPrecisionBytes();
+  }
+  return stats;
+}
+
+void MeshManager::OptimizeMesh(const std::string &path,
+                               std::vector<Vertex> &vertices,
+                               std::vector<unsigned int> &indices) {
+  VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(
+      indices.data(), indices.size(), vertices.size());
+
+  if (mOptimizeSettings.vertexCache)
+    MeshOptimizer::OptimizeVertexCache(indices.data(), indices.size(),
+                                       vertices.size());
+  if (mOptimizeSettings.overdraw)
+    MeshOptimizer::OptimizeOverdraw(vertices, indices.data(), indices.size(),
+                                    mOptimizeSettings.overdrawThreshold);
+  if (mOptimizeSettings.vertexFetch)
+    MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+
+  VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(
+      indices.data(), indices.size(), vertices.size());
+  std::cout << "[MeshManager] " << path << ": ACMR " << before.acmr << " -> "
+            << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+            << std::endl;
+}
+
+std::vector<MeshLod>
+MeshManager::BuildLods(const std::vector<Vertex> &vertices,
+                       std::vector<unsigned int> &indices) {
+  const unsigned int baseCount = static_cast<unsigned int>(indices.size());
+  std::vector<MeshLod> lods{{0, baseCount, 0.0f}};
+  if (vertices.empty() || baseCount / 3 < mLodSettings.minTriangles)
+    return lods;
+
+  glm::vec3 min = vertices[0].position, max = vertices[0].position;
+  for (const auto &vertex : vertices) {
+    min = glm::min(min, vertex.position);
+    max = glm::max(max, vertex.position);
+  }
+  float maxError = mLodSettings.maxError * glm::length(max - min) * 0.5f;
+
+  // each level is simplified from the previous one, which is cheaper and
+  // keeps the chain nested
+  std::vector<unsigned int> source(indices.begin(), indices.end());
+  for (float ratio : mLodSettings.ratios) {
+    size_t target = static_cast<size_t>(baseCount / 3 * ratio) * 3;
+    if (target / 3 < mLodSettings.minTriangles)
+      break;
+
+    float error = 0.0f;
+    std::vector<unsigned int> simplified =
+        MeshSimplifier::Simplify(vertices, source, target, maxError, &error);
+
+    // stalled on the error limit, further levels would look the same
+    if (simplified.empty() || simplified.size() > source.size() * 9 / 10)
+      break;
+
+    // simplification keeps the triangle order, which no longer fans well
+    if (mOptimizeSettings.vertexCache)
+      MeshOptimizer::OptimizeVertexCache(simplified.data(), simplified.size(),
+                                         vertices.size());
+
+    lods.push_back({static_cast<unsigned int>(indices.size()),
+                    static_cast<unsigned int>(simplified.size()), error});
+    indices.insert(indices.end(), simplified.begin(), simplified.end());
+    source = std::move(simplified);
+  }
+  return lods;
+}
+
+bool MeshManager::LoadAsset(const std::string &path, MeshAsset &asset) {
+  PROFILE_SCOPE("LoadMeshAsset");
+  const uint64_t settingsHash = GetSettingsHash();
+  if (mCache.IsEnabled() && mCache.Load(path, settingsHash, asset))
+    return true;
+
+  MappedFile source(path);
+  if (!source.IsOpen()) {
+    std::cerr << "Failed to open OBJ file: " << path << std::endl;
+    return false;
+  }
+
+  ObjParser::Parse(source.Data(), source.Size(), asset.vertices,
+                   asset.indices);
+  OptimizeMesh(path, asset.vertices, asset.indices);
+  asset.lods = BuildLods(asset.vertices, asset.indices);
+  asset.layout = mVertexLayout;
+  asset.encoded = Mesh::Encode(asset.vertices, asset.indices, asset.layout);
+  asset.payload = asset.encoded.View();
+
+  if (mCache.IsEnabled())
+    mCache.Store(path, settingsHash,
+                 HashBytes(source.Data(), source.Size()), asset);
+  return true;
+}
+
+uint64_t MeshManager::GetSettingsHash() const {
+  // every setting that changes what LoadAsset produces
+  std::vector<float> values(mLodSettings.ratios.begin(),
+                            mLodSettings.ratios.end());
+  values.push_back(mLodSettings.maxError);
+  values.push_back(float(mLodSettings.minTriangles));
+  values.push_back(mOptimizeSettings.vertexCache);
+  values.push_back(mOptimizeSettings.overdraw);
+  values.push_back(mOptimizeSettings.overdrawThreshold);
+  values.push_back(mOptimizeSettings.vertexFetch);
+  values.push_back(float(mVertexLayout.position));
+  values.push_back(float(mVertexLayout.normal));
+  values.push_back(float(mVertexLayout.texCoord));
+  return HashBytes(values.data(), values.size() * sizeof(float));
 }
 
 void MeshManager::Clear() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  ++mGeneration;
+  mCompleted.clear();
+  mPending.clear();
+  mStreaming.clear();
   mPathToId.clear();
-  mIdToPath.clear();
-  mIdToMesh.clear();
-  mNextId = 0;
+  // every id goes stale
+  mSlots.Clear();
+  mRecords.clear();
+  mPool.TakeAll();
 }
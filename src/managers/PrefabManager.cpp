@@ -0,0 +1,93 @@
+#include "managers/PrefabManager.h"
+#include "components/PrefabComponent.h"
+#include "managers/ResourceContext.h"
+#include "managers/SerializationRegistry.h"
+#include <fstream>
+#include <iostream>
+#include <typeindex>
+#include <utility>
+
+PrefabManager::PrefabManager(const SerializationRegistry &registry,
+                             ResourceContext &resources)
+    : mRegistry(registry), mResources(resources) {
+  mPrototypes.Init();
+  for (const RegisteredComponent &component : registry.All())
+    component.register_type(mPrototypes);
+  // prototypes keep their resources alive until Clear
+  registry.TrackReferences(mPrototypes, resources);
+}
+
+PrefabId PrefabManager::Load(const std::string &path) {
+  auto it = mPathToId.find(path);
+  if (it != mPathToId.end())
+    return it->second;
+
+  std::ifstream file(path, std::ios::binary);
+  Json prefab = Json::parse(file, nullptr, false);
+  auto components = prefab.is_object() ? prefab.find("components")
+                                       : prefab.end();
+  if (prefab.is_discarded() || components == prefab.end() ||
+      !components->is_object()) {
+    std::cerr << "[PrefabManager] Failed to load " << path << std::endl;
+    mPathToId.emplace(path, INVALID_PREFAB);
+    return INVALID_PREFAB;
+  }
+
+  Prefab loaded{path, mPrototypes.CreateEntity(), {}, {}};
+  loaded.data.resize(mRegistry.All().size());
+  for (auto &kv : components->items()) {
+    const RegisteredComponent *component = mRegistry.FindByName(kv.key());
+    // prefabs don't nest
+    if (!component ||
+        component->type == std::type_index(typeid(PrefabComponent))) {
+      std::cerr << "[PrefabManager] " << path << ": can't use component "
+                << kv.key() << ", skipped" << std::endl;
+      continue;
+    }
+    const ComponentSerializer &serializer = component->serializer;
+    serializer.deserialize(loaded.prototype, kv.value(), mPrototypes,
+                           mResources);
+    size_t index = mRegistry.IndexOf(*component);
+    loaded.components.push_back(index);
+    loaded.data[index] =
+        serializer.serialize(loaded.prototype, mPrototypes, mResources);
+  }
+
+  PrefabId id = static_cast<PrefabId>(mPrefabs.size());
+  mPrefabs.push_back(std::move(loaded));
+  mPathToId.emplace(path, id);
+  return id;
+}
+
+void PrefabManager::Instantiate(PrefabId id, const Entity *entities,
+                                size_t count, Coordinator &coordinator) {
+  if (id >= mPrefabs.size())
+    return;
+  const Prefab &prefab = mPrefabs[id];
+  const std::vector<RegisteredComponent> &components = mRegistry.All();
+  for (size_t index : prefab.components) {
+    coordinator.ReserveComponents(components[index].type, count);
+    components[index].copy(mPrototypes, prefab.prototype, coordinator,
+                           entities, count);
+  }
+  coordinator.ReserveComponents(typeid(PrefabComponent), count);
+  coordinator.AddComponentCopies(entities, count, PrefabComponent{id});
+}
+
+const Json *PrefabManager::GetComponentData(PrefabId id, size_t index) const {
+  if (id >= mPrefabs.size() || index >= mPrefabs[id].data.size() ||
+      mPrefabs[id].data[index].is_null())
+    return nullptr;
+  return &mPrefabs[id].data[index];
+}
+
+const std::string &PrefabManager::GetPath(PrefabId id) const {
+  static const std::string NONE;
+  return id < mPrefabs.size() ? mPrefabs[id].path : NONE;
+}
+
+void PrefabManager::Clear() {
+  mPrototypes.DestroyAllEntities();
+  mPrefabs.clear();
+  mPathToId.clear();
+}
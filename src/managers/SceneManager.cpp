@@ -1,92 +1,611 @@
 #include "managers/SceneManager.h"
+#include "components/PrefabComponent.h"
+#include "core/MemoryTracker.h"
+#include "core/Profiler.h"
 #include "ecs/Types.h"
+#include "io/JsonSceneStream.h"
+#include "managers/PrefabManager.h"
 #include "managers/ResourceContext.h"
 #include "managers/SerializationRegistry.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 SceneManager::SceneManager(Coordinator &coord, SerializationRegistry &reg,
                            ResourceContext &resources)
     : mCoordinator(coord), mRegistry(reg), mResourceContext(resources) {}
 
+Json SceneManager::SerializeEntity(Entity entity) {
+  // an instance is written as its prefab plus the fields that differ
+  const PrefabManager *prefabs = mResourceContext.prefabs;
+  PrefabId prefab = INVALID_PREFAB;
+  if (prefabs && mCoordinator.HasComponent<PrefabComponent>(entity))
+    prefab = mCoordinator.GetComponent<PrefabComponent>(entity).mId;
+  if (prefab != INVALID_PREFAB && prefabs->GetPath(prefab).empty())
+    prefab = INVALID_PREFAB;
+
+  Json components = Json::object();
+  for (const RegisteredComponent &component : mRegistry.All()) {
+    if (component.type == std::type_index(typeid(PrefabComponent)) ||
+        !mCoordinator.HasComponent(component.type, entity))
+      continue;
+    Json data = component.serializer.serialize(entity, mCoordinator,
+                                               mResourceContext);
+    size_t index = mRegistry.IndexOf(component);
+    const Json *base = prefab == INVALID_PREFAB
+                           ? nullptr
+                           : prefabs->GetComponentData(prefab, index);
+    if (base && data.is_object()) {
+      Json changed = Json::object();
+      for (auto &kv : data.items()) {
+        auto field = base->find(kv.key());
+        if (field == base->end() || *field != kv.value())
+          changed[kv.key()] = std::move(kv.value());
+      }
+      if (changed.empty())
+        continue;
+      data = std::move(changed);
+    }
+    components[component.name] = std::move(data);
+  }
+
+  Json entry = {{"id", entity}};
+  if (prefab != INVALID_PREFAB)
+    entry["prefab"] = prefabs->GetPath(prefab);
+  entry["components"] = std::move(components);
+  return entry;
+}
+
 Json SceneManager::SerializeScene() {
-  Json scene;
-  Json entities_json = Json::array();
+  Json entities = Json::array();
+  for (Entity e : mCoordinator.GetAllEntities())
+    entities.push_back(SerializeEntity(e));
+  return {{"entities", std::move(entities)}};
+}
+
+void SceneManager::DeserializeScene(const Json &scene) {
+  const Json &entities = scene["entities"];
+  std::vector<const Json *> records;
+  records.reserve(entities.size());
+  for (const Json &ent : entities)
+    records.push_back(&ent);
+
+  std::unordered_set<std::string> unknown;
+  CoordinatorBatch batch(mCoordinator);
+  DeserializeEntities(records, unknown);
+}
 
-  auto allTypes = mRegistry.AllTypes();
+void SceneManager::DeserializeEntities(
+    const std::vector<const Json *> &entities,
+    std::unordered_set<std::string> &unknown) {
+  const std::vector<RegisteredComponent> &components = mRegistry.All();
+  PrefabManager *prefabs = mResourceContext.prefabs;
+  std::vector<Entity> ids;
+  ids.reserve(entities.size());
+  // records of components the entities get from the file, and overrides of
+  // ones they get from their prefab, merged into the prefab's value
+  std::vector<std::vector<ComponentRecord>> records(components.size());
+  std::vector<std::vector<ComponentRecord>> overrides(components.size());
+  std::deque<Json> merged;
+  std::map<PrefabId, std::vector<Entity>> instances;
 
-  for (Entity e : mCoordinator.GetAllEntities()) {
-    Json entity_json;
-    entity_json["id"] = e;
-    Json comps = Json::object();
+  // resolve every name once, grouping the records by component type
+  for (const Json *ent : entities) {
+    Entity e = (*ent)["id"].get<Entity>();
+    ids.push_back(e);
 
-    for (auto type : allTypes) {
-      const ComponentSerializer *ser = mRegistry.Find(type);
-      if (!ser)
+    PrefabId prefab = INVALID_PREFAB;
+    auto link = ent->find("prefab");
+    if (link != ent->end() && link->is_string()) {
+      const std::string &path = link->get_ref<const std::string &>();
+      if (prefabs)
+        prefab = prefabs->Load(path);
+      if (prefab == INVALID_PREFAB) {
+        // the overrides alone are partial components
+        if (unknown.insert(path).second)
+          std::cerr << "[SceneManager] No prefab " << path
+                    << ", its instances are left empty" << std::endl;
         continue;
+      }
+      instances[prefab].push_back(e);
+    }
 
-      if (mCoordinator.HasComponent(type, e)) {
-        Json data = ser->serialize(e, mCoordinator, mResourceContext);
-        comps[type.name()] = data;
+    for (auto &kv : (*ent)["components"].items()) {
+      const RegisteredComponent *component = mRegistry.FindByName(kv.key());
+      if (!component) {
+        if (unknown.insert(kv.key()).second)
+          std::cerr << "[SceneManager] Unknown component " << kv.key()
+                    << ", skipped" << std::endl;
+        continue;
+      }
+      size_t t = mRegistry.IndexOf(*component);
+      const Json *base = prefab == INVALID_PREFAB
+                             ? nullptr
+                             : prefabs->GetComponentData(prefab, t);
+      if (base && !kv.value().is_object()) {
+        // the instance already has the prefab's copy, there is nothing to
+        // merge a non-object into
+        if (unknown.insert(kv.key() + " override").second)
+          std::cerr << "[SceneManager] Override of " << kv.key()
+                    << " isn't an object, the prefab's is kept" << std::endl;
+      } else if (base) {
+        merged.push_back(*base);
+        merged.back().update(kv.value());
+        overrides[t].push_back({e, &merged.back()});
+      } else {
+        records[t].push_back({e, &kv.value()});
       }
     }
+  }
+  mCoordinator.CreateEntities(ids);
+
+  // instances start as copies of their prefab, without any JSON
+  for (const auto &[prefab, owners] : instances)
+    prefabs->Instantiate(prefab, owners.data(), owners.size(), mCoordinator);
+
+  // 1. every distinct resource is requested before any record is converted,
+  // so the workers load them meanwhile
+  for (size_t t = 0; t < components.size(); ++t) {
+    if (!components[t].serializer.request_resources)
+      continue;
+    for (const auto *list : {&records[t], &overrides[t]})
+      if (!list->empty())
+        components[t].serializer.request_resources(*list, mResourceContext);
+  }
+
+  // 2. pools sized up front; records of concurrent types are converted in
+  // place on all threads, in blocks so small types don't get a thread each.
+  // Overrides are converted into the components the prefab gave.
+  constexpr size_t BLOCK = 1024;
+  struct Block {
+    const std::vector<ComponentRecord> *records;
+    size_t type;
+    size_t begin;
+  };
+  std::vector<Block> blocks;
+  std::vector<Entity> owners;
+  for (size_t t = 0; t < components.size(); ++t) {
+    if (!records[t].empty())
+      mCoordinator.ReserveComponents(components[t].type, records[t].size());
+    if (!components[t].serializer.concurrent)
+      continue;
+    for (size_t begin = 0; begin < overrides[t].size(); begin += BLOCK)
+      blocks.push_back({&overrides[t], t, begin});
+    if (records[t].empty())
+      continue;
+    owners.clear();
+    for (const ComponentRecord &record : records[t])
+      owners.push_back(record.entity);
+    mCoordinator.AddDefaultComponents(components[t].type, owners.data(),
+                                      owners.size());
+    for (size_t begin = 0; begin < records[t].size(); begin += BLOCK)
+      blocks.push_back({&records[t], t, begin});
+  }
+
+  auto convert = [&](size_t i) {
+    const Block &block = blocks[i];
+    const ComponentSerializer &serializer =
+        components[block.type].serializer;
+    size_t end = std::min(block.records->size(), block.begin + BLOCK);
+    for (size_t r = block.begin; r < end; ++r)
+      serializer.deserialize((*block.records)[r].entity,
+                             *(*block.records)[r].data, mCoordinator,
+                             mResourceContext);
+  };
+  if (mWorkers) {
+    mWorkers->ParallelFor(blocks.size(), convert);
+  } else {
+    for (size_t i = 0; i < blocks.size(); ++i)
+      convert(i);
+  }
 
-    entity_json["components"] = comps;
-    entities_json.push_back(entity_json);
+  // the rest may add components themselves, one at a time
+  for (size_t t = 0; t < components.size(); ++t) {
+    if (components[t].serializer.concurrent)
+      continue;
+    for (const auto *list : {&records[t], &overrides[t]})
+      for (const ComponentRecord &record : *list)
+        components[t].serializer.deserialize(record.entity, *record.data,
+                                             mCoordinator, mResourceContext);
   }
+  // 3. is the caller's CommitBatch
+}
 
-  scene["entities"] = entities_json;
-  return scene;
+bool SceneManager::IsBinaryScenePath(const std::string &path) {
+  return std::filesystem::path(path).extension() == BINARY_EXTENSION;
 }
 
-void SceneManager::DeserializeScene(const Json &scene) {
-  for (auto &ent : scene["entities"]) {
-    Entity e = mCoordinator.CreateEntity(ent["id"]);
+std::string SceneManager::GetDeltaLogPath(const std::string &path) {
+  return path + ".delta";
+}
 
-    for (auto &kv : ent["components"].items()) {
-      std::string type_name = kv.key();
-      const Json &data = kv.value();
+bool SceneManager::LoadScene(const std::string &path) {
+  PROFILE_SCOPE("LoadScene");
+  mResourceContext.shaders->ResetStats();
+  bool intoEmptyWorld = mCoordinator.GetAllEntities().empty();
+  bool loaded = IsBinaryScenePath(path) ? LoadBinaryScene(path)
+                                        : LoadJsonScene(path);
+  if (!loaded)
+    return false;
 
-      // std::cout << kv.key() << std::endl;
-      // std::cout << kv.value() << std::endl;
+  // a stale log must not be appended to, the next delta save starts over
+  if (ApplyDeltaLog(path) && intoEmptyWorld)
+    SetDeltaBase(path);
+  else
+    mDeltaBase.clear();
+  LogLoaded(path);
+  return true;
+}
 
-      for (auto type : mRegistry.AllTypes()) {
-        if (type.name() == type_name) {
-          const ComponentSerializer *ser = mRegistry.Find(type);
-          ser->deserialize(e, data, mCoordinator, mResourceContext);
-        }
-      }
+bool SceneManager::ApplyDeltaLog(const std::string &path) {
+  std::string logPath = GetDeltaLogPath(path);
+  size_t validSize = 0;
+  bool torn = false;
+  bool ok = true;
+  {
+    SceneDeltaReader log;
+    if (!log.Open(logPath))
+      return !std::filesystem::exists(logPath);
+    SceneFileStamp stamp;
+    if (!ReadSceneFileStamp(path, stamp) || !(stamp == log.GetBase())) {
+      std::cerr << "[SceneManager] " << logPath
+                << " was written for an older " << path << ", ignored"
+                << std::endl;
+      return false;
+    }
+
+    // an entity in a record is replaced as a whole, the components it lost
+    // aren't listed
+    std::vector<Entity> destroyed;
+    BinarySceneReader scene;
+    size_t applied = 0;
+    while (log.Next(destroyed, scene)) {
+      for (Entity e : destroyed)
+        mCoordinator.DestroyEntity(e);
+      for (Entity e : scene.GetEntities())
+        mCoordinator.DestroyEntity(e);
+      if (!LoadBinaryColumns(scene))
+        ok = false;
+      ++applied;
     }
+    if (applied > 0)
+      std::cout << "[SceneManager] Applied " << applied << " deltas from "
+                << logPath << std::endl;
+    torn = log.IsTorn();
+    validSize = log.GetValidSize();
+  }
+
+  if (torn) {
+    // left by an interrupted save; cut so later records aren't appended
+    // behind it
+    std::cerr << "[SceneManager] Dropped a torn record at the end of "
+              << logPath << std::endl;
+    std::error_code error;
+    std::filesystem::resize_file(logPath, validSize, error);
+  }
+  return ok;
+}
+
+void SceneManager::SetDeltaBase(const std::string &path) {
+  if (!ReadSceneFileStamp(path, mDeltaBaseStamp)) {
+    mDeltaBase.clear();
+    return;
   }
+  mDeltaBase = path;
+  mCoordinator.ClearChanges();
 }
 
-void SceneManager::LoadScene(const std::string &path) {
-  std::ifstream file(path);
+bool SceneManager::LoadJsonScene(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
   if (!file.is_open()) {
     std::cerr << "Failed to open scene file: " << path << std::endl;
-    return;
+    return false;
   }
 
-  Json sceneJson;
+  // entities are deserialized STREAM_BLOCK at a time, which bounds memory
+  // and still gives the parallel conversion enough to work with. Only the
+  // block itself is tracked, not what the values allocate.
+  constexpr size_t STREAM_BLOCK = 16384;
+  std::vector<Json, TrackingAllocator<Json, MemoryCategory::JsonParse>> block;
+  std::vector<const Json *> pointers;
+  std::unordered_set<std::string> unknown;
+  auto flush = [&] {
+    pointers.clear();
+    for (const Json &ent : block)
+      pointers.push_back(&ent);
+    DeserializeEntities(pointers, unknown);
+    block.clear();
+  };
+  auto onEntity = [&](Json &ent) {
+    block.push_back(std::move(ent));
+    if (block.size() == STREAM_BLOCK)
+      flush();
+  };
+
+  // entities become visible to the systems once the file is read
+  std::string error;
+  bool ok;
   try {
-    file >> sceneJson;
+    CoordinatorBatch batch(mCoordinator);
+    ok = ReadJsonSceneEntities(file, onEntity, error);
+    flush();
   } catch (const std::exception &e) {
-    std::cerr << "Failed to parse JSON: " << e.what() << std::endl;
-    return;
+    // a component the serializer couldn't read, what came before it stays
+    ok = false;
+    error = e.what();
   }
+  if (!ok)
+    std::cerr << "Failed to parse JSON: " << error << std::endl;
+  return ok;
+}
 
-  DeserializeScene(sceneJson);
+void SceneManager::LogLoaded(const std::string &path) {
   std::cout << "Scene loaded: " << path << std::endl;
+
+  // async programs are reported by the ShaderManager once they are built
+  if (mResourceContext.shaders->GetPendingCount() == 0)
+    mResourceContext.shaders->LogStats();
+
+  MeshMemoryStats memory = mResourceContext.meshes->GetMemoryStats();
+  std::cout << "[SceneManager] " << memory.meshes << " meshes, "
+            << memory.gpuBytes / 1024 << " KB on the GPU (float layout "
+            << memory.fullPrecisionBytes / 1024 << " KB), "
+            << memory.cpuBytes / 1024 << " KB on the CPU";
+  size_t pending = mResourceContext.meshes->GetPendingCount();
+  if (pending > 0)
+    std::cout << ", " << pending << " still loading";
+  std::cout << std::endl;
+}
+
+bool SceneManager::SaveScene(const std::string &path) {
+  bool saved = IsBinaryScenePath(path) ? SaveBinaryScene(path)
+                                       : SaveJsonScene(path);
+  if (!saved)
+    return false;
+
+  // the log described the snapshot that was just replaced
+  std::error_code error;
+  std::filesystem::remove(GetDeltaLogPath(path), error);
+  SetDeltaBase(path);
+  std::cout << "Scene saved: " << path << std::endl;
+  return true;
 }
 
-void SceneManager::SaveScene(const std::string& path) {
-  Json data = SerializeScene();
+bool SceneManager::SaveSceneDelta(const std::string &path) {
+  SceneFileStamp stamp;
+  if (path != mDeltaBase || !ReadSceneFileStamp(path, stamp) ||
+      !(stamp == mDeltaBaseStamp))
+    return SaveScene(path);
+
+  std::vector<Entity> changed = mCoordinator.GetChangedEntities();
+  if (changed.empty())
+    return true;
+  std::sort(changed.begin(), changed.end());
+  std::vector<Entity> alive;
+  std::vector<Entity> destroyed;
+  for (Entity e : changed)
+    (mCoordinator.IsAlive(e) ? alive : destroyed).push_back(e);
+
+  SceneStringTable strings;
+  std::vector<BinarySceneColumn> columns;
+  BuildBinaryColumns(&alive, strings, columns);
+  if (!AppendSceneDelta(GetDeltaLogPath(path), stamp, destroyed,
+                        strings.GetStrings(), alive, columns))
+    return false;
 
-  std::ofstream file(path);
+  mCoordinator.ClearChanges();
+  std::cout << "Scene delta saved: " << path << " (" << alive.size()
+            << " changed, " << destroyed.size() << " destroyed)"
+            << std::endl;
+  return true;
+}
+
+bool SceneManager::SaveJsonScene(const std::string &path) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
   if (!file.is_open()) {
     std::cerr << "Failed to create scene file: " << path << std::endl;
-    return;
+    return false;
   }
-  file << data;
-  std::cout << "Scene saved: " << path << std::endl;
+
+  JsonSceneWriter writer(file);
+  for (Entity e : mCoordinator.GetAllEntities())
+    writer.WriteEntity(SerializeEntity(e));
+  writer.Finish();
+  if (!file) {
+    std::cerr << "Failed to write scene file: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool SceneManager::ConvertScene(const std::string &from,
+                                const std::string &to) {
+  mCoordinator.DestroyAllEntities();
+  return LoadScene(from) && SaveScene(to);
+}
+
+void SceneManager::BuildBinaryColumns(const std::vector<Entity> *only,
+                                      SceneStringTable &strings,
+                                      std::vector<BinarySceneColumn> &columns) {
+  const std::vector<Entity> &candidates =
+      only ? *only : mCoordinator.GetAllEntities();
+  std::vector<Entity> owners;
+
+  for (const RegisteredComponent &component : mRegistry.All()) {
+    const ComponentSerializer &serializer = component.serializer;
+    BinarySceneColumn column{strings.Intern(component.name),
+                             static_cast<std::uint32_t>(
+                                 serializer.schema_version),
+                             0,
+                             {},
+                             {}};
+
+    if (serializer.binary.write && serializer.binary.read) {
+      column.recordSize = serializer.binary.record_size;
+      if (only) {
+        owners.clear();
+        for (Entity e : *only)
+          if (mCoordinator.HasComponent(component.type, e))
+            owners.push_back(e);
+      }
+      serializer.binary.write(mCoordinator, mResourceContext, strings,
+                              only ? &owners : nullptr, column.entities,
+                              column.records);
+    } else {
+      for (Entity e : candidates) {
+        if (!mCoordinator.HasComponent(component.type, e))
+          continue;
+        std::uint32_t document = strings.Intern(
+            serializer.serialize(e, mCoordinator, mResourceContext).dump());
+        column.entities.push_back(e);
+        const char *bytes = reinterpret_cast<const char *>(&document);
+        column.records.insert(column.records.end(), bytes,
+                              bytes + sizeof(document));
+      }
+    }
+
+    if (!column.entities.empty())
+      columns.push_back(std::move(column));
+  }
+}
+
+bool SceneManager::SaveBinaryScene(const std::string &path) {
+  SceneStringTable strings;
+  std::vector<BinarySceneColumn> columns;
+  BuildBinaryColumns(nullptr, strings, columns);
+  return WriteBinaryScene(path, strings.GetStrings(),
+                          mCoordinator.GetAllEntities(), columns);
+}
+
+bool SceneManager::LoadBinaryScene(const std::string &path) {
+  BinarySceneReader reader;
+  if (!reader.Open(path))
+    return false;
+  return LoadBinaryColumns(reader);
+}
+
+bool SceneManager::SaveEntities(const std::string &path,
+                                const std::vector<Entity> &entities) {
+  SceneStringTable strings;
+  std::vector<BinarySceneColumn> columns;
+  BuildBinaryColumns(&entities, strings, columns);
+  return WriteBinaryScene(path, strings.GetStrings(), entities, columns);
+}
+
+bool SceneManager::LoadEntities(const BinarySceneReader &reader,
+                                std::vector<Entity> &created) {
+  return LoadBinaryColumns(reader, &created);
+}
+
+bool SceneManager::LoadBinaryColumns(const BinarySceneReader &reader,
+                                     std::vector<Entity> *created) {
+  const std::vector<std::string> &strings = reader.GetStrings();
+
+  std::vector<const RegisteredComponent *> components;
+  for (const BinarySceneReader::Column &column : reader.GetColumns()) {
+    const RegisteredComponent *component =
+        mRegistry.FindByName(strings[column.name]);
+    if (!component)
+      std::cerr << "[SceneManager] Unknown component " << strings[column.name]
+                << ", skipped" << std::endl;
+    components.push_back(component);
+  }
+
+  // file id -> id in the world, when the file's ids may be taken
+  std::unordered_map<Entity, Entity> ids;
+  if (created) {
+    ids.reserve(reader.GetEntities().size());
+    for (Entity e : reader.GetEntities()) {
+      Entity entity = mCoordinator.CreateEntity();
+      ids.emplace(e, entity);
+      created->push_back(entity);
+    }
+  } else {
+    mCoordinator.CreateEntities(reader.GetEntities());
+  }
+  for (size_t i = 0; i < components.size(); ++i)
+    if (components[i])
+      mCoordinator.ReserveComponents(components[i]->type,
+                                     reader.GetColumns()[i].count);
+
+  std::vector<Entity> entities;
+  std::vector<char> migrated;
+  bool ok = true;
+  CoordinatorBatch batch(mCoordinator);
+  for (size_t i = 0; i < components.size(); ++i) {
+    const BinarySceneReader::Column &column = reader.GetColumns()[i];
+    const RegisteredComponent *component = components[i];
+    if (!component)
+      continue;
+    const ComponentSerializer &serializer = component->serializer;
+
+    entities.resize(column.count);
+    std::memcpy(entities.data(), column.entities,
+                column.count * sizeof(Entity));
+    // the reader checked every id is in the entity list
+    if (created)
+      for (Entity &e : entities)
+        e = ids.at(e);
+
+    if (column.recordSize == 0) {
+      for (std::uint32_t c = 0; c < column.count; ++c) {
+        std::uint32_t document;
+        std::memcpy(&document, column.records + c * sizeof(document),
+                    sizeof(document));
+        Json data = document < strings.size()
+                        ? Json::parse(strings[document], nullptr, false)
+                        : Json(Json::value_t::discarded);
+        if (data.is_discarded())
+          continue;
+        try {
+          serializer.deserialize(entities[c], data, mCoordinator,
+                                 mResourceContext);
+        } catch (const std::exception &e) {
+          // a document of the wrong shape, the rest still load
+          std::cerr << "[SceneManager] Failed to read " << component->name
+                    << ": " << e.what() << std::endl;
+          ok = false;
+        }
+      }
+      continue;
+    }
+
+    if (!serializer.binary.read) {
+      std::cerr << "[SceneManager] " << component->name
+                << " has no binary layout anymore, skipped" << std::endl;
+      continue;
+    }
+
+    const char *records = column.records;
+    if (column.schemaVersion !=
+            static_cast<std::uint32_t>(serializer.schema_version) ||
+        column.recordSize != serializer.binary.record_size) {
+      migrated.clear();
+      if (!serializer.binary.migrate ||
+          !serializer.binary.migrate(static_cast<int>(column.schemaVersion),
+                                     column.recordSize, column.records,
+                                     column.count, migrated) ||
+          migrated.size() != size_t(column.count) *
+                                 serializer.binary.record_size) {
+        std::cerr << "[SceneManager] Can't migrate " << component->name
+                  << " from schema " << column.schemaVersion << " ("
+                  << column.recordSize << " byte records), skipped"
+                  << std::endl;
+        continue;
+      }
+      records = migrated.data();
+    }
+    serializer.binary.read(entities.data(), records, column.count,
+                           mCoordinator, mResourceContext, strings);
+  }
+  return ok;
 }
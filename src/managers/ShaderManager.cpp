@@ -1,19 +1,470 @@
 #include "managers/ShaderManager.h"
 #include "App.h"
+#include "core/Hash.h"
+#include "core/MemoryTracker.h"
+#include "core/Profiler.h"
+#include "core/ThreadPool.h"
 #include "glm/detail/qualifier.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "render/Mesh.h"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <utility>
 
+namespace {
+
+// What a program is charged in the pool when the driver can't report its
+// binary size
+constexpr size_t UNKNOWN_PROGRAM_BYTES = 64 * 1024;
+
+// Flat grey stand-in for programs that are loading or failed to build.
+// Same position math as default.vert so it passes the depth pre-pass.
+const char *PLACEHOLDER_VERT = R"(#version 420 core
+layout (location = 0) in vec3 aPos;
+
+layout(std140, binding = 0) uniform CameraUBO {
+  mat4 view;
+  mat4 projection;
+  vec3 cameraPos;
+} camera;
+
+uniform mat4 uModel;
+
+invariant gl_Position;
+
+void main() {
+  vec4 worldPos = uModel * vec4(aPos, 1.0);
+  gl_Position = camera.projection * camera.view * worldPos;
+}
+)";
+
+const char *PLACEHOLDER_FRAG = R"(#version 420 core
+out vec4 FragColor;
+
+void main() { FragColor = vec4(0.5, 0.5, 0.5, 1.0); }
+)";
+
+std::uint64_t HashDefines(const ShaderDefines &defines) {
+  std::string text;
+  for (const auto &[name, value] : defines)
+    text += name + "=" + value + "\n";
+  return HashString(text);
+}
+
+// Inserts the defines after the #version line, #line keeps compiler
+// messages pointing at the lines of the file
+std::string ApplyDefines(const std::string &source,
+                         const ShaderDefines &defines) {
+  if (defines.empty())
+    return source;
+
+  std::string block;
+  for (const auto &[name, value] : defines)
+    block += "#define " + name + " " + value + "\n";
+
+  size_t version = source.find("#version");
+  if (version == std::string::npos)
+    return block + "#line 1\n" + source;
+  size_t lineEnd = source.find('\n', version);
+  if (lineEnd == std::string::npos)
+    return source + "\n" + block;
+
+  size_t line = std::count(source.begin(), source.begin() + lineEnd, '\n') + 2;
+  return source.substr(0, lineEnd + 1) + block + "#line " +
+         std::to_string(line) + "\n" + source.substr(lineEnd + 1);
+}
+
+} // namespace
+
 ShaderId ShaderManager::LoadShader(const std::string &frag,
-                                   const std::string &vert) {
-  std::string fragStr = GetFileContext(frag);
-  std::string vertStr = GetFileContext(vert);
+                                   const std::string &vert,
+                                   const ShaderDefines &defines) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  ++mStats.requests;
+  ShaderId id;
+  auto it = mKeyToId.find({frag, vert, defines});
+  if (it != mKeyToId.end()) {
+    id = it->second;
+    Shader &shader = *FindShader(id);
+    Reference(id, shader, 1);
+    ++mStats.shared;
+    if (!shader.pending)
+      return id;
+    // an async request is in flight, its sources are ignored once they
+    // arrive
+  } else {
+    id = NewId(frag, vert, defines, 1);
+    if (id == 0)
+      return 0;
+  }
+  lock.unlock();
+
+  if (AttachProgram(id, GetFileContext(frag), GetFileContext(vert)))
+    return id;
+
+  ReleaseShader(id);
+  return 0;
+}
+
+ShaderId ShaderManager::LoadShaderAsync(const std::string &frag,
+                                        const std::string &vert,
+                                        const ShaderDefines &defines) {
+  return RequestAsync(frag, vert, defines, 1);
+}
+
+ShaderId ShaderManager::PrefetchShader(const std::string &frag,
+                                       const std::string &vert,
+                                       const ShaderDefines &defines) {
+  return RequestAsync(frag, vert, defines, 0);
+}
+
+ShaderId ShaderManager::RequestAsync(const std::string &frag,
+                                     const std::string &vert,
+                                     const ShaderDefines &defines,
+                                     unsigned int references) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto it = mKeyToId.find({frag, vert, defines});
+  if (references > 0) {
+    ++mStats.requests;
+    if (it != mKeyToId.end())
+      ++mStats.shared;
+  }
+  if (it != mKeyToId.end()) {
+    Reference(it->second, *FindShader(it->second), references);
+    return it->second;
+  }
+
+  ShaderId id = NewId(frag, vert, defines, references);
+  if (id == 0)
+    return 0;
+  const unsigned int generation = mGeneration;
+  lock.unlock();
+
+  auto job = [this, frag, vert, id, generation] {
+    PROFILE_SCOPE("ReadShaderSources");
+    LoadedSources loaded{id, generation, GetFileContext(frag),
+                         GetFileContext(vert)};
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (generation == mGeneration)
+      mLoaded.push_back(std::move(loaded));
+  };
+
+  if (mWorkers)
+    mWorkers->Submit(std::move(job));
+  else
+    job();
+  return id;
+}
+
+ShaderId ShaderManager::NewId(const std::string &frag,
+                               const std::string &vert,
+                               const ShaderDefines &defines,
+                               unsigned int references) {
+  ShaderId id = mSlots.Allocate();
+  if (id == 0) {
+    std::cerr << "[ShaderManager] Out of shader handles, " << frag
+              << " not loaded" << std::endl;
+    return 0;
+  }
+  size_t index = HandlePool<ShaderSlot>::Index(id);
+  if (index >= mShaders.size())
+    mShaders.resize(index + 1);
+  Shader &shader = mShaders[index];
+  shader = {};
+  shader.vert = vert;
+  shader.frag = frag;
+  shader.defines = defines;
+  shader.refs = references;
+  shader.pending = true;
+  mKeyToId[{frag, vert, defines}] = id;
+  mPool.CountMiss();
+  return id;
+}
+
+ShaderManager::Shader *ShaderManager::FindShader(ShaderId id) {
+  return const_cast<Shader *>(
+      static_cast<const ShaderManager &>(*this).FindShader(id));
+}
+
+const ShaderManager::Shader *ShaderManager::FindShader(ShaderId id) const {
+  if (!mSlots.Get(id))
+    return nullptr;
+  return &mShaders[HandlePool<ShaderSlot>::Index(id)];
+}
+
+void ShaderManager::RetainShader(ShaderId id, unsigned int count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (Shader *shader = FindShader(id))
+    Reference(id, *shader, count);
+}
+
+void ShaderManager::ReleaseShader(ShaderId id) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  Shader *shader = FindShader(id);
+  if (!shader || shader->refs == 0 || --shader->refs > 0)
+    return;
+  Unreferenced(id);
+}
+
+void ShaderManager::Reference(ShaderId id, Shader &shader,
+                              unsigned int references) {
+  if (references == 0)
+    return;
+  mPool.Take(id);
+  shader.refs += references;
+}
+
+void ShaderManager::Unreferenced(ShaderId id) {
+  Shader &shader = *FindShader(id);
+  // pooled by AttachProgram once it is done with it
+  if (shader.pending)
+    return;
+  if (shader.programKey != 0) {
+    mPool.Add(id, mPrograms[shader.programKey].bytes, 0);
+    return;
+  }
+  // failed to build, the next request tries again
+  mKeyToId.erase({shader.frag, shader.vert, shader.defines});
+  shader = {};
+  mSlots.Free(id);
+}
+
+void ShaderManager::EvictPooled() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  std::vector<ShaderId> evicted = mPool.Evict(mPoolSettings);
+  for (ShaderId id : evicted) {
+    Shader &shader = *FindShader(id);
+    mKeyToId.erase({shader.frag, shader.vert, shader.defines});
+    ReleaseProgram(shader.programKey);
+    shader = {};
+    mSlots.Free(id);
+  }
+  ResourcePoolStats stats = mPool.GetStats();
+  lock.unlock();
+
+  if (!evicted.empty())
+    std::cout << "[ShaderManager] Evicted " << evicted.size()
+              << " unused shaders, " << stats.pooled << " left in the pool ("
+              << stats.gpuBytes / 1024 << " KB)" << std::endl;
+}
+
+void ShaderManager::ReleaseProgram(std::uint64_t programKey) {
+  auto it = mPrograms.find(programKey);
+  if (it == mPrograms.end() || --it->second.refs > 0)
+    return;
+  DeleteProgram(it->second.program);
+  MemoryTracker::Freed(MemoryCategory::ShaderPrograms, it->second.bytes);
+  mPrograms.erase(it);
+}
+
+void ShaderManager::DeleteProgram(GLuint program) {
+  auto reflection = mReflections.find(program);
+  if (reflection != mReflections.end()) {
+    if (mBoundReflection == &reflection->second) {
+      mBoundId = 0;
+      mBoundReflection = nullptr;
+    }
+    mReflections.erase(reflection);
+  }
+  glDeleteProgram(program);
+}
+
+bool ShaderManager::AttachProgram(ShaderId id, const std::string &fragSource,
+                                  const std::string &vertSource) {
+  PROFILE_SCOPE("AttachProgram");
+  std::string frag, vert;
+  ShaderDefines defines;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    const Shader *shader = FindShader(id);
+    if (!shader)
+      return false;
+    frag = shader->frag;
+    vert = shader->vert;
+    defines = shader->defines;
+  }
+
+  // identical sources under other paths end up on the same program
+  std::uint64_t key =
+      HashString(vertSource, HashString(fragSource, HashDefines(defines)));
+  key = key == 0 ? 1 : key;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto cached = mPrograms.find(key);
+  GLuint program = 0;
+  if (cached != mPrograms.end()) {
+    ++cached->second.refs;
+    ++mStats.shared;
+    program = cached->second.program;
+  } else {
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    program = mBinaryCache.Load(key);
+    const bool restored = program != 0;
+    if (restored) {
+      SetupProgram(program);
+    } else {
+      program = CompileProgram(fragSource, vertSource, frag, vert, defines);
+      if (program != 0)
+        mBinaryCache.Store(key, program);
+    }
+    size_t bytes = program != 0 ? mBinaryCache.GetProgramSize(program) : 0;
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    lock.lock();
+
+    if (restored) {
+      ++mStats.restored;
+      mStats.restoreMs += elapsed.count();
+    } else {
+      mStats.compileMs += elapsed.count();
+      ++(program != 0 ? mStats.compiled : mStats.failed);
+    }
+    if (program != 0) {
+      bytes = bytes != 0 ? bytes : UNKNOWN_PROGRAM_BYTES;
+      mPrograms[key] = {program, 1, bytes};
+      MemoryTracker::Allocated(MemoryCategory::ShaderPrograms, bytes);
+    }
+  }
+
+  Shader *shader = FindShader(id);
+  if (!shader)
+    return false;
+  shader->pending = false;
+  if (program != 0) {
+    shader->programKey = key;
+    ShaderSlot &slot = *mSlots.Get(id);
+    slot.program = program;
+    auto reflection = mReflections.find(program);
+    slot.reflection =
+        reflection != mReflections.end() ? &reflection->second : nullptr;
+  }
+  // released while it was being built
+  if (shader->refs == 0)
+    Unreferenced(id);
+  return program != 0;
+}
+
+size_t ShaderManager::ProcessUploads(double budgetMs) {
+  auto start = std::chrono::steady_clock::now();
+  size_t compiled = 0;
+  EvictPooled();
+
+  while (true) {
+    LoadedSources loaded;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mLoaded.empty())
+        break;
+      loaded = std::move(mLoaded.front());
+      mLoaded.pop_front();
+      const Shader *shader = FindShader(loaded.id);
+      if (loaded.generation != mGeneration || !shader || !shader->pending)
+        continue;
+    }
+
+    AttachProgram(loaded.id, loaded.fragSource, loaded.vertSource);
+    ++compiled;
+
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (elapsed.count() >= budgetMs)
+      break;
+  }
+
+  if (GetPendingCount() > 0) {
+    mCompiling = true;
+  } else if (mCompiling) {
+    mCompiling = false;
+    LogStats();
+  }
+  return compiled;
+}
+
+bool ShaderManager::IsReady(ShaderId id) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const ShaderSlot *slot = mSlots.Get(id);
+  return slot && slot->program != 0;
+}
+
+size_t ShaderManager::GetPendingCount() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  size_t pending = 0;
+  for (const Shader &shader : mShaders)
+    pending += shader.pending;
+  return pending;
+}
+
+size_t ShaderManager::GetProgramCount() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPrograms.size();
+}
+
+void ShaderManager::SetPoolSettings(const ResourcePoolSettings &settings) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mPoolSettings = settings;
+}
+
+ResourcePoolStats ShaderManager::GetPoolStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPool.GetStats();
+}
+
+ShaderStats ShaderManager::GetStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+void ShaderManager::ResetStats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mStats = {};
+  mPool.ResetCounters();
+}
+
+void ShaderManager::LogStats() const {
+  ShaderStats stats = GetStats();
+  std::cout << "[ShaderManager] " << GetProgramCount() << " programs for "
+            << stats.requests << " requests (" << stats.shared << " shared, "
+            << stats.compiled << " compiled in " << stats.compileMs << " ms";
+  if (stats.restored > 0)
+    std::cout << ", " << stats.restored << " restored from binaries in "
+              << stats.restoreMs << " ms";
+  if (stats.failed > 0)
+    std::cout << ", " << stats.failed << " failed";
+  std::cout << ")" << std::endl;
+}
+
+const ShaderManager::ShaderSlot &ShaderManager::Resolve(ShaderId id) {
+  static const ShaderSlot NONE;
+  const ShaderSlot *slot = mSlots.Get(id);
+  if (!slot)
+    return NONE;
+  if (slot->program != 0)
+    return *slot;
 
-  const char *fragContext = fragStr.c_str();
-  const char *vertContext = vertStr.c_str();
+  if (mPlaceholder == 0) {
+    mPlaceholder = CompileProgram(PLACEHOLDER_FRAG, PLACEHOLDER_VERT,
+                                  "<placeholder>", "<placeholder>");
+    auto reflection = mReflections.find(mPlaceholder);
+    mPlaceholderSlot = {mPlaceholder, reflection != mReflections.end()
+                                          ? &reflection->second
+                                          : nullptr};
+  }
+  return mPlaceholderSlot;
+}
+
+GLuint ShaderManager::CompileProgram(const std::string &fragStr,
+                                     const std::string &vertStr,
+                                     const std::string &frag,
+                                     const std::string &vert,
+                                     const ShaderDefines &defines) {
+  PROFILE_SCOPE("CompileProgram");
+  std::string fragDefined = ApplyDefines(fragStr, defines);
+  std::string vertDefined = ApplyDefines(vertStr, defines);
+  const char *fragContext = fragDefined.c_str();
+  const char *vertContext = vertDefined.c_str();
 
   GLuint fragShader, vertShader;
   fragShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -48,9 +499,10 @@ ShaderId ShaderManager::LoadShader(const std::string &frag,
     return 0;
   }
 
-  ShaderId program = glCreateProgram();
+  GLuint program = glCreateProgram();
   glAttachShader(program, fragShader);
   glAttachShader(program, vertShader);
+  mBinaryCache.PrepareLink(program);
   glLinkProgram(program);
 
   glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -65,44 +517,67 @@ ShaderId ShaderManager::LoadShader(const std::string &frag,
     return 0;
   }
 
-  GLuint blockIndex = glGetUniformBlockIndex(program, "CameraUBO");
-  if (blockIndex != GL_INVALID_INDEX) {
-    glUniformBlockBinding(program, blockIndex, 0);
-  }
+  SetupProgram(program);
 
   glDeleteShader(fragShader);
   glDeleteShader(vertShader);
 
-  mIds.push_back(program);
-  mIdToPath[program] = std::make_pair(vert, frag);
   return program;
 }
 
+void ShaderManager::SetupProgram(GLuint program) {
+  mReflections[program] = ShaderReflection(program, mBlockResolver);
+}
+
 std::pair<std::string, std::string> ShaderManager::GetPath(ShaderId id) {
-  return mIdToPath[id];
+  std::lock_guard<std::mutex> lock(mMutex);
+  const Shader *shader = FindShader(id);
+  if (!shader)
+    return {};
+  return {shader->vert, shader->frag};
+}
+
+ShaderDefines ShaderManager::GetDefines(ShaderId id) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const Shader *shader = FindShader(id);
+  if (!shader)
+    return {};
+  return shader->defines;
 }
 
-void ShaderManager::BindShader(ShaderId id) { glUseProgram(id); }
-void ShaderManager::UnbindShader() { glUseProgram(0); }
+void ShaderManager::BindShader(ShaderId id) {
+  const ShaderSlot &slot = Resolve(id);
+  glUseProgram(slot.program);
+  PROFILE_COUNT(ProgramBinds, 1);
+  mBoundId = id;
+  mBoundReflection = slot.reflection;
+}
 
-ShaderManager::~ShaderManager() { Clear(); }
+void ShaderManager::UnbindShader() {
+  glUseProgram(0);
+  mBoundId = 0;
+  mBoundReflection = nullptr;
+}
 
-GLint ShaderManager::GetUniformLocation(ShaderId id, const std::string &name) {
-  auto &progCache = mUniformLocationCache[id];
-  auto it = progCache.find(name);
-  if (it != progCache.end())
-    return it->second;
+ShaderManager::~ShaderManager() {
+  Clear();
+  if (mPlaceholder != 0)
+    DeleteProgram(mPlaceholder);
+}
 
-  GLint loc = glGetUniformLocation(id, name.c_str());
-  progCache.emplace(name, loc);
-  return loc;
+const ShaderReflection &ShaderManager::GetReflection(ShaderId id) {
+  static const ShaderReflection empty;
+  const ShaderReflection *reflection = Resolve(id).reflection;
+  return reflection ? *reflection : empty;
 }
 
-void ShaderManager::InvalidateUniformCache(ShaderId id) {
-  mUniformLocationCache.erase(id);
+GLint ShaderManager::GetUniformLocation(ShaderId id, UniformName name) {
+  if (id == mBoundId && mBoundReflection)
+    return mBoundReflection->GetLocation(name);
+  return GetReflection(id).GetLocation(name);
 }
 
-void ShaderManager::SetMat4(ShaderId id, const std::string &name,
+void ShaderManager::SetMat4(ShaderId id, UniformName name,
                             const glm::mat4 &matrix) {
   GLint loc = GetUniformLocation(id, name);
   if (loc == -1) {
@@ -111,7 +586,7 @@ void ShaderManager::SetMat4(ShaderId id, const std::string &name,
   glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
-void ShaderManager::SetVec3(ShaderId id, const std::string &name,
+void ShaderManager::SetVec3(ShaderId id, UniformName name,
                             const glm::vec3 &vec) {
   GLint loc = GetUniformLocation(id, name);
   if (loc == -1)
@@ -120,6 +595,14 @@ void ShaderManager::SetVec3(ShaderId id, const std::string &name,
   glUniform3fv(loc, 1, glm::value_ptr(vec));
 }
 
+void ShaderManager::SetInt(ShaderId id, UniformName name, GLint value) {
+  GLint loc = GetUniformLocation(id, name);
+  if (loc == -1)
+    return;
+
+  glUniform1i(loc, value);
+}
+
 std::string ShaderManager::GetFileContext(const std::string &path) {
   std::ifstream file(path);
   return std::string(std::istreambuf_iterator<char>(file),
@@ -127,12 +610,20 @@ std::string ShaderManager::GetFileContext(const std::string &path) {
 }
 
 void ShaderManager::Clear() {
-  for (auto id : mIds) {
-    if (id != 0) {
-      glDeleteProgram(id);
-    }
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (auto &[key, program] : mPrograms) {
+    DeleteProgram(program.program);
+    MemoryTracker::Freed(MemoryCategory::ShaderPrograms, program.bytes);
   }
-  mIds.clear();
-  mIdToPath.clear();
-  mUniformLocationCache.clear();
+  ++mGeneration;
+  // every id goes stale
+  mSlots.Clear();
+  mShaders.clear();
+  mKeyToId.clear();
+  mPrograms.clear();
+  mPool.TakeAll();
+  mLoaded.clear();
+  mCompiling = false;
+  mBoundId = 0;
+  mBoundReflection = nullptr;
 }
@@ -0,0 +1,324 @@
+#include "managers/WorldStreamer.h"
+#include "components/CameraComponent.h"
+#include "components/TransformComponent.h"
+#include "core/Profiler.h"
+#include "core/ThreadPool.h"
+#include "ecs/Coordinator.h"
+#include "io/BinaryScene.h"
+#include "managers/SceneManager.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <system_error>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char *MANIFEST = "world.json";
+constexpr int MANIFEST_VERSION = 1;
+
+std::uint64_t CellKey(int x, int z) {
+  return (std::uint64_t(std::uint32_t(x)) << 32) | std::uint32_t(z);
+}
+
+} // namespace
+
+struct WorldStreamer::ReadQueue {
+  struct Read {
+    size_t cell;
+    unsigned int generation;
+    // null when the file couldn't be read
+    std::unique_ptr<BinarySceneReader> reader;
+  };
+
+  std::mutex mutex;
+  std::deque<Read> completed;
+  // bumped by Close() so reads started before it are discarded
+  unsigned int generation = 0;
+};
+
+WorldStreamer::WorldStreamer(Coordinator &coordinator, SceneManager &scenes)
+    : mCoordinator(coordinator), mScenes(scenes),
+      mReads(std::make_shared<ReadQueue>()) {}
+
+bool WorldStreamer::PartitionWorld(Coordinator &coordinator,
+                                   SceneManager &scenes,
+                                   const std::string &directory,
+                                   float cellSize) {
+  if (!(cellSize > 0.0f)) {
+    std::cerr << "[WorldStreamer] Cell size must be positive" << std::endl;
+    return false;
+  }
+
+  std::vector<Entity> global;
+  std::map<std::pair<int, int>, std::vector<Entity>> cells;
+  for (Entity e : coordinator.GetAllEntities()) {
+    if (!coordinator.HasComponent<TransformComponent>(e) ||
+        coordinator.HasComponent<CameraComponent>(e)) {
+      global.push_back(e);
+      continue;
+    }
+    const glm::vec3 &position =
+        coordinator.GetComponent<TransformComponent>(e).mPosition;
+    cells[{static_cast<int>(std::floor(position.x / cellSize)),
+           static_cast<int>(std::floor(position.z / cellSize))}]
+        .push_back(e);
+  }
+
+  std::error_code error;
+  fs::create_directories(directory, error);
+  fs::path root(directory);
+  if (!scenes.SaveEntities((root / "global.rcscene").string(), global))
+    return false;
+
+  nlohmann::json list = nlohmann::json::array();
+  for (auto &[coords, entities] : cells) {
+    std::string file = "cell_" + std::to_string(coords.first) + "_" +
+                       std::to_string(coords.second) + ".rcscene";
+    std::string path = (root / file).string();
+    if (!scenes.SaveEntities(path, entities))
+      return false;
+    list.push_back({{"x", coords.first},
+                    {"z", coords.second},
+                    {"file", file},
+                    {"entities", entities.size()},
+                    {"bytes", fs::file_size(path, error)}});
+  }
+
+  nlohmann::json manifest = {{"version", MANIFEST_VERSION},
+                             {"cell_size", cellSize},
+                             {"global", "global.rcscene"},
+                             {"cells", std::move(list)}};
+  std::ofstream out(root / MANIFEST, std::ios::binary | std::ios::trunc);
+  out << manifest.dump(1) << '\n';
+  if (!out) {
+    std::cerr << "[WorldStreamer] Failed to write "
+              << (root / MANIFEST).string() << std::endl;
+    return false;
+  }
+  std::cout << "[WorldStreamer] " << directory << ": " << cells.size()
+            << " cells of " << cellSize << ", " << global.size()
+            << " global entities" << std::endl;
+  return true;
+}
+
+bool WorldStreamer::Open(const std::string &directory) {
+  Close();
+  fs::path root(directory);
+  std::ifstream in(root / MANIFEST, std::ios::binary);
+  nlohmann::json manifest = nlohmann::json::parse(in, nullptr, false);
+  if (manifest.is_discarded() || !manifest.is_object() ||
+      manifest.value("version", 0) != MANIFEST_VERSION ||
+      !(manifest.value("cell_size", 0.0f) > 0.0f)) {
+    std::cerr << "[WorldStreamer] No world manifest in " << directory
+              << std::endl;
+    return false;
+  }
+
+  mCellSize = manifest["cell_size"].get<float>();
+  for (const nlohmann::json &entry : manifest["cells"]) {
+    Cell cell;
+    cell.x = entry["x"].get<int>();
+    cell.z = entry["z"].get<int>();
+    cell.file = entry["file"].get<std::string>();
+    cell.bytes = entry["bytes"].get<size_t>();
+    mCellIndex[CellKey(cell.x, cell.z)] = mCells.size();
+    mCells.push_back(std::move(cell));
+  }
+
+  BinarySceneReader global;
+  if (!global.Open((root / manifest.value("global", "global.rcscene"))
+                       .string())) {
+    mCells.clear();
+    mCellIndex.clear();
+    return false;
+  }
+  mScenes.LoadEntities(global, mGlobalEntities);
+  mDirectory = directory;
+  std::cout << "[WorldStreamer] Opened " << directory << ": "
+            << mCells.size() << " cells" << std::endl;
+  return true;
+}
+
+void WorldStreamer::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mReads->mutex);
+    ++mReads->generation;
+    mReads->completed.clear();
+  }
+  for (size_t index : mResident)
+    UnloadCell(mCells[index]);
+  for (Entity e : mGlobalEntities)
+    mCoordinator.DestroyEntity(e);
+
+  mResident.clear();
+  mGlobalEntities.clear();
+  mCells.clear();
+  mCellIndex.clear();
+  mPendingBytes = 0;
+  mDirectory.clear();
+  mStats = {};
+}
+
+float WorldStreamer::Distance(const Cell &cell,
+                              const glm::vec3 &viewer) const {
+  float minX = cell.x * mCellSize;
+  float minZ = cell.z * mCellSize;
+  float dx = std::max({minX - viewer.x, 0.0f, viewer.x - minX - mCellSize});
+  float dz = std::max({minZ - viewer.z, 0.0f, viewer.z - minZ - mCellSize});
+  return std::sqrt(dx * dx + dz * dz);
+}
+
+template <typename Fn>
+void WorldStreamer::ForEachCellInRange(const glm::vec3 &viewer, float radius,
+                                       Fn fn) const {
+  int x0 = static_cast<int>(std::floor((viewer.x - radius) / mCellSize));
+  int x1 = static_cast<int>(std::floor((viewer.x + radius) / mCellSize));
+  int z0 = static_cast<int>(std::floor((viewer.z - radius) / mCellSize));
+  int z1 = static_cast<int>(std::floor((viewer.z + radius) / mCellSize));
+  for (int x = x0; x <= x1; ++x) {
+    for (int z = z0; z <= z1; ++z) {
+      auto it = mCellIndex.find(CellKey(x, z));
+      if (it != mCellIndex.end() &&
+          Distance(mCells[it->second], viewer) <= radius)
+        fn(it->second);
+    }
+  }
+}
+
+void WorldStreamer::Update(const glm::vec3 &viewer) {
+  if (!IsOpen())
+    return;
+
+  auto start = std::chrono::steady_clock::now();
+  bool worked = false;
+  auto outOfTime = [&] {
+    return worked && std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                             .count() > mSettings.frameBudgetMs;
+  };
+
+  // 1. cells read since the last frame join the world
+  while (!outOfTime()) {
+    ReadQueue::Read read;
+    {
+      std::lock_guard<std::mutex> lock(mReads->mutex);
+      if (mReads->completed.empty())
+        break;
+      read = std::move(mReads->completed.front());
+      mReads->completed.pop_front();
+      if (read.generation != mReads->generation)
+        continue;
+    }
+
+    Cell &cell = mCells[read.cell];
+    mPendingBytes -= cell.bytes;
+    --mStats.pendingLoads;
+    cell.state = CellState::Unloaded;
+    // the viewer may have moved on while it was read
+    if (!read.reader || Distance(cell, viewer) > mSettings.unloadRadius)
+      continue;
+
+    mScenes.LoadEntities(*read.reader, cell.entities);
+    cell.state = CellState::Resident;
+    mResident.push_back(read.cell);
+    mStats.residentBytes += cell.bytes;
+    mStats.residentEntities += cell.entities.size();
+    ++mStats.residentCells;
+    ++mStats.cellsLoaded;
+    worked = true;
+  }
+
+  // 2. cells left behind are destroyed
+  for (size_t i = 0; i < mResident.size() && !outOfTime();) {
+    Cell &cell = mCells[mResident[i]];
+    if (Distance(cell, viewer) <= mSettings.unloadRadius) {
+      ++i;
+      continue;
+    }
+    UnloadCell(cell);
+    mResident[i] = mResident.back();
+    mResident.pop_back();
+    worked = true;
+  }
+
+  // 3. cells coming into range are requested, nearest first
+  std::vector<std::pair<float, size_t>> wanted;
+  ForEachCellInRange(viewer, mSettings.loadRadius, [&](size_t index) {
+    if (mCells[index].state == CellState::Unloaded)
+      wanted.push_back({Distance(mCells[index], viewer), index});
+  });
+  std::sort(wanted.begin(), wanted.end());
+
+  mStats.deferredLoads = 0;
+  for (const auto &[distance, index] : wanted) {
+    if (mStats.pendingLoads >= mSettings.maxPendingLoads)
+      break;
+    if (mStats.residentBytes + mPendingBytes + mCells[index].bytes >
+        mSettings.memoryBudget) {
+      ++mStats.deferredLoads;
+      continue;
+    }
+    RequestCell(index);
+  }
+}
+
+void WorldStreamer::RequestCell(size_t index) {
+  Cell &cell = mCells[index];
+  cell.state = CellState::Loading;
+  mPendingBytes += cell.bytes;
+  ++mStats.pendingLoads;
+
+  std::string path = (fs::path(mDirectory) / cell.file).string();
+  unsigned int generation;
+  {
+    std::lock_guard<std::mutex> lock(mReads->mutex);
+    generation = mReads->generation;
+  }
+
+  auto job = [reads = mReads, index, path, generation] {
+    PROFILE_SCOPE("ReadCell");
+    auto reader = std::make_unique<BinarySceneReader>();
+    if (!reader->Open(path))
+      reader.reset();
+    std::lock_guard<std::mutex> lock(reads->mutex);
+    if (generation == reads->generation)
+      reads->completed.push_back({index, generation, std::move(reader)});
+  };
+
+  if (mWorkers)
+    mWorkers->Submit(std::move(job));
+  else
+    job();
+}
+
+void WorldStreamer::UnloadCell(Cell &cell) {
+  for (Entity e : cell.entities)
+    mCoordinator.DestroyEntity(e);
+  mStats.residentBytes -= cell.bytes;
+  mStats.residentEntities -= cell.entities.size();
+  --mStats.residentCells;
+  ++mStats.cellsUnloaded;
+  cell.entities.clear();
+  cell.entities.shrink_to_fit();
+  cell.state = CellState::Unloaded;
+}
+
+size_t WorldStreamer::CountMissingCells(const glm::vec3 &viewer,
+                                        float radius) const {
+  size_t missing = 0;
+  ForEachCellInRange(viewer, radius, [&](size_t index) {
+    if (mCells[index].state != CellState::Resident)
+      ++missing;
+  });
+  return missing;
+}
@@ -0,0 +1,58 @@
+#include "render/GpuProfiler.h"
+#include "core/Profiler.h"
+
+GpuProfiler::~GpuProfiler() { Release(); }
+
+void GpuProfiler::Begin(const char *name) {
+  if (mOpen)
+    return;
+  Frame &frame = mFrames[mFrame % LATENCY];
+  if (frame.used == frame.passes.size()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    frame.passes.push_back({name, query, 0});
+  }
+  Pass &pass = frame.passes[frame.used++];
+  pass.name = name;
+  pass.submitted = Profiler::Now();
+  glBeginQuery(GL_TIME_ELAPSED, pass.query);
+  mOpen = true;
+}
+
+void GpuProfiler::End() {
+  if (!mOpen)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  mOpen = false;
+}
+
+void GpuProfiler::EndFrame() {
+  End();
+  ++mFrame;
+
+  // the oldest frame in flight, its queries are about to be reused
+  Frame &frame = mFrames[mFrame % LATENCY];
+  if (mFrame < LATENCY)
+    return;
+  double total = 0.0;
+  for (size_t i = 0; i < frame.used; ++i) {
+    const Pass &pass = frame.passes[i];
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(pass.query, GL_QUERY_RESULT, &nanoseconds);
+    total += nanoseconds / 1e6;
+    if (Profiler::IsEnabled())
+      Profiler::RecordGpu(pass.name, pass.submitted, nanoseconds);
+  }
+  frame.used = 0;
+  mLastFrameMs = total;
+}
+
+void GpuProfiler::Release() {
+  End();
+  for (Frame &frame : mFrames) {
+    for (const Pass &pass : frame.passes)
+      glDeleteQueries(1, &pass.query);
+    frame.passes.clear();
+    frame.used = 0;
+  }
+}
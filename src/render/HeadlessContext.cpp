@@ -0,0 +1,178 @@
+#include "render/HeadlessContext.h"
+#include <iostream>
+
+#ifdef RENDERCORE_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+namespace {
+
+void *LoadProc(const char *name) {
+  return reinterpret_cast<void *>(eglGetProcAddress(name));
+}
+
+bool HasExtension(const char *extensions, const char *name) {
+  if (!extensions)
+    return false;
+  size_t length = std::strlen(name);
+  for (const char *at = std::strstr(extensions, name); at;
+       at = std::strstr(at + length, name))
+    if ((at == extensions || at[-1] == ' ') &&
+        (at[length] == ' ' || at[length] == '\0'))
+      return true;
+  return false;
+}
+
+// Mesa's surfaceless platform needs no X, Wayland or GPU device, the
+// default display is the fallback for drivers without it
+EGLDisplay OpenDisplay() {
+  const char *clientExtensions =
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+    auto getPlatformDisplay =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay) {
+      EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, nullptr);
+      if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+        return display;
+    }
+  }
+  EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+    return display;
+  return EGL_NO_DISPLAY;
+}
+
+} // namespace
+
+HeadlessContext::~HeadlessContext() { Destroy(); }
+
+bool HeadlessContext::Create(int major, int minor) {
+  Destroy();
+  EGLDisplay display = OpenDisplay();
+  if (display == EGL_NO_DISPLAY) {
+    std::cerr << "[HeadlessContext] No EGL display" << std::endl;
+    return false;
+  }
+  mDisplay = display;
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    std::cerr << "[HeadlessContext] EGL can't create desktop GL contexts"
+              << std::endl;
+    Destroy();
+    return false;
+  }
+
+  const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+  bool surfaceless = HasExtension(extensions, "EGL_KHR_surfaceless_context");
+  const EGLint configAttributes[] = {EGL_SURFACE_TYPE,
+                                     surfaceless ? 0 : EGL_PBUFFER_BIT,
+                                     EGL_RENDERABLE_TYPE,
+                                     EGL_OPENGL_BIT,
+                                     EGL_NONE};
+  EGLConfig config = nullptr;
+  EGLint configs = 0;
+  eglChooseConfig(display, configAttributes, &config, 1, &configs);
+  if (configs == 0 && !surfaceless) {
+    std::cerr << "[HeadlessContext] No pbuffer config" << std::endl;
+    Destroy();
+    return false;
+  }
+
+  const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                      major,
+                                      EGL_CONTEXT_MINOR_VERSION,
+                                      minor,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                      EGL_NONE};
+  // surfaceless contexts may be created without any config
+  EGLContext context =
+      eglCreateContext(display, configs ? config : EGL_NO_CONFIG_KHR,
+                       EGL_NO_CONTEXT, contextAttributes);
+  if (context == EGL_NO_CONTEXT) {
+    std::cerr << "[HeadlessContext] Couldn't create a GL " << major << "."
+              << minor << " core context (EGL error 0x" << std::hex
+              << eglGetError() << std::dec << ")" << std::endl;
+    Destroy();
+    return false;
+  }
+  mContext = context;
+
+  EGLSurface surface = EGL_NO_SURFACE;
+  if (!surfaceless) {
+    const EGLint surfaceAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1,
+                                        EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+    if (surface == EGL_NO_SURFACE) {
+      std::cerr << "[HeadlessContext] Couldn't create a pbuffer" << std::endl;
+      Destroy();
+      return false;
+    }
+    mSurface = surface;
+  }
+
+  if (!eglMakeCurrent(display, surface, surface, context)) {
+    std::cerr << "[HeadlessContext] Couldn't make the context current"
+              << std::endl;
+    Destroy();
+    return false;
+  }
+  return true;
+}
+
+GLADloadproc HeadlessContext::GetLoader() { return LoadProc; }
+
+bool HeadlessContext::MakeCurrent() {
+  if (!mContext)
+    return false;
+  // the bound API is per thread
+  eglBindAPI(EGL_OPENGL_API);
+  EGLSurface surface =
+      mSurface ? static_cast<EGLSurface>(mSurface) : EGL_NO_SURFACE;
+  return eglMakeCurrent(static_cast<EGLDisplay>(mDisplay), surface, surface,
+                        static_cast<EGLContext>(mContext));
+}
+
+void HeadlessContext::ReleaseCurrent() {
+  if (mDisplay)
+    eglMakeCurrent(static_cast<EGLDisplay>(mDisplay), EGL_NO_SURFACE,
+                   EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void HeadlessContext::Destroy() {
+  if (!mDisplay)
+    return;
+  EGLDisplay display = static_cast<EGLDisplay>(mDisplay);
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (mSurface)
+    eglDestroySurface(display, static_cast<EGLSurface>(mSurface));
+  if (mContext)
+    eglDestroyContext(display, static_cast<EGLContext>(mContext));
+  eglTerminate(display);
+  mDisplay = mContext = mSurface = nullptr;
+}
+
+#else
+
+HeadlessContext::~HeadlessContext() = default;
+
+bool HeadlessContext::Create(int, int) {
+  std::cerr << "[HeadlessContext] Built without EGL, headless rendering is "
+               "unavailable"
+            << std::endl;
+  return false;
+}
+
+GLADloadproc HeadlessContext::GetLoader() { return nullptr; }
+
+bool HeadlessContext::MakeCurrent() { return false; }
+
+void HeadlessContext::ReleaseCurrent() {}
+
+void HeadlessContext::Destroy() {}
+
+#endif
@@ -1,49 +1,203 @@
 #include "render/Mesh.h"
-#include <cstddef>
+#include "core/MemoryTracker.h"
+#include "core/Profiler.h"
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 
+MeshPayload EncodedMesh::View() const {
+  MeshPayload payload;
+  payload.vertexData = vertices.data();
+  payload.vertexBytes = vertices.size();
+  payload.positionData = positions.data();
+  payload.positionBytes = positions.size();
+  payload.indexData = indices.data();
+  payload.indexBytes = indices.size();
+  payload.indexType = indexType;
+  payload.dequantization = dequantization;
+  payload.boundsCenter = boundsCenter;
+  payload.boundsRadius = boundsRadius;
+  return payload;
+}
+
 Mesh::Mesh(const std::vector<Vertex> &vertices,
-           const std::vector<unsigned int> &indices)
-    : mVertices(vertices), mIndices(indices) {
-  SetupMesh();
+           const std::vector<unsigned int> &indices,
+           const std::vector<MeshLod> &lods, const VertexLayout &layout)
+    : mVertices(vertices), mIndices(indices), mLods(lods), mFormat(layout) {
+  Upload(Encode(mVertices, mIndices, layout).View());
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
+           std::vector<MeshLod> lods, const VertexLayout &layout,
+           const MeshPayload &payload, StagingUploader *uploader)
+    : mVertices(std::move(vertices)), mIndices(std::move(indices)),
+      mLods(std::move(lods)), mFormat(layout), mUploader(uploader) {
+  Upload(payload);
+}
+
+void Mesh::Upload(const MeshPayload &payload) {
+  if (mLods.empty())
+    mLods.push_back({0, static_cast<unsigned int>(mIndices.size()), 0.0f});
+  CountLodVertices();
+  mVertexCount = mVertices.size();
+  mIndexCount = mIndices.size();
+
+  mBoundsCenter = payload.boundsCenter;
+  mBoundsRadius = payload.boundsRadius;
+  mDequantize = glm::mat4(payload.dequantization.scale);
+  mDequantize[3] = glm::vec4(payload.dequantization.offset, 1.0f);
+
+  SetupMesh(payload);
+  SetupDepthStream(payload);
+  MemoryTracker::Allocated(MemoryCategory::MeshCpu, GetCpuBytes());
+  MemoryTracker::Allocated(MemoryCategory::MeshGpu, mGpuBytes);
+}
+
+void Mesh::ReleaseCpuData() {
+  MemoryTracker::Freed(MemoryCategory::MeshCpu, GetCpuBytes());
+  std::vector<Vertex>().swap(mVertices);
+  std::vector<unsigned int>().swap(mIndices);
+}
+
+EncodedMesh Mesh::Encode(const std::vector<Vertex> &vertices,
+                         const std::vector<unsigned int> &indices,
+                         const VertexLayout &layout) {
+  EncodedMesh encoded;
+  if (!vertices.empty()) {
+    glm::vec3 min = vertices[0].position, max = vertices[0].position;
+    for (const auto &vertex : vertices) {
+      min = glm::min(min, vertex.position);
+      max = glm::max(max, vertex.position);
+    }
+    encoded.boundsCenter = (min + max) * 0.5f;
+    for (const auto &vertex : vertices)
+      encoded.boundsRadius =
+          std::max(encoded.boundsRadius,
+                   glm::length(vertex.position - encoded.boundsCenter));
+  }
+
+  VertexFormat format(layout);
+  encoded.dequantization = format.ComputeDequantization(vertices);
+  format.Encode(vertices, encoded.dequantization, encoded.vertices);
+  format.EncodePositions(vertices, encoded.dequantization, encoded.positions);
+
+  if (vertices.size() <= 0xFFFF) {
+    // half the index bandwidth and memory for everything but huge meshes
+    std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+    encoded.indexType = GL_UNSIGNED_SHORT;
+    encoded.indices.resize(shortIndices.size() * sizeof(uint16_t));
+    std::memcpy(encoded.indices.data(), shortIndices.data(),
+                encoded.indices.size());
+  } else {
+    encoded.indexType = GL_UNSIGNED_INT;
+    encoded.indices.resize(indices.size() * sizeof(unsigned int));
+    std::memcpy(encoded.indices.data(), indices.data(),
+                encoded.indices.size());
+  }
+  return encoded;
 }
 
-void Mesh::Draw() const {
+void Mesh::Draw(size_t lod) const {
+  const MeshLod &level = mLods[lod];
   glBindVertexArray(mVAO);
-  glDrawElements(GL_TRIANGLES, mIndices.size(), GL_UNSIGNED_INT, 0);
+  glDrawElements(GL_TRIANGLES, level.indexCount, mIndexType,
+                 (void *)(level.indexOffset * mIndexSize));
+  PROFILE_COUNT(VaoBinds, 1);
+  PROFILE_COUNT(DrawCalls, 1);
+  PROFILE_COUNT(Triangles, level.indexCount / 3);
   glBindVertexArray(0);
 }
 
+void Mesh::DrawDepth(size_t lod) const {
+  const MeshLod &level = mLods[lod];
+  glBindVertexArray(mDepthVAO);
+  glDrawElements(GL_TRIANGLES, level.indexCount, mIndexType,
+                 (void *)(level.indexOffset * mIndexSize));
+  PROFILE_COUNT(VaoBinds, 1);
+  PROFILE_COUNT(DrawCalls, 1);
+  PROFILE_COUNT(Triangles, level.indexCount / 3);
+  glBindVertexArray(0);
+}
+
+void Mesh::CountLodVertices() {
+  std::vector<bool> seen(mVertices.size());
+  for (auto &level : mLods) {
+    std::fill(seen.begin(), seen.end(), false);
+    level.vertexCount = 0;
+    for (unsigned int i = 0; i < level.indexCount; ++i) {
+      unsigned int v = mIndices[level.indexOffset + i];
+      if (!seen[v]) {
+        seen[v] = true;
+        ++level.vertexCount;
+      }
+    }
+  }
+}
+
 Mesh::~Mesh() {
+  if (!IsUploaded()) {
+    mUploader->Cancel(mVBO);
+    mUploader->Cancel(mEBO);
+    mUploader->Cancel(mPositionVBO);
+  }
   glDeleteVertexArrays(1, &mVAO);
+  glDeleteVertexArrays(1, &mDepthVAO);
   glDeleteBuffers(1, &mVBO);
+  glDeleteBuffers(1, &mPositionVBO);
   glDeleteBuffers(1, &mEBO);
+  MemoryTracker::Freed(MemoryCategory::MeshCpu, GetCpuBytes());
+  MemoryTracker::Freed(MemoryCategory::MeshGpu, mGpuBytes);
 }
 
-void Mesh::SetupMesh() {
+void Mesh::SetupMesh(const MeshPayload &payload) {
   glGenVertexArrays(1, &mVAO);
   glGenBuffers(1, &mVBO);
   glGenBuffers(1, &mEBO);
 
   glBindVertexArray(mVAO);
   glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-  glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex),
-               mVertices.data(), GL_STATIC_DRAW);
+  FillBuffer(GL_ARRAY_BUFFER, mVBO, payload.vertexData, payload.vertexBytes,
+             payload);
 
+  mIndexType = payload.indexType;
+  mIndexSize = mIndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t)
+                                               : sizeof(unsigned int);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(unsigned int),
-               mIndices.data(), GL_STATIC_DRAW);
+  FillBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO, payload.indexData,
+             payload.indexBytes, payload);
+  mGpuBytes += payload.vertexBytes + payload.indexBytes;
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-  glEnableVertexAttribArray(0);
+  mFormat.Apply();
 
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        (void *)offsetof(Vertex, normal));
-  glEnableVertexAttribArray(1);
+  glBindVertexArray(0);
+}
 
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        (void *)offsetof(Vertex, texCoord));
-  glEnableVertexAttribArray(2);
+void Mesh::SetupDepthStream(const MeshPayload &payload) {
+  glGenVertexArrays(1, &mDepthVAO);
+  glGenBuffers(1, &mPositionVBO);
+
+  glBindVertexArray(mDepthVAO);
+  glBindBuffer(GL_ARRAY_BUFFER, mPositionVBO);
+  FillBuffer(GL_ARRAY_BUFFER, mPositionVBO, payload.positionData,
+             payload.positionBytes, payload);
+  mGpuBytes += payload.positionBytes;
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+
+  mFormat.ApplyPositionOnly();
 
   glBindVertexArray(0);
 }
+
+void Mesh::FillBuffer(GLenum target, GLuint buffer, const void *data,
+                      size_t size, const MeshPayload &payload) {
+  if (!mUploader) {
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    return;
+  }
+  glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+  mUploadTicket = mUploader->Enqueue(buffer, 0, data, size, payload.owner);
+}
@@ -0,0 +1,254 @@
+#include "render/MeshCache.h"
+#include "core/Hash.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char MAGIC[4] = {'R', 'C', 'M', 'B'};
+// bump whenever the layout of the file or of any stored struct changes
+constexpr std::uint32_t VERSION = 1;
+constexpr size_t ALIGNMENT = 64;
+
+enum Section : std::uint32_t {
+  SECTION_PATH,
+  SECTION_LODS,
+  SECTION_VERTICES,
+  SECTION_GPU_VERTICES,
+  SECTION_GPU_POSITIONS,
+  SECTION_GPU_INDICES,
+  SECTION_COUNT
+};
+
+struct SectionRange {
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t settingsHash;
+  std::uint64_t sourceSize;
+  std::int64_t sourceMtime;
+  std::uint64_t sourceHash;
+  std::uint8_t position, normal, texCoord, padding;
+  std::uint32_t indexType;
+  float dequantOffset[3];
+  float dequantScale;
+  float boundsCenter[3];
+  float boundsRadius;
+  SectionRange sections[SECTION_COUNT];
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<MeshLod>);
+static_assert(std::is_trivially_copyable_v<Vertex>);
+
+size_t AlignUp(size_t value) {
+  return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+bool SourceStat(const std::string &path, std::uint64_t &size,
+                std::int64_t &mtime) {
+  std::error_code error;
+  size = fs::file_size(path, error);
+  if (error)
+    return false;
+  auto time = fs::last_write_time(path, error);
+  if (error)
+    return false;
+  mtime = static_cast<std::int64_t>(time.time_since_epoch().count());
+  return true;
+}
+
+} // namespace
+
+MeshCache::MeshCache(std::string directory) : mDirectory(std::move(directory)) {}
+
+std::string MeshCache::GetEntryPath(const std::string &sourcePath) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.rcmesh",
+                static_cast<unsigned long long>(
+                    HashBytes(sourcePath.data(), sourcePath.size())));
+  return (fs::path(mDirectory) / name).string();
+}
+
+bool MeshCache::Load(const std::string &sourcePath, std::uint64_t settingsHash,
+                     MeshAsset &asset) const {
+  std::uint64_t sourceSize;
+  std::int64_t sourceMtime;
+  if (!SourceStat(sourcePath, sourceSize, sourceMtime))
+    return false;
+
+  std::string entryPath = GetEntryPath(sourcePath);
+  MappedFile file(entryPath);
+  if (!file.IsOpen() || file.Size() < sizeof(Header))
+    return false;
+
+  Header header;
+  std::memcpy(&header, file.Data(), sizeof(Header));
+  if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION ||
+      header.settingsHash != settingsHash || header.sourceSize != sourceSize)
+    return false;
+  for (const SectionRange &section : header.sections)
+    if (section.offset > file.Size() ||
+        section.size > file.Size() - section.offset)
+      return false;
+
+  auto section = [&](Section s) {
+    return file.Data() + header.sections[s].offset;
+  };
+  auto sectionSize = [&](Section s) { return header.sections[s].size; };
+
+  // a different source hashing to the same entry name
+  if (std::string(section(SECTION_PATH), sectionSize(SECTION_PATH)) !=
+      sourcePath)
+    return false;
+
+  if (header.sourceMtime != sourceMtime) {
+    // touched but maybe not changed (checkout, copy), fall back to content
+    MappedFile source(sourcePath);
+    if (!source.IsOpen() ||
+        HashBytes(source.Data(), source.Size()) != header.sourceHash)
+      return false;
+
+    header.sourceMtime = sourceMtime;
+    std::fstream patch(entryPath,
+                       std::ios::in | std::ios::out | std::ios::binary);
+    patch.seekp(offsetof(Header, sourceMtime));
+    patch.write(reinterpret_cast<const char *>(&sourceMtime),
+                sizeof(sourceMtime));
+  }
+
+  asset.layout.position = static_cast<PositionEncoding>(header.position);
+  asset.layout.normal = static_cast<NormalEncoding>(header.normal);
+  asset.layout.texCoord = static_cast<TexCoordEncoding>(header.texCoord);
+
+  asset.lods.resize(sectionSize(SECTION_LODS) / sizeof(MeshLod));
+  std::memcpy(asset.lods.data(), section(SECTION_LODS),
+              asset.lods.size() * sizeof(MeshLod));
+  asset.vertices.resize(sectionSize(SECTION_VERTICES) / sizeof(Vertex));
+  std::memcpy(asset.vertices.data(), section(SECTION_VERTICES),
+              asset.vertices.size() * sizeof(Vertex));
+
+  const char *indexData = section(SECTION_GPU_INDICES);
+  if (header.indexType == GL_UNSIGNED_SHORT) {
+    asset.indices.resize(sectionSize(SECTION_GPU_INDICES) / sizeof(uint16_t));
+    for (size_t i = 0; i < asset.indices.size(); ++i) {
+      uint16_t index;
+      std::memcpy(&index, indexData + i * sizeof(uint16_t), sizeof(index));
+      asset.indices[i] = index;
+    }
+  } else {
+    asset.indices.resize(sectionSize(SECTION_GPU_INDICES) /
+                         sizeof(unsigned int));
+    std::memcpy(asset.indices.data(), indexData,
+                asset.indices.size() * sizeof(unsigned int));
+  }
+
+  MeshPayload &payload = asset.payload;
+  payload.vertexData = section(SECTION_GPU_VERTICES);
+  payload.vertexBytes = sectionSize(SECTION_GPU_VERTICES);
+  payload.positionData = section(SECTION_GPU_POSITIONS);
+  payload.positionBytes = sectionSize(SECTION_GPU_POSITIONS);
+  payload.indexData = indexData;
+  payload.indexBytes = sectionSize(SECTION_GPU_INDICES);
+  payload.indexType = header.indexType;
+  payload.dequantization.offset =
+      glm::vec3(header.dequantOffset[0], header.dequantOffset[1],
+                header.dequantOffset[2]);
+  payload.dequantization.scale = header.dequantScale;
+  payload.boundsCenter = glm::vec3(header.boundsCenter[0],
+                                   header.boundsCenter[1],
+                                   header.boundsCenter[2]);
+  payload.boundsRadius = header.boundsRadius;
+
+  asset.mapping = std::move(file);
+  asset.fromCache = true;
+  return true;
+}
+
+bool MeshCache::Store(const std::string &sourcePath,
+                      std::uint64_t settingsHash, std::uint64_t sourceHash,
+                      const MeshAsset &asset) const {
+  Header header{};
+  std::memcpy(header.magic, MAGIC, 4);
+  header.version = VERSION;
+  header.settingsHash = settingsHash;
+  header.sourceHash = sourceHash;
+  if (!SourceStat(sourcePath, header.sourceSize, header.sourceMtime))
+    return false;
+
+  const MeshPayload &payload = asset.payload;
+  header.position = static_cast<std::uint8_t>(asset.layout.position);
+  header.normal = static_cast<std::uint8_t>(asset.layout.normal);
+  header.texCoord = static_cast<std::uint8_t>(asset.layout.texCoord);
+  header.indexType = payload.indexType;
+  for (int i = 0; i < 3; ++i) {
+    header.dequantOffset[i] = payload.dequantization.offset[i];
+    header.boundsCenter[i] = payload.boundsCenter[i];
+  }
+  header.dequantScale = payload.dequantization.scale;
+  header.boundsRadius = payload.boundsRadius;
+
+  const void *data[SECTION_COUNT] = {
+      sourcePath.data(),  asset.lods.data(),    asset.vertices.data(),
+      payload.vertexData, payload.positionData, payload.indexData};
+  const size_t sizes[SECTION_COUNT] = {
+      sourcePath.size(),
+      asset.lods.size() * sizeof(MeshLod),
+      asset.vertices.size() * sizeof(Vertex),
+      payload.vertexBytes,
+      payload.positionBytes,
+      payload.indexBytes};
+
+  size_t offset = AlignUp(sizeof(Header));
+  for (std::uint32_t s = 0; s < SECTION_COUNT; ++s) {
+    header.sections[s] = {offset, sizes[s]};
+    offset = AlignUp(offset + sizes[s]);
+  }
+
+  std::error_code error;
+  fs::create_directories(mDirectory, error);
+  std::string entryPath = GetEntryPath(sourcePath);
+  // written aside and renamed so a crash never leaves a torn entry
+  std::string tempPath = entryPath + ".tmp";
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "[MeshCache] Failed to write " << tempPath << std::endl;
+      return false;
+    }
+
+    static const char zeros[ALIGNMENT] = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    size_t written = sizeof(Header);
+    for (std::uint32_t s = 0; s < SECTION_COUNT; ++s) {
+      out.write(zeros, header.sections[s].offset - written);
+      out.write(static_cast<const char *>(data[s]), sizes[s]);
+      written = header.sections[s].offset + sizes[s];
+    }
+    if (!out) {
+      std::cerr << "[MeshCache] Failed to write " << tempPath << std::endl;
+      return false;
+    }
+  }
+
+  fs::rename(tempPath, entryPath, error);
+  if (error) {
+    std::cerr << "[MeshCache] Failed to replace " << entryPath << ": "
+              << error.message() << std::endl;
+    fs::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,262 @@
+#include "render/MeshOptimizer.h"
+#include "glm/geometric.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+constexpr unsigned int INVALID = std::numeric_limits<unsigned int>::max();
+
+// FIFO cache: a vertex is still cached while fewer than cacheSize misses
+// happened since it was last loaded
+struct FifoCache {
+  std::vector<unsigned int> loadedAt;
+  unsigned int time = 0;
+  unsigned int size;
+
+  FifoCache(size_t vertexCount, unsigned int cacheSize)
+      : loadedAt(vertexCount, INVALID), size(cacheSize) {}
+
+  // returns true on a miss
+  bool Access(unsigned int v) {
+    if (loadedAt[v] != INVALID && time - loadedAt[v] < size)
+      return false;
+    loadedAt[v] = time++;
+    return true;
+  }
+
+  // empties the cache without touching every entry
+  void Flush() { time += size; }
+};
+
+} // namespace
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const unsigned int *indices,
+                                                   size_t indexCount,
+                                                   size_t vertexCount,
+                                                   unsigned int cacheSize) {
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> referenced(vertexCount, false);
+  size_t misses = 0, unique = 0;
+
+  for (size_t i = 0; i < indexCount; ++i) {
+    unsigned int v = indices[i];
+    misses += cache.Access(v);
+    if (!referenced[v]) {
+      referenced[v] = true;
+      ++unique;
+    }
+  }
+
+  VertexCacheStats stats{0.0f, 0.0f};
+  if (indexCount > 0)
+    stats.acmr = float(misses) / float(indexCount / 3);
+  if (unique > 0)
+    stats.atvr = float(misses) / float(unique);
+  return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(unsigned int *indices,
+                                        size_t indexCount, size_t vertexCount,
+                                        unsigned int cacheSize) {
+  const size_t triCount = indexCount / 3;
+  if (triCount == 0)
+    return;
+
+  // vertex -> triangle adjacency in CSR form
+  std::vector<unsigned int> offsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < indexCount; ++i)
+    offsets[indices[i] + 1]++;
+  for (size_t v = 0; v < vertexCount; ++v)
+    offsets[v + 1] += offsets[v];
+  std::vector<unsigned int> adjacency(indexCount);
+  {
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+      adjacency[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+  }
+
+  std::vector<unsigned int> liveTris(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+    liveTris[v] = offsets[v + 1] - offsets[v];
+
+  std::vector<unsigned int> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triCount, false);
+  std::vector<unsigned int> deadEnd;
+  std::vector<unsigned int> candidates;
+  std::vector<unsigned int> output;
+  output.reserve(indexCount);
+
+  unsigned int time = cacheSize + 1;
+  size_t cursor = 0;
+
+  auto skipDeadEnd = [&]() -> unsigned int {
+    while (!deadEnd.empty()) {
+      unsigned int v = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveTris[v] > 0)
+        return v;
+    }
+    while (cursor < vertexCount) {
+      if (liveTris[cursor] > 0)
+        return static_cast<unsigned int>(cursor);
+      ++cursor;
+    }
+    return INVALID;
+  };
+
+  unsigned int fan = skipDeadEnd();
+  while (fan != INVALID) {
+    candidates.clear();
+
+    for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+      unsigned int t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = true;
+
+      for (int k = 0; k < 3; ++k) {
+        unsigned int v = indices[t * 3 + k];
+        output.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        liveTris[v]--;
+        if (time - cacheTime[v] > cacheSize)
+          cacheTime[v] = time++;
+      }
+    }
+
+    // prefer the candidate that stays in cache the longest while it still
+    // has triangles left to fan around
+    unsigned int next = INVALID;
+    int bestPriority = -1;
+    for (unsigned int v : candidates) {
+      if (liveTris[v] == 0)
+        continue;
+      int priority = 0;
+      if (time - cacheTime[v] + 2 * liveTris[v] <= cacheSize)
+        priority = static_cast<int>(time - cacheTime[v]);
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        next = v;
+      }
+    }
+
+    fan = next != INVALID ? next : skipDeadEnd();
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(const std::vector<Vertex> &vertices,
+                                     unsigned int *indices, size_t indexCount,
+                                     float threshold, unsigned int cacheSize) {
+  const size_t triCount = indexCount / 3;
+  if (triCount == 0)
+    return;
+
+  // hard boundaries: triangles that miss on all three vertices, Tipsify
+  // restarted there so cutting costs nothing
+  std::vector<size_t> hard;
+  {
+    FifoCache hardCache(vertices.size(), cacheSize);
+    for (size_t t = 0; t < triCount; ++t) {
+      int misses = hardCache.Access(indices[t * 3]) +
+                   hardCache.Access(indices[t * 3 + 1]) +
+                   hardCache.Access(indices[t * 3 + 2]);
+      if (t == 0 || misses == 3)
+        hard.push_back(t);
+    }
+  }
+  hard.push_back(triCount);
+
+  // soft boundaries: split a hard cluster wherever the ACMR so far stays
+  // within threshold of the cluster's own
+  std::vector<size_t> clusters;
+  FifoCache cache(vertices.size(), cacheSize);
+  for (size_t h = 0; h + 1 < hard.size(); ++h) {
+    size_t begin = hard[h], end = hard[h + 1];
+
+    cache.Flush();
+    size_t misses = 0;
+    for (size_t i = begin * 3; i < end * 3; ++i)
+      misses += cache.Access(indices[i]);
+    float clusterAcmr = float(misses) / float(end - begin);
+
+    cache.Flush();
+    size_t start = begin;
+    misses = 0;
+    clusters.push_back(begin);
+    for (size_t t = begin; t < end; ++t) {
+      for (int k = 0; k < 3; ++k)
+        misses += cache.Access(indices[t * 3 + k]);
+
+      size_t tris = t - start + 1;
+      if (t + 1 < end && tris >= 8 &&
+          float(misses) / float(tris) <= clusterAcmr * threshold) {
+        clusters.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.Flush();
+      }
+    }
+  }
+  clusters.push_back(triCount);
+
+  glm::vec3 meshCenter(0.0f);
+  for (size_t i = 0; i < indexCount; ++i)
+    meshCenter += vertices[indices[i]].position;
+  meshCenter /= float(indexCount);
+
+  // clusters facing away from the centre are likely occluders, draw first
+  struct Cluster {
+    size_t begin, end;
+    float sortKey;
+  };
+  std::vector<Cluster> sorted;
+  for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+      const glm::vec3 &p0 = vertices[indices[t * 3]].position;
+      const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+      const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+      glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      float a = glm::length(n);
+      centroid += (p0 + p1 + p2) * (a / 3.0f);
+      normal += n;
+      area += a;
+    }
+    float key = 0.0f;
+    if (area > 0.0f && glm::length(normal) > 0.0f)
+      key = glm::dot(centroid / area - meshCenter, glm::normalize(normal));
+    sorted.push_back({clusters[c], clusters[c + 1], key});
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sortKey > b.sortKey;
+                   });
+
+  std::vector<unsigned int> output;
+  output.reserve(indexCount);
+  for (const Cluster &c : sorted)
+    output.insert(output.end(), indices + c.begin * 3, indices + c.end * 3);
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex> &vertices,
+                                        std::vector<unsigned int> &indices) {
+  std::vector<unsigned int> remap(vertices.size(), INVALID);
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+
+  for (unsigned int &index : indices) {
+    if (remap[index] == INVALID) {
+      remap[index] = static_cast<unsigned int>(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(reordered);
+}
@@ -0,0 +1,341 @@
+#include "render/MeshSimplifier.h"
+#include "glm/geometric.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Symmetric 4x4 quadric, accumulated with its total weight so the error is a
+// weighted mean of squared plane distances instead of growing with valence
+struct Quadric {
+  double a2 = 0, ab = 0, ac = 0, ad = 0;
+  double b2 = 0, bc = 0, bd = 0;
+  double c2 = 0, cd = 0;
+  double d2 = 0;
+  double w = 0;
+
+  void AddPlane(const glm::vec3 &n, double d, double weight) {
+    a2 += weight * n.x * n.x;
+    ab += weight * n.x * n.y;
+    ac += weight * n.x * n.z;
+    ad += weight * n.x * d;
+    b2 += weight * n.y * n.y;
+    bc += weight * n.y * n.z;
+    bd += weight * n.y * d;
+    c2 += weight * n.z * n.z;
+    cd += weight * n.z * d;
+    d2 += weight * d * d;
+    w += weight;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad;
+    b2 += o.b2, bc += o.bc, bd += o.bd;
+    c2 += o.c2, cd += o.cd;
+    d2 += o.d2, w += o.w;
+    return *this;
+  }
+
+  double Error(const glm::vec3 &v) const {
+    double x = v.x, y = v.y, z = v.z;
+    double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+               b2 * y * y + 2 * bc * y * z + 2 * bd * y + c2 * z * z +
+               2 * cd * z + d2;
+    return w > 0 ? std::fabs(e) / w : 0.0;
+  }
+};
+
+struct Collapse {
+  double cost;
+  unsigned int from, to;
+  unsigned int fromVersion, toVersion;
+
+  bool operator>(const Collapse &o) const { return cost > o.cost; }
+};
+
+struct PositionHash {
+  size_t operator()(const glm::vec3 &p) const {
+    uint32_t h[3];
+    std::memcpy(h, &p, sizeof(h));
+    return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+  }
+};
+
+uint64_t EdgeKey(unsigned int a, unsigned int b) {
+  if (a > b)
+    std::swap(a, b);
+  return (uint64_t(a) << 32) | b;
+}
+
+// weight of the virtual planes that keep open borders in place
+constexpr double BOUNDARY_WEIGHT = 10.0;
+
+} // namespace
+
+std::vector<unsigned int>
+MeshSimplifier::Simplify(const std::vector<Vertex> &vertices,
+                         const std::vector<unsigned int> &indices,
+                         size_t targetIndexCount, float maxError,
+                         float *outError) {
+  const size_t vertexCount = vertices.size();
+  const size_t triCount = indices.size() / 3;
+  if (outError)
+    *outError = 0.0f;
+
+  // OBJ import splits vertices on normal/uv seams; topology and quadrics work
+  // on welded positions, the original vertices ("wedges") are only used to
+  // pick the output index
+  std::vector<unsigned int> weld(vertexCount);
+  std::vector<std::vector<unsigned int>> wedges;
+  std::vector<unsigned int> canonical;
+  {
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> lookup;
+    lookup.reserve(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; ++v) {
+      auto [it, inserted] = lookup.emplace(
+          vertices[v].position, static_cast<unsigned int>(wedges.size()));
+      if (inserted) {
+        wedges.emplace_back();
+        canonical.push_back(v);
+      }
+      weld[v] = it->second;
+      wedges[it->second].push_back(v);
+    }
+  }
+  const size_t pointCount = wedges.size();
+  auto position = [&](unsigned int p) -> const glm::vec3 & {
+    return vertices[canonical[p]].position;
+  };
+
+  // triangles hold wedges, the welded point is weld[wedge]
+  std::vector<unsigned int> corners(indices.begin(), indices.end());
+  std::vector<bool> triAlive(triCount, true);
+  std::vector<std::vector<unsigned int>> adjacency(pointCount);
+  std::vector<Quadric> quadrics(pointCount);
+  std::unordered_map<uint64_t, unsigned int> edgeUse;
+  size_t liveTris = 0;
+
+  for (size_t t = 0; t < triCount; ++t) {
+    unsigned int p0 = weld[corners[t * 3]], p1 = weld[corners[t * 3 + 1]],
+                 p2 = weld[corners[t * 3 + 2]];
+    if (p0 == p1 || p1 == p2 || p0 == p2) {
+      triAlive[t] = false;
+      continue;
+    }
+    ++liveTris;
+
+    glm::vec3 n = glm::cross(position(p1) - position(p0),
+                             position(p2) - position(p0));
+    float area = glm::length(n);
+    if (area > 0.0f) {
+      n = n / area;
+      double d = -glm::dot(n, position(p0));
+      for (unsigned int p : {p0, p1, p2})
+        quadrics[p].AddPlane(n, d, area * 0.5);
+    }
+
+    for (unsigned int p : {p0, p1, p2})
+      adjacency[p].push_back(static_cast<unsigned int>(t));
+    edgeUse[EdgeKey(p0, p1)]++;
+    edgeUse[EdgeKey(p1, p2)]++;
+    edgeUse[EdgeKey(p2, p0)]++;
+  }
+
+  // open borders get a plane perpendicular to the face through the edge
+  for (size_t t = 0; t < triCount; ++t) {
+    if (!triAlive[t])
+      continue;
+    unsigned int p[3] = {weld[corners[t * 3]], weld[corners[t * 3 + 1]],
+                         weld[corners[t * 3 + 2]]};
+    glm::vec3 faceNormal = glm::cross(position(p[1]) - position(p[0]),
+                                      position(p[2]) - position(p[0]));
+    if (glm::length(faceNormal) == 0.0f)
+      continue;
+    faceNormal = glm::normalize(faceNormal);
+
+    for (int e = 0; e < 3; ++e) {
+      unsigned int a = p[e], b = p[(e + 1) % 3];
+      if (edgeUse[EdgeKey(a, b)] != 1)
+        continue;
+      glm::vec3 edge = position(b) - position(a);
+      float length = glm::length(edge);
+      if (length == 0.0f)
+        continue;
+      glm::vec3 n = glm::normalize(glm::cross(edge / length, faceNormal));
+      double d = -glm::dot(n, position(a));
+      quadrics[a].AddPlane(n, d, BOUNDARY_WEIGHT * length * length);
+      quadrics[b].AddPlane(n, d, BOUNDARY_WEIGHT * length * length);
+    }
+  }
+
+  std::vector<unsigned int> version(pointCount, 0);
+  std::vector<bool> pointAlive(pointCount, true);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>
+      heap;
+
+  auto pushEdge = [&](unsigned int a, unsigned int b) {
+    Quadric q = quadrics[a];
+    q += quadrics[b];
+    double toB = q.Error(position(b));
+    double toA = q.Error(position(a));
+    if (toB <= toA)
+      heap.push({toB, a, b, version[a], version[b]});
+    else
+      heap.push({toA, b, a, version[b], version[a]});
+  };
+
+  for (auto &[key, uses] : edgeUse)
+    pushEdge(static_cast<unsigned int>(key >> 32),
+             static_cast<unsigned int>(key & 0xffffffffu));
+  edgeUse.clear();
+
+  auto triHas = [&](unsigned int t, unsigned int p) {
+    return weld[corners[t * 3]] == p || weld[corners[t * 3 + 1]] == p ||
+           weld[corners[t * 3 + 2]] == p;
+  };
+
+  const double maxCost = double(maxError) * double(maxError);
+  const size_t targetTris = targetIndexCount / 3;
+  double worstCost = 0.0;
+  std::vector<unsigned int> neighbours;
+
+  while (liveTris > targetTris && !heap.empty()) {
+    Collapse c = heap.top();
+    heap.pop();
+
+    if (!pointAlive[c.from] || !pointAlive[c.to] ||
+        version[c.from] != c.fromVersion || version[c.to] != c.toVersion)
+      continue;
+    if (c.cost > maxCost)
+      break;
+
+    // link condition: the two points may only share the apexes of the
+    // triangles on the collapsed edge, otherwise the surface gets pinched
+    neighbours.clear();
+    size_t sharedTris = 0;
+    for (unsigned int t : adjacency[c.from]) {
+      if (!triAlive[t])
+        continue;
+      if (triHas(t, c.to))
+        ++sharedTris;
+      for (int k = 0; k < 3; ++k) {
+        unsigned int p = weld[corners[t * 3 + k]];
+        if (p != c.from && p != c.to)
+          neighbours.push_back(p);
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                     neighbours.end());
+
+    size_t commonNeighbours = 0;
+    for (unsigned int t : adjacency[c.to]) {
+      if (!triAlive[t] || triHas(t, c.from))
+        continue;
+      for (int k = 0; k < 3; ++k) {
+        unsigned int p = weld[corners[t * 3 + k]];
+        if (p != c.to &&
+            std::binary_search(neighbours.begin(), neighbours.end(), p)) {
+          ++commonNeighbours;
+          // count every neighbour once
+          neighbours.erase(
+              std::lower_bound(neighbours.begin(), neighbours.end(), p));
+        }
+      }
+    }
+    if (commonNeighbours > sharedTris)
+      continue;
+
+    // reject collapses that flip a surviving triangle
+    bool flips = false;
+    for (unsigned int t : adjacency[c.from]) {
+      if (!triAlive[t] || triHas(t, c.to))
+        continue;
+      glm::vec3 before[3], after[3];
+      for (int k = 0; k < 3; ++k) {
+        unsigned int p = weld[corners[t * 3 + k]];
+        before[k] = position(p);
+        after[k] = p == c.from ? position(c.to) : before[k];
+      }
+      glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+      glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+      if (glm::dot(n0, n1) <= 0.0f) {
+        flips = true;
+        break;
+      }
+    }
+    if (flips)
+      continue;
+
+    for (unsigned int t : adjacency[c.from]) {
+      if (!triAlive[t])
+        continue;
+      if (triHas(t, c.to)) {
+        triAlive[t] = false;
+        --liveTris;
+        continue;
+      }
+
+      for (int k = 0; k < 3; ++k) {
+        unsigned int &wedge = corners[t * 3 + k];
+        if (weld[wedge] != c.from)
+          continue;
+
+        // keep the wedge of the surviving point whose attributes are closest
+        unsigned int best = wedges[c.to][0];
+        float bestScore = -2.0f;
+        for (unsigned int candidate : wedges[c.to]) {
+          float score = glm::dot(vertices[candidate].normal,
+                                 vertices[wedge].normal);
+          if (score > bestScore) {
+            bestScore = score;
+            best = candidate;
+          }
+        }
+        wedge = best;
+      }
+      adjacency[c.to].push_back(t);
+    }
+
+    pointAlive[c.from] = false;
+    adjacency[c.from].clear();
+    quadrics[c.to] += quadrics[c.from];
+    ++version[c.to];
+    worstCost = std::max(worstCost, c.cost);
+
+    auto &toTris = adjacency[c.to];
+    toTris.erase(std::remove_if(toTris.begin(), toTris.end(),
+                                [&](unsigned int t) { return !triAlive[t]; }),
+                 toTris.end());
+
+    neighbours.clear();
+    for (unsigned int t : toTris)
+      for (int k = 0; k < 3; ++k)
+        neighbours.push_back(weld[corners[t * 3 + k]]);
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                     neighbours.end());
+    for (unsigned int p : neighbours)
+      if (p != c.to)
+        pushEdge(c.to, p);
+  }
+
+  if (outError)
+    *outError = static_cast<float>(std::sqrt(worstCost));
+
+  std::vector<unsigned int> result;
+  result.reserve(liveTris * 3);
+  for (size_t t = 0; t < triCount; ++t) {
+    if (!triAlive[t])
+      continue;
+    result.push_back(corners[t * 3]);
+    result.push_back(corners[t * 3 + 1]);
+    result.push_back(corners[t * 3 + 2]);
+  }
+  return result;
+}
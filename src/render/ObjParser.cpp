@@ -0,0 +1,393 @@
+#include "render/ObjParser.h"
+#include "io/MappedFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t NONE = 0xffffffffu;
+// below this a chunk isn't worth a thread
+constexpr size_t MIN_CHUNK_BYTES = 4 << 20;
+
+struct Corner {
+  uint32_t v, t, n;
+  bool operator==(const Corner &o) const {
+    return v == o.v && t == o.t && n == o.n;
+  }
+};
+
+struct Chunk {
+  const char *begin;
+  const char *end;
+  // element counts, filled by the counting pass
+  size_t positions = 0, texCoords = 0, normals = 0;
+  // global index of this chunk's first element of each kind
+  size_t positionBase = 0, texCoordBase = 0, normalBase = 0;
+  std::vector<Corner> corners; // three per triangle
+};
+
+inline bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char *SkipBlank(const char *p, const char *end) {
+  while (p < end && IsBlank(*p))
+    ++p;
+  return p;
+}
+
+inline const char *LineEnd(const char *p, const char *end) {
+  const void *nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+  return nl ? static_cast<const char *>(nl) : end;
+}
+
+const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Decimal float without locale or allocation. Not correctly rounded in
+// every case, but well within float precision. Leaves out at 0 and returns
+// p when there is no number.
+const char *ParseFloat(const char *p, const char *end, float &out) {
+  out = 0.0f;
+  p = SkipBlank(p, end);
+  const char *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  uint64_t mantissa = 0;
+  int exponent = 0, digits = 0;
+  for (; p < end && unsigned(*p - '0') < 10; ++p, ++digits) {
+    if (mantissa < 1000000000000000000ull)
+      mantissa = mantissa * 10 + unsigned(*p - '0');
+    else
+      ++exponent;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    for (; p < end && unsigned(*p - '0') < 10; ++p, ++digits) {
+      if (mantissa < 1000000000000000000ull) {
+        mantissa = mantissa * 10 + unsigned(*p - '0');
+        --exponent;
+      }
+    }
+  }
+  if (digits == 0)
+    return start;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *e = p + 1;
+    bool negativeExp = false;
+    if (e < end && (*e == '-' || *e == '+'))
+      negativeExp = *e++ == '-';
+    if (e < end && unsigned(*e - '0') < 10) {
+      int value = 0;
+      for (; e < end && unsigned(*e - '0') < 10; ++e)
+        value = std::min(value * 10 + int(*e - '0'), 10000);
+      exponent += negativeExp ? -value : value;
+      p = e;
+    }
+  }
+
+  double value = static_cast<double>(mantissa);
+  if (exponent < 0 && exponent >= -22)
+    value /= POW10[-exponent];
+  else if (exponent > 0 && exponent <= 22)
+    value *= POW10[exponent];
+  else if (exponent != 0)
+    value *= std::pow(10.0, exponent);
+
+  out = static_cast<float>(negative ? -value : value);
+  return p;
+}
+
+const char *ParseInt(const char *p, const char *end, long long &out) {
+  out = 0;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  for (; p < end && unsigned(*p - '0') < 10; ++p)
+    out = out * 10 + (*p - '0');
+  if (negative)
+    out = -out;
+  return p;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element
+// defined so far; 0 or out of range becomes NONE
+uint32_t ResolveIndex(long long index, size_t definedSoFar) {
+  long long resolved = index > 0 ? index - 1
+                                 : static_cast<long long>(definedSoFar) + index;
+  if (index == 0 || resolved < 0)
+    return NONE;
+  return static_cast<uint32_t>(resolved);
+}
+
+void CountChunk(Chunk &chunk) {
+  const char *p = chunk.begin;
+  while (p < chunk.end) {
+    const char *eol = LineEnd(p, chunk.end);
+    p = SkipBlank(p, eol);
+    if (eol - p >= 2 && p[0] == 'v') {
+      if (IsBlank(p[1]))
+        ++chunk.positions;
+      else if (p[1] == 't')
+        ++chunk.texCoords;
+      else if (p[1] == 'n')
+        ++chunk.normals;
+    }
+    p = eol + 1;
+  }
+}
+
+void ParseChunk(Chunk &chunk, std::vector<glm::vec3> &positions,
+                std::vector<glm::vec2> &texCoords,
+                std::vector<glm::vec3> &normals) {
+  size_t positionCount = chunk.positionBase;
+  size_t texCoordCount = chunk.texCoordBase;
+  size_t normalCount = chunk.normalBase;
+  std::vector<Corner> face;
+
+  const char *p = chunk.begin;
+  while (p < chunk.end) {
+    const char *eol = LineEnd(p, chunk.end);
+    p = SkipBlank(p, eol);
+
+    if (eol - p >= 2 && p[0] == 'v') {
+      if (IsBlank(p[1])) {
+        glm::vec3 &v = positions[positionCount++];
+        const char *q = ParseFloat(p + 2, eol, v.x);
+        q = ParseFloat(q, eol, v.y);
+        ParseFloat(q, eol, v.z);
+      } else if (p[1] == 't') {
+        glm::vec2 &uv = texCoords[texCoordCount++];
+        const char *q = ParseFloat(p + 2, eol, uv.x);
+        ParseFloat(q, eol, uv.y);
+      } else if (p[1] == 'n') {
+        glm::vec3 &n = normals[normalCount++];
+        const char *q = ParseFloat(p + 2, eol, n.x);
+        q = ParseFloat(q, eol, n.y);
+        ParseFloat(q, eol, n.z);
+      }
+    } else if (eol - p >= 2 && p[0] == 'f' && IsBlank(p[1])) {
+      face.clear();
+      const char *q = p + 2;
+      while (true) {
+        q = SkipBlank(q, eol);
+        if (q >= eol)
+          break;
+
+        // v, v/t, v//n or v/t/n
+        long long v = 0, t = 0, n = 0;
+        q = ParseInt(q, eol, v);
+        if (q < eol && *q == '/') {
+          ++q;
+          if (q < eol && *q != '/')
+            q = ParseInt(q, eol, t);
+          if (q < eol && *q == '/')
+            q = ParseInt(q + 1, eol, n);
+        }
+        // skip whatever is left of a malformed token
+        while (q < eol && !IsBlank(*q))
+          ++q;
+
+        face.push_back({ResolveIndex(v, positionCount),
+                        t ? ResolveIndex(t, texCoordCount) : NONE,
+                        n ? ResolveIndex(n, normalCount) : NONE});
+      }
+
+      for (size_t i = 2; i < face.size(); ++i) {
+        chunk.corners.push_back(face[0]);
+        chunk.corners.push_back(face[i - 1]);
+        chunk.corners.push_back(face[i]);
+      }
+    }
+    p = eol + 1;
+  }
+}
+
+template <typename Fn> void ForEachChunk(std::vector<Chunk> &chunks, Fn fn) {
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < chunks.size(); ++i)
+    workers.emplace_back([&, i] { fn(chunks[i]); });
+  fn(chunks[0]);
+  for (auto &worker : workers)
+    worker.join();
+}
+
+// Open addressing (v, t, n) -> vertex index, linear probing
+class CornerMap {
+public:
+  explicit CornerMap(size_t expected) {
+    size_t capacity = 16;
+    while (capacity < expected * 2)
+      capacity *= 2;
+    mSlots.assign(capacity, {{NONE, NONE, NONE}, NONE});
+  }
+
+  // returns the existing index or inserts next
+  uint32_t FindOrInsert(const Corner &key, uint32_t next) {
+    if ((mCount + 1) * 2 > mSlots.size())
+      Grow();
+    size_t mask = mSlots.size() - 1;
+    for (size_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+      Slot &slot = mSlots[i];
+      if (slot.value == NONE) {
+        slot = {key, next};
+        ++mCount;
+        return next;
+      }
+      if (slot.key == key)
+        return slot.value;
+    }
+  }
+
+private:
+  struct Slot {
+    Corner key;
+    uint32_t value;
+  };
+
+  static size_t Hash(const Corner &c) {
+    uint64_t h = uint64_t(c.v) * 0x9e3779b97f4a7c15ull;
+    h ^= uint64_t(c.t) * 0xc2b2ae3d27d4eb4full + (h >> 29);
+    h ^= uint64_t(c.n) * 0x165667b19e3779f9ull + (h >> 32);
+    return static_cast<size_t>(h ^ (h >> 31));
+  }
+
+  void Grow() {
+    std::vector<Slot> old(mSlots.size() * 2, {{NONE, NONE, NONE}, NONE});
+    old.swap(mSlots);
+    size_t mask = mSlots.size() - 1;
+    for (const Slot &slot : old) {
+      if (slot.value == NONE)
+        continue;
+      size_t i = Hash(slot.key) & mask;
+      while (mSlots[i].value != NONE)
+        i = (i + 1) & mask;
+      mSlots[i] = slot;
+    }
+  }
+
+  std::vector<Slot> mSlots;
+  size_t mCount = 0;
+};
+
+} // namespace
+
+bool ObjParser::Parse(const std::string &path,
+                      std::vector<Vertex> &outVertices,
+                      std::vector<unsigned int> &outIndices,
+                      unsigned int threads) {
+  MappedFile file(path);
+  if (!file.IsOpen()) {
+    std::cerr << "Failed to open OBJ file: " << path << std::endl;
+    return false;
+  }
+  return Parse(file.Data(), file.Size(), outVertices, outIndices, threads);
+}
+
+bool ObjParser::Parse(const char *data, size_t size,
+                      std::vector<Vertex> &outVertices,
+                      std::vector<unsigned int> &outIndices,
+                      unsigned int threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunkCount = std::clamp<size_t>(size / MIN_CHUNK_BYTES, 1, threads);
+
+  // split on line boundaries
+  std::vector<Chunk> chunks(chunkCount);
+  const char *end = data + size;
+  const char *p = data;
+  for (size_t i = 0; i < chunkCount; ++i) {
+    const char *chunkEnd = std::max(p, data + size * (i + 1) / chunkCount);
+    chunkEnd = chunkEnd < end ? LineEnd(chunkEnd, end) : end;
+    if (chunkEnd < end)
+      ++chunkEnd;
+    chunks[i].begin = p;
+    chunks[i].end = chunkEnd;
+    p = chunkEnd;
+  }
+
+  // counting first gives every chunk its global offsets, so elements land
+  // in place and negative indices resolve without a fix-up pass
+  if (chunkCount > 1)
+    ForEachChunk(chunks, CountChunk);
+  else
+    CountChunk(chunks[0]);
+
+  size_t positionTotal = 0, texCoordTotal = 0, normalTotal = 0;
+  for (Chunk &chunk : chunks) {
+    chunk.positionBase = positionTotal;
+    chunk.texCoordBase = texCoordTotal;
+    chunk.normalBase = normalTotal;
+    positionTotal += chunk.positions;
+    texCoordTotal += chunk.texCoords;
+    normalTotal += chunk.normals;
+  }
+
+  std::vector<glm::vec3> positions(positionTotal);
+  std::vector<glm::vec2> texCoords(texCoordTotal);
+  std::vector<glm::vec3> normals(normalTotal);
+  auto parse = [&](Chunk &chunk) {
+    ParseChunk(chunk, positions, texCoords, normals);
+  };
+  if (chunkCount > 1)
+    ForEachChunk(chunks, parse);
+  else
+    parse(chunks[0]);
+
+  size_t cornerTotal = 0;
+  for (const Chunk &chunk : chunks)
+    cornerTotal += chunk.corners.size();
+
+  outVertices.clear();
+  outIndices.clear();
+  outVertices.reserve(positionTotal);
+  outIndices.reserve(cornerTotal);
+
+  CornerMap unique(positionTotal);
+  size_t invalid = 0;
+  for (Chunk &chunk : chunks) {
+    const std::vector<Corner> &corners = chunk.corners;
+    for (size_t c = 0; c + 2 < corners.size(); c += 3) {
+      bool valid = true;
+      for (int k = 0; k < 3; ++k) {
+        const Corner &corner = corners[c + k];
+        valid &= corner.v < positionTotal &&
+                 (corner.t == NONE || corner.t < texCoordTotal) &&
+                 (corner.n == NONE || corner.n < normalTotal);
+      }
+      if (!valid) {
+        ++invalid;
+        continue;
+      }
+
+      for (int k = 0; k < 3; ++k) {
+        const Corner &corner = corners[c + k];
+        uint32_t next = static_cast<uint32_t>(outVertices.size());
+        uint32_t index = unique.FindOrInsert(corner, next);
+        if (index == next) {
+          Vertex vertex{};
+          vertex.position = positions[corner.v];
+          if (corner.t != NONE)
+            vertex.texCoord = texCoords[corner.t];
+          if (corner.n != NONE)
+            vertex.normal = normals[corner.n];
+          outVertices.push_back(vertex);
+        }
+        outIndices.push_back(index);
+      }
+    }
+    std::vector<Corner>().swap(chunk.corners);
+  }
+
+  if (invalid > 0)
+    std::cerr << "[ObjParser] skipped " << invalid
+              << " triangles with out of range indices" << std::endl;
+  return true;
+}
@@ -0,0 +1,87 @@
+#include "render/OffscreenTarget.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+OffscreenTarget::~OffscreenTarget() { Release(); }
+
+bool OffscreenTarget::Create(int width, int height) {
+  Release();
+  mWidth = width;
+  mHeight = height;
+
+  glGenRenderbuffers(1, &mColor);
+  glBindRenderbuffer(GL_RENDERBUFFER, mColor);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &mDepth);
+  glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &mFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, mColor);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, mDepth);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "[OffscreenTarget] Framebuffer incomplete (0x" << std::hex
+              << status << std::dec << ")" << std::endl;
+    Release();
+    return false;
+  }
+  return true;
+}
+
+void OffscreenTarget::Bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+}
+
+std::vector<std::uint8_t> OffscreenTarget::ReadPixels() const {
+  size_t row = size_t(mWidth) * 3;
+  std::vector<std::uint8_t> pixels(row * mHeight);
+  if (pixels.empty())
+    return pixels;
+
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &framebuffer);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, mWidth, mHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+
+  // GL's first row is the bottom one
+  std::vector<std::uint8_t> flipped(row);
+  for (int y = 0; y < mHeight / 2; ++y) {
+    std::uint8_t *top = pixels.data() + row * y;
+    std::uint8_t *bottom = pixels.data() + row * (mHeight - 1 - y);
+    std::memcpy(flipped.data(), top, row);
+    std::memcpy(top, bottom, row);
+    std::memcpy(bottom, flipped.data(), row);
+  }
+  return pixels;
+}
+
+bool OffscreenTarget::WritePpm(const std::string &path) const {
+  std::vector<std::uint8_t> pixels = ReadPixels();
+  std::ofstream file(path, std::ios::binary);
+  file << "P6\n" << mWidth << " " << mHeight << "\n255\n";
+  file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+  if (!file) {
+    std::cerr << "[OffscreenTarget] Couldn't write " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void OffscreenTarget::Release() {
+  if (mFramebuffer)
+    glDeleteFramebuffers(1, &mFramebuffer);
+  if (mColor)
+    glDeleteRenderbuffers(1, &mColor);
+  if (mDepth)
+    glDeleteRenderbuffers(1, &mDepth);
+  mFramebuffer = mColor = mDepth = 0;
+  mWidth = mHeight = 0;
+}
@@ -0,0 +1,171 @@
+#include "render/ProgramBinaryCache.h"
+#include "core/Hash.h"
+#include "io/MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// GL_ARB_get_program_binary, not in the 3.3 headers
+constexpr GLenum PROGRAM_BINARY_RETRIEVABLE_HINT = 0x8257;
+constexpr GLenum PROGRAM_BINARY_LENGTH = 0x8741;
+constexpr GLenum NUM_PROGRAM_BINARY_FORMATS = 0x87FE;
+
+constexpr char MAGIC[4] = {'R', 'C', 'P', 'B'};
+constexpr std::uint32_t VERSION = 1;
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t driverHash;
+  std::uint64_t key;
+  std::uint32_t format;
+  std::uint32_t length;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+
+std::string GetString(GLenum name) {
+  const GLubyte *value = glGetString(name);
+  return value ? reinterpret_cast<const char *>(value) : "";
+}
+
+} // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(std::string directory)
+    : mDirectory(std::move(directory)) {}
+
+bool ProgramBinaryCache::Init(GLADloadproc load) {
+  mAvailable = false;
+  mGetProgramBinary =
+      reinterpret_cast<GetProgramBinaryProc>(load("glGetProgramBinary"));
+  mProgramBinary = reinterpret_cast<ProgramBinaryProc>(load("glProgramBinary"));
+  mProgramParameteri =
+      reinterpret_cast<ProgramParameteriProc>(load("glProgramParameteri"));
+  if (!mGetProgramBinary || !mProgramBinary || !mProgramParameteri)
+    return false;
+
+  // the entry points may exist without any format to use them with
+  GLint formats = 0;
+  glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+  glGetError();
+  if (formats <= 0)
+    return false;
+
+  std::string driver = GetString(GL_VENDOR) + "\n" + GetString(GL_RENDERER) +
+                       "\n" + GetString(GL_VERSION);
+  mDriverHash = HashString(driver);
+  mAvailable = true;
+  return true;
+}
+
+std::string ProgramBinaryCache::GetEntryPath(std::uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.rcprog",
+                static_cast<unsigned long long>(
+                    HashBytes(&key, sizeof(key), mDriverHash)));
+  return (fs::path(mDirectory) / name).string();
+}
+
+GLuint ProgramBinaryCache::Load(std::uint64_t key) const {
+  if (!IsAvailable())
+    return 0;
+
+  std::string entryPath = GetEntryPath(key);
+  MappedFile file(entryPath);
+  if (!file.IsOpen() || file.Size() < sizeof(Header))
+    return 0;
+
+  Header header;
+  std::memcpy(&header, file.Data(), sizeof(Header));
+  if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION ||
+      header.driverHash != mDriverHash || header.key != key ||
+      header.length > file.Size() - sizeof(Header))
+    return 0;
+
+  GLuint program = glCreateProgram();
+  mProgramBinary(program, header.format, file.Data() + sizeof(Header),
+                 header.length);
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // the driver changed underneath the same strings, rebuild the entry
+    glDeleteProgram(program);
+    glGetError();
+    std::error_code error;
+    fs::remove(entryPath, error);
+    return 0;
+  }
+  return program;
+}
+
+void ProgramBinaryCache::PrepareLink(GLuint program) const {
+  if (IsAvailable())
+    mProgramParameteri(program, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+size_t ProgramBinaryCache::GetProgramSize(GLuint program) const {
+  if (!mAvailable)
+    return 0;
+  GLint length = 0;
+  glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+  return length > 0 ? static_cast<size_t>(length) : 0;
+}
+
+bool ProgramBinaryCache::Store(std::uint64_t key, GLuint program) const {
+  if (!IsAvailable())
+    return false;
+
+  GLint length = 0;
+  glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return false;
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  GLsizei written = 0;
+  mGetProgramBinary(program, length, &written, &format, binary.data());
+  if (written <= 0)
+    return false;
+
+  Header header{};
+  std::memcpy(header.magic, MAGIC, 4);
+  header.version = VERSION;
+  header.driverHash = mDriverHash;
+  header.key = key;
+  header.format = format;
+  header.length = static_cast<std::uint32_t>(written);
+
+  std::error_code error;
+  fs::create_directories(mDirectory, error);
+  std::string entryPath = GetEntryPath(key);
+  // written aside and renamed so a crash never leaves a torn entry
+  std::string tempPath = entryPath + ".tmp";
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    out.write(binary.data(), written);
+    if (!out) {
+      std::cerr << "[ProgramBinaryCache] Failed to write " << tempPath
+                << std::endl;
+      return false;
+    }
+  }
+
+  fs::rename(tempPath, entryPath, error);
+  if (error) {
+    std::cerr << "[ProgramBinaryCache] Failed to replace " << entryPath
+              << ": " << error.message() << std::endl;
+    fs::remove(tempPath, error);
+    return false;
+  }
+  return true;
+}
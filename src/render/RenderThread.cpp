@@ -0,0 +1,93 @@
+#include "render/RenderThread.h"
+#include "core/Profiler.h"
+#include <algorithm>
+
+RenderThread::~RenderThread() { Stop(); }
+
+void RenderThread::Start(unsigned int framesInFlight,
+                         std::function<void()> attach, PacketFn render,
+                         std::function<void()> detach) {
+  if (IsRunning())
+    return;
+  framesInFlight = std::clamp(framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT);
+  mPackets.assign(framesInFlight, RenderPacket{});
+  mRender = std::move(render);
+  mSubmitted = mRendered = 0;
+  mStopping = false;
+  mStats = {};
+  mThread = std::thread(&RenderThread::Loop, this, std::move(attach),
+                        std::move(detach));
+}
+
+RenderPacket &RenderThread::BeginPacket() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  std::uint64_t start = Profiler::Now();
+  mDone.wait(lock, [&] { return mSubmitted - mRendered < mPackets.size(); });
+  mStats.simulationWaitMs += (Profiler::Now() - start) / 1e6;
+  return mPackets[mSubmitted % mPackets.size()];
+}
+
+void RenderThread::SubmitPacket() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mSubmitted;
+  }
+  mWork.notify_one();
+}
+
+void RenderThread::Invoke(const std::function<void()> &fn) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mTask = &fn;
+  mWork.notify_one();
+  mDone.wait(lock, [&] { return mTask == nullptr; });
+}
+
+void RenderThread::Stop() {
+  if (!IsRunning())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mWork.notify_one();
+  mThread.join();
+}
+
+RenderThreadStats RenderThread::GetStats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+void RenderThread::Loop(std::function<void()> attach,
+                        std::function<void()> detach) {
+  Profiler::SetThreadName("render");
+  attach();
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  for (;;) {
+    std::uint64_t start = Profiler::Now();
+    mWork.wait(lock, [&] {
+      return mRendered < mSubmitted || mTask != nullptr || mStopping;
+    });
+    // packets first, a task runs once the ones before it are drawn
+    if (mRendered < mSubmitted) {
+      mStats.renderWaitMs += (Profiler::Now() - start) / 1e6;
+      RenderPacket &packet = mPackets[mRendered % mPackets.size()];
+      lock.unlock();
+      mRender(packet);
+      lock.lock();
+      ++mRendered;
+      ++mStats.frames;
+    } else if (mTask) {
+      lock.unlock();
+      (*mTask)();
+      lock.lock();
+      mTask = nullptr;
+    } else {
+      break;
+    }
+    mDone.notify_all();
+  }
+  lock.unlock();
+  detach();
+}
@@ -0,0 +1,68 @@
+#include "render/ShaderReflection.h"
+#include <algorithm>
+#include <iostream>
+
+ShaderReflection::ShaderReflection(GLuint program,
+                                   const UniformBlockResolver &resolver) {
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::string name(std::max(maxLength, 1), '\0');
+
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, i, static_cast<GLsizei>(name.size()), &length,
+                       &size, &type, name.data());
+    std::string uniformName = name.substr(0, length);
+
+    // block members have no location of their own
+    GLint location = glGetUniformLocation(program, uniformName.c_str());
+    if (location == -1)
+      continue;
+
+    // arrays are reported as "name[0]", callers use the bare name
+    if (uniformName.size() > 3 &&
+        uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+      uniformName.resize(uniformName.size() - 3);
+
+    UniformName hash = HashUniformName(uniformName);
+    if (GetLocation(hash) != -1)
+      std::cerr << "[ShaderReflection] Uniform name hash collision on "
+                << uniformName << std::endl;
+    mUniforms.push_back({hash, location, type, size});
+  }
+
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                 &maxLength);
+  name.assign(std::max(maxLength, 1), '\0');
+
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    glGetActiveUniformBlockName(program, i, static_cast<GLsizei>(name.size()),
+                                &length, name.data());
+    UniformBlockInfo block{name.substr(0, length), static_cast<GLuint>(i), 0,
+                           0};
+    glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE,
+                              &block.size);
+
+    GLuint binding;
+    GLsizeiptr bufferSize;
+    if (resolver && resolver(block.name, binding, bufferSize)) {
+      if (block.size > bufferSize)
+        std::cerr << "[ShaderReflection] Block " << block.name << " is "
+                  << block.size << " bytes, its buffer only " << bufferSize
+                  << std::endl;
+      glUniformBlockBinding(program, block.index, binding);
+      block.binding = binding;
+    } else {
+      GLint declared = 0;
+      glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING,
+                                &declared);
+      block.binding = static_cast<GLuint>(declared);
+    }
+    mBlocks.push_back(std::move(block));
+  }
+}
@@ -0,0 +1,185 @@
+#include "render/StagingUploader.h"
+#include "core/MemoryTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+StagingUploader::StagingUploader(const StagingSettings &settings)
+    : mSettings(settings) {}
+
+StagingUploader::~StagingUploader() { ReleaseRing(); }
+
+void StagingUploader::SetSettings(const StagingSettings &settings) {
+  if (settings.stagingBytes != mSettings.stagingBytes)
+    ReleaseRing(); // recreated at the new size by the next copy
+  mSettings = settings;
+}
+
+StagingUploader::Ticket StagingUploader::Enqueue(
+    GLuint buffer, GLintptr offset, const void *data, size_t size,
+    std::shared_ptr<const void> owner) {
+  Ticket ticket = mNextTicket++;
+  if (size == 0) {
+    UpdateCompleted();
+    return ticket;
+  }
+  mRequests.push_back({buffer, offset, static_cast<const char *>(data), size,
+                       0, ticket, std::move(owner)});
+  mStats.bytesQueued += size;
+  return ticket;
+}
+
+void StagingUploader::Process() {
+  auto start = std::chrono::steady_clock::now();
+  RetireSegments();
+  size_t copied = Copy(mSettings.frameBudgetBytes);
+
+  mStats.bytesLastFrame = copied;
+  if (copied > 0) {
+    ++mStats.frames;
+    mStats.seconds += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  }
+}
+
+void StagingUploader::Finish(Ticket ticket) {
+  auto start = std::chrono::steady_clock::now();
+  size_t copied = 0;
+  while (!IsComplete(ticket) && !mRequests.empty()) {
+    size_t chunk = Copy(std::numeric_limits<size_t>::max());
+    if (chunk == 0)
+      break;
+    copied += chunk;
+  }
+
+  if (copied > 0)
+    mStats.seconds += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+}
+
+void StagingUploader::Cancel(GLuint buffer) {
+  for (auto it = mRequests.begin(); it != mRequests.end();) {
+    if (it->buffer == buffer) {
+      mStats.bytesQueued -= it->size - it->copied;
+      it = mRequests.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  UpdateCompleted();
+}
+
+size_t StagingUploader::Copy(size_t budget) {
+  if (mRing == 0) {
+    mRingSize = std::max<size_t>(mSettings.stagingBytes, 1);
+    glGenBuffers(1, &mRing);
+    glBindBuffer(GL_COPY_READ_BUFFER, mRing);
+    glBufferData(GL_COPY_READ_BUFFER, mRingSize, nullptr, GL_STREAM_DRAW);
+    MemoryTracker::Allocated(MemoryCategory::MeshGpu, mRingSize);
+  }
+
+  size_t copied = 0;
+  while (!mRequests.empty() && copied < budget) {
+    Request &request = mRequests.front();
+    size_t size = std::min({request.size - request.copied, budget - copied,
+                            mRingSize});
+    size_t ringOffset = Reserve(size);
+
+    // COPY_READ/COPY_WRITE leave the array and element bindings (and with
+    // them any bound VAO) untouched
+    glBindBuffer(GL_COPY_READ_BUFFER, mRing);
+    void *staging = glMapBufferRange(
+        GL_COPY_READ_BUFFER, ringOffset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!staging) {
+      std::cerr << "[StagingUploader] Failed to map the staging buffer"
+                << std::endl;
+      break;
+    }
+    std::memcpy(staging, request.data + request.copied, size);
+    if (glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_FALSE) {
+      // storage was lost while mapped, the range is written again next time
+      break;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, request.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ringOffset,
+                        request.offset + request.copied, size);
+    mSegments.push_back({ringOffset, ringOffset + size,
+                         glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+    mHead = ringOffset + size;
+
+    request.copied += size;
+    copied += size;
+    ++mStats.copies;
+    if (request.copied == request.size) {
+      mRequests.pop_front();
+      UpdateCompleted();
+    }
+  }
+
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  mStats.bytesUploaded += copied;
+  mStats.bytesQueued -= copied;
+  return copied;
+}
+
+size_t StagingUploader::Reserve(size_t size) {
+  size_t begin = mHead + size <= mRingSize ? mHead : 0;
+  size_t end = begin + size;
+
+  auto overlaps = [&] {
+    return std::any_of(mSegments.begin(), mSegments.end(),
+                       [&](const Segment &segment) {
+                         return segment.begin < end && begin < segment.end;
+                       });
+  };
+  if (overlaps()) {
+    RetireSegments();
+    if (overlaps()) {
+      // the driver keeps the old storage alive for the copies reading it
+      glBindBuffer(GL_COPY_READ_BUFFER, mRing);
+      glBufferData(GL_COPY_READ_BUFFER, mRingSize, nullptr, GL_STREAM_DRAW);
+      for (const Segment &segment : mSegments)
+        glDeleteSync(segment.fence);
+      mSegments.clear();
+      ++mStats.orphans;
+      return 0;
+    }
+  }
+  return begin;
+}
+
+void StagingUploader::RetireSegments() {
+  while (!mSegments.empty()) {
+    GLenum status = glClientWaitSync(mSegments.front().fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      break;
+    glDeleteSync(mSegments.front().fence);
+    mSegments.pop_front();
+  }
+}
+
+void StagingUploader::ReleaseRing() {
+  for (const Segment &segment : mSegments)
+    glDeleteSync(segment.fence);
+  mSegments.clear();
+  if (mRing != 0) {
+    glDeleteBuffers(1, &mRing);
+    MemoryTracker::Freed(MemoryCategory::MeshGpu, mRingSize);
+  }
+  mRing = 0;
+  mRingSize = 0;
+  mHead = 0;
+}
+
+void StagingUploader::UpdateCompleted() {
+  mCompleted =
+      mRequests.empty() ? mNextTicket - 1 : mRequests.front().ticket - 1;
+}
@@ -0,0 +1,256 @@
+#include "render/VertexFormat.h"
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "render/Mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+std::uint16_t FloatToHalf(float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  std::uint32_t sign = (bits >> 16) & 0x8000u;
+  std::int32_t exponent = static_cast<std::int32_t>((bits >> 23) & 0xffu) - 112;
+  std::uint32_t mantissa = bits & 0x7fffffu;
+
+  if (exponent <= 0) {
+    // too small for a normal half, flush to a signed zero
+    return static_cast<std::uint16_t>(sign);
+  }
+  if (exponent >= 31) {
+    // overflow (and NaN/inf) saturates to infinity
+    return static_cast<std::uint16_t>(sign | 0x7c00u);
+  }
+
+  // round to nearest, the carry may bump the exponent which is still correct
+  std::uint32_t half = sign | (std::uint32_t(exponent) << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000u)
+    ++half;
+  return static_cast<std::uint16_t>(half);
+}
+
+std::int16_t ToSnorm16(float value) {
+  return static_cast<std::int16_t>(
+      std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+std::uint16_t ToUnorm16(float value) {
+  return static_cast<std::uint16_t>(
+      std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+std::uint32_t PackInt2_10_10_10(const glm::vec3 &n) {
+  auto component = [](float v) -> std::uint32_t {
+    return static_cast<std::uint32_t>(
+               std::lround(std::clamp(v, -1.0f, 1.0f) * 511.0f)) &
+           0x3ffu;
+  };
+  return component(n.x) | (component(n.y) << 10) | (component(n.z) << 20);
+}
+
+// Cigolle et al., "A Survey of Efficient Representations for Independent
+// Unit Vectors"; decoded by DecodeOctahedral in default.vert
+void EncodeOctahedral(glm::vec3 n, std::int16_t out[2]) {
+  float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  if (l1 == 0.0f) {
+    out[0] = out[1] = 0;
+    return;
+  }
+  n /= l1;
+
+  float u = n.x, v = n.y;
+  if (n.z < 0.0f) {
+    u = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+    v = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  out[0] = ToSnorm16(u);
+  out[1] = ToSnorm16(v);
+}
+
+GLsizei PositionSize(PositionEncoding encoding) {
+  return encoding == PositionEncoding::Float32 ? 12 : 8;
+}
+
+} // namespace
+
+VertexFormat::VertexFormat(const VertexLayout &layout) : mLayout(layout) {
+  GLuint offset = 0;
+
+  switch (layout.position) {
+  case PositionEncoding::Float32:
+    mAttributes.push_back({0, 3, GL_FLOAT, GL_FALSE, offset});
+    break;
+  case PositionEncoding::Half:
+    mAttributes.push_back({0, 4, GL_HALF_FLOAT, GL_FALSE, offset});
+    break;
+  case PositionEncoding::Snorm16:
+    mAttributes.push_back({0, 4, GL_SHORT, GL_TRUE, offset});
+    break;
+  }
+  offset += PositionSize(layout.position);
+  mPositionStride = PositionSize(layout.position);
+
+  switch (layout.normal) {
+  case NormalEncoding::None:
+    break;
+  case NormalEncoding::Float32:
+    mAttributes.push_back({1, 3, GL_FLOAT, GL_FALSE, offset});
+    offset += 12;
+    break;
+  case NormalEncoding::Int2_10_10_10:
+    mAttributes.push_back({1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offset});
+    offset += 4;
+    break;
+  case NormalEncoding::Octahedral16:
+    mAttributes.push_back({1, 2, GL_SHORT, GL_TRUE, offset});
+    offset += 4;
+    break;
+  }
+
+  switch (layout.texCoord) {
+  case TexCoordEncoding::None:
+    break;
+  case TexCoordEncoding::Float32:
+    mAttributes.push_back({2, 2, GL_FLOAT, GL_FALSE, offset});
+    offset += 8;
+    break;
+  case TexCoordEncoding::Half:
+    mAttributes.push_back({2, 2, GL_HALF_FLOAT, GL_FALSE, offset});
+    offset += 4;
+    break;
+  case TexCoordEncoding::Unorm16:
+    mAttributes.push_back({2, 2, GL_UNSIGNED_SHORT, GL_TRUE, offset});
+    offset += 4;
+    break;
+  }
+
+  mStride = static_cast<GLsizei>(offset);
+}
+
+void VertexFormat::Apply() const {
+  for (const auto &attribute : mAttributes) {
+    glVertexAttribPointer(attribute.location, attribute.components,
+                          attribute.type, attribute.normalized, mStride,
+                          (void *)(size_t)attribute.offset);
+    glEnableVertexAttribArray(attribute.location);
+  }
+}
+
+void VertexFormat::ApplyPositionOnly() const {
+  const auto &position = mAttributes[0];
+  glVertexAttribPointer(0, position.components, position.type,
+                        position.normalized, mPositionStride, (void *)0);
+  glEnableVertexAttribArray(0);
+}
+
+Dequantization
+VertexFormat::ComputeDequantization(const std::vector<Vertex> &vertices) const {
+  Dequantization dq;
+  if (mLayout.position == PositionEncoding::Float32 || vertices.empty())
+    return dq;
+
+  glm::vec3 min = vertices[0].position, max = vertices[0].position;
+  for (const auto &vertex : vertices) {
+    min = glm::min(min, vertex.position);
+    max = glm::max(max, vertex.position);
+  }
+
+  glm::vec3 extent = (max - min) * 0.5f;
+  dq.offset = (min + max) * 0.5f;
+  dq.scale = std::max({extent.x, extent.y, extent.z});
+  if (dq.scale <= 0.0f)
+    dq.scale = 1.0f;
+  return dq;
+}
+
+void VertexFormat::EncodePositions(const std::vector<Vertex> &vertices,
+                                   const Dequantization &dq,
+                                   std::vector<std::uint8_t> &out) const {
+  out.resize(vertices.size() * mPositionStride);
+  std::uint8_t *dst = out.data();
+
+  for (const auto &vertex : vertices) {
+    glm::vec3 p = (vertex.position - dq.offset) / dq.scale;
+    switch (mLayout.position) {
+    case PositionEncoding::Float32:
+      std::memcpy(dst, &p, 12);
+      break;
+    case PositionEncoding::Half: {
+      std::uint16_t h[4] = {FloatToHalf(p.x), FloatToHalf(p.y),
+                            FloatToHalf(p.z), FloatToHalf(1.0f)};
+      std::memcpy(dst, h, sizeof(h));
+      break;
+    }
+    case PositionEncoding::Snorm16: {
+      std::int16_t s[4] = {ToSnorm16(p.x), ToSnorm16(p.y), ToSnorm16(p.z),
+                           32767};
+      std::memcpy(dst, s, sizeof(s));
+      break;
+    }
+    }
+    dst += mPositionStride;
+  }
+}
+
+void VertexFormat::Encode(const std::vector<Vertex> &vertices,
+                          const Dequantization &dq,
+                          std::vector<std::uint8_t> &out) const {
+  std::vector<std::uint8_t> positions;
+  EncodePositions(vertices, dq, positions);
+
+  out.assign(vertices.size() * mStride, 0);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const Vertex &vertex = vertices[i];
+    std::uint8_t *dst = out.data() + i * mStride;
+    std::memcpy(dst, positions.data() + i * mPositionStride, mPositionStride);
+
+    for (size_t a = 1; a < mAttributes.size(); ++a) {
+      const VertexAttribute &attribute = mAttributes[a];
+      std::uint8_t *field = dst + attribute.offset;
+
+      if (attribute.location == 1) {
+        switch (mLayout.normal) {
+        case NormalEncoding::Float32:
+          std::memcpy(field, &vertex.normal, 12);
+          break;
+        case NormalEncoding::Int2_10_10_10: {
+          std::uint32_t packed = PackInt2_10_10_10(vertex.normal);
+          std::memcpy(field, &packed, sizeof(packed));
+          break;
+        }
+        case NormalEncoding::Octahedral16: {
+          std::int16_t oct[2];
+          EncodeOctahedral(vertex.normal, oct);
+          std::memcpy(field, oct, sizeof(oct));
+          break;
+        }
+        case NormalEncoding::None:
+          break;
+        }
+      } else {
+        switch (mLayout.texCoord) {
+        case TexCoordEncoding::Float32:
+          std::memcpy(field, &vertex.texCoord, 8);
+          break;
+        case TexCoordEncoding::Half: {
+          std::uint16_t h[2] = {FloatToHalf(vertex.texCoord.x),
+                                FloatToHalf(vertex.texCoord.y)};
+          std::memcpy(field, h, sizeof(h));
+          break;
+        }
+        case TexCoordEncoding::Unorm16: {
+          std::uint16_t u[2] = {ToUnorm16(vertex.texCoord.x),
+                                ToUnorm16(vertex.texCoord.y)};
+          std::memcpy(field, u, sizeof(u));
+          break;
+        }
+        case TexCoordEncoding::None:
+          break;
+        }
+      }
+    }
+  }
+}
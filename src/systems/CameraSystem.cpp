@@ -28,13 +28,16 @@ void CameraSystem::Update(Coordinator &coordinator, float deltaTime) {
                  camera.mDistance * cos(camera.mPitch) * cos(camera.mYaw);
 
     auto &transform = coordinator.GetComponent<TransformComponent>(entity);
+    glm::vec3 rotation(camera.mPitch, camera.mYaw, 0.0f);
+    // the yaw moves the rotation too, so this covers auto rotation
+    if (transform.mPosition != position || transform.mRotation != rotation)
+      coordinator.MarkChanged(entity);
     transform.mPosition = position;
-    transform.mRotation = glm::vec3(camera.mPitch, camera.mYaw, 0.0f);
+    transform.mRotation = rotation;
   }
 }
-void CameraSystem::UploadToUBO(Coordinator &coordinator,
-                               UniformBufferManager &uboManager,
-                               float aspectRatio) {
+bool CameraSystem::BuildUBO(Coordinator &coordinator, float aspectRatio,
+                            CameraUBO &data) {
   for (auto const &entity : mEntities) {
     auto &camera = coordinator.GetComponent<CameraComponent>(entity);
     if (!camera.mActive)
@@ -42,22 +45,37 @@ void CameraSystem::UploadToUBO(Coordinator &coordinator,
 
     auto &transform = coordinator.GetComponent<TransformComponent>(entity);
 
-    CameraUBO data{};
+    data = {};
     data.view = glm::lookAt(transform.mPosition, camera.mTarget,
                             glm::vec3(0.0f, 1.0f, 0.0f));
 
     data.projection = glm::perspective(glm::radians(camera.mFov), aspectRatio,
                                        camera.mNearPlane, camera.mFarPlane);
     data.cameraPos = transform.mPosition;
-    uboManager.UpdateUBO("Camera", data);
-    break;
+    return true;
   }
+  return false;
 }
 
 void CameraSystem::ToggleCamera(Coordinator &coordinator) {
   for (auto const &entity : mEntities) {
     auto &camera = coordinator.GetComponent<CameraComponent>(entity);
     camera.mAutoRotate = !camera.mAutoRotate;
+    coordinator.MarkChanged(entity);
     break;
   }
 }
+
+bool CameraSystem::GetActiveView(Coordinator &coordinator, glm::vec3 &position,
+                                 float &fovY) {
+  for (auto const &entity : mEntities) {
+    auto &camera = coordinator.GetComponent<CameraComponent>(entity);
+    if (!camera.mActive)
+      continue;
+
+    position = coordinator.GetComponent<TransformComponent>(entity).mPosition;
+    fovY = glm::radians(camera.mFov);
+    return true;
+  }
+  return false;
+}
@@ -4,8 +4,8 @@
 #include "render/uniforms/DirectionalLightUBO.h"
 
 void DirectionalLightSystem::Update(Coordinator &coordinator,
-                                    UniformBufferManager &uboManager) {
-  DirectionalLightUBO uboData{};
+                                    DirectionalLightUBO &uboData) {
+  uboData = {};
 
   int i = 0;
   for (auto it = mEntities.begin();
@@ -20,5 +20,4 @@ void DirectionalLightSystem::Update(Coordinator &coordinator,
   }
 
   uboData.size = i;
-  uboManager.UpdateUBO("DirectionalLight", uboData);
 }
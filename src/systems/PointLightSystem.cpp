@@ -3,8 +3,8 @@
 #include "render/uniforms/PointLightUBO.h"
 
 void PointLightSystem::Update(Coordinator &coordinator,
-                              UniformBufferManager &uboManager) {
-  PointLightUBO uboData{};
+                              PointLightUBO &uboData) {
+  uboData = {};
 
   int i = 0;
   for (auto it = mEntities.begin();
@@ -25,5 +25,4 @@ void PointLightSystem::Update(Coordinator &coordinator,
   }
   
   uboData.size = i;
-  uboManager.UpdateUBO("PointLight", uboData);
 }
@@ -1,17 +1,37 @@
 #include "systems/RenderSystem.h"
 #include "components/MaterialComponent.h"
 #include "components/TransformComponent.h"
+#include "core/Profiler.h"
 #include "ecs/Coordinator.h"
 #include "glm/ext/matrix_float4x4.hpp"
 #include "glm/ext/matrix_transform.hpp"
 #include "glm/fwd.hpp"
+#include "glm/geometric.hpp"
+#include "glm/vec4.hpp"
 #include "managers/ResourceContext.h"
 #include "managers/UniformBufferManager.h"
 #include "render/uniforms/MaterialUBO.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <memory>
 
-glm::mat4 RenderSystem::GetTransformMatrix(TransformComponent transform) {
+namespace {
+
+constexpr UniformName U_MODEL = HashUniformName("uModel");
+constexpr UniformName U_OCTAHEDRAL_NORMALS =
+    HashUniformName("uOctahedralNormals");
+constexpr UniformName U_OBJECT_COLOR = HashUniformName("uObjectColor");
+
+} // namespace
+
+RenderSystem::~RenderSystem() {
+  if (mQueries[0][0] != 0)
+    glDeleteQueries(4, &mQueries[0][0]);
+}
+
+glm::mat4
+RenderSystem::GetTransformMatrix(TransformComponent transform) const {
   glm::mat4 model(1.0f);
   model = glm::translate(model, transform.mPosition);
   model = glm::rotate(model, transform.mRotation.x, glm::vec3(1, 0, 0));
@@ -28,34 +48,205 @@ void RenderSystem::SetMaterial(UniformBufferManager &uboManager,
   data.diffuse = material.diffuse;
   data.specular = material.specular;
   data.shininess = material.shininess;
-  uboManager.UpdateUBO("Material", data);
+  if (mMaterialUBO == 0)
+    mMaterialUBO = uboManager.GetUBO("Material");
+  uboManager.UpdateUBO(mMaterialUBO, data);
 }
 
-void RenderSystem::Update(Coordinator &coordinator, ResourceContext &resources,
-                          UniformBufferManager &uboManager) {
+void RenderSystem::ReadQueries() {
+  if (mQueries[0][0] == 0) {
+    glGenQueries(4, &mQueries[0][0]);
+    return;
+  }
+
+  // results of the previous frame, skipped rather than waited for
+  int frame = mQueryFrame ^ 1;
+  if (!mQueryPending[frame][1])
+    return;
+
+  GLuint results[2] = {0, 0};
+  for (int pass = 0; pass < 2; ++pass) {
+    if (!mQueryPending[frame][pass])
+      continue;
 
+    GLuint available = 0;
+    glGetQueryObjectuiv(mQueries[frame][pass], GL_QUERY_RESULT_AVAILABLE,
+                        &available);
+    if (!available)
+      return;
+    glGetQueryObjectuiv(mQueries[frame][pass], GL_QUERY_RESULT,
+                        &results[pass]);
+  }
+
+  mQueryPending[frame][0] = mQueryPending[frame][1] = false;
+  mStats.depthFragments = results[0];
+  mStats.shadedFragments = results[1];
+}
+
+size_t RenderSystem::SelectLod(const RenderPacket &packet,
+                               const RenderItem &item, const MeshInfo &mesh) {
+  size_t maxLod = std::min<size_t>(mesh.lodCount - 1,
+                                   mLodSelection.screenSizes.size());
+  if (maxLod == 0 || packet.cameraFovY <= 0.0f)
+    return 0;
+
+  glm::vec3 center =
+      glm::vec3(item.model * glm::vec4(mesh.boundsCenter, 1.0f));
+  const glm::vec3 &scale = item.scale;
+  float radius = mesh.boundsRadius *
+                 std::max({std::abs(scale.x), std::abs(scale.y),
+                           std::abs(scale.z)});
+  float distance = glm::length(center - packet.cameraPosition);
+  if (distance <= radius)
+    return 0;
+
+  float screenSize =
+      radius / (distance * std::tan(packet.cameraFovY * 0.5f));
+
+  const auto &thresholds = mLodSelection.screenSizes;
+  const float h = mLodSelection.hysteresis;
+  size_t lod = std::min<size_t>(mEntityLod[item.entity], maxLod);
+  while (lod < maxLod && screenSize < thresholds[lod] * (1.0f - h))
+    ++lod;
+  while (lod > 0 && screenSize > thresholds[lod - 1] * (1.0f + h))
+    --lod;
+
+  mEntityLod[item.entity] = static_cast<uint8_t>(lod);
+  return lod;
+}
+
+void RenderSystem::Extract(Coordinator &coordinator,
+                           RenderPacket &packet) const {
+  packet.cameraPosition = mCameraPosition;
+  packet.cameraFovY = mCameraFovY;
+  packet.depthPrepass = mDepthPrepass;
+  packet.items.clear();
   for (auto const &entity : mEntities) {
     auto &meshComponent = coordinator.GetComponent<MeshComponent>(entity);
-    auto &shaderComponent = coordinator.GetComponent<ShaderComponent>(entity);
     auto &transformComponent =
         coordinator.GetComponent<TransformComponent>(entity);
+    auto &shaderComponent = coordinator.GetComponent<ShaderComponent>(entity);
+
+    RenderItem item{};
+    item.entity = entity;
+    item.mesh = meshComponent.mId;
+    item.shader = shaderComponent.mId;
+    item.objectColor = shaderComponent.mObjectColor;
+    item.model = GetTransformMatrix(transformComponent);
+    item.scale = transformComponent.mScale;
+    item.hasMaterial = coordinator.HasComponent<MaterialComponent>(entity);
+    if (item.hasMaterial)
+      item.material = coordinator.GetComponent<MaterialComponent>(entity);
+    packet.items.push_back(item);
+  }
+}
+
+void RenderSystem::BuildDrawList(const RenderPacket &packet,
+                                 ResourceContext &resources) {
+  // items are in entity order, the last one has the highest id
+  if (!packet.items.empty() &&
+      mEntityLod.size() <= packet.items.back().entity)
+    mEntityLod.resize(packet.items.back().entity + 1, 0);
+
+  mDrawList.clear();
+  mFrameStats = {};
+  for (const RenderItem &item : packet.items) {
+    const MeshInfo *info = resources.meshes->GetInfo(item.mesh);
+    if (!info)
+      continue;
+    Mesh *mesh = info->mesh;
+    size_t lod = SelectLod(packet, item, *info);
+
+    mDrawList.push_back(
+        {&item, mesh, lod, item.model * mesh->GetDequantizeMatrix()});
+    mFrameStats.drawCalls++;
+    mFrameStats.triangles += mesh->GetTriangleCount(lod);
+    mFrameStats.trianglesFullDetail += info->indexCount / 3;
+    mFrameStats.vertexBytes += mesh->GetVertexCount(lod) * info->vertexStride;
+    mFrameStats.vertexBytesFullPrecision +=
+        mesh->GetVertexCount(lod) * sizeof(Vertex);
+  }
+}
 
-    resources.shaders->BindShader(shaderComponent.mId);
-    if (coordinator.HasComponent<MaterialComponent>(entity)) {
-      auto &material = coordinator.GetComponent<MaterialComponent>(entity);
-      SetMaterial(uboManager, material);
-    }
+void RenderSystem::DepthPrepass(ResourceContext &resources) {
+  if (mDepthShader == 0) {
+    mDepthShader = resources.shaders->LoadShader(
+        "resources/shaders/depth.frag", "resources/shaders/depth.vert");
+  }
+
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_TRUE);
+  glDepthFunc(GL_LESS);
+
+  glBeginQuery(GL_SAMPLES_PASSED, mQueries[mQueryFrame][0]);
+  resources.shaders->BindShader(mDepthShader);
+  for (const DrawItem &item : mDrawList) {
+    resources.shaders->SetMat4(mDepthShader, U_MODEL, item.model);
+    item.mesh->DrawDepth(item.lod);
+  }
+  resources.shaders->UnbindShader();
+  glEndQuery(GL_SAMPLES_PASSED);
+  mQueryPending[mQueryFrame][0] = true;
+
+  // main pass only shades the fragments that won the depth test
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glDepthMask(GL_FALSE);
+  glDepthFunc(GL_EQUAL);
+}
+
+void RenderSystem::Submit(const RenderPacket &packet,
+                          ResourceContext &resources,
+                          UniformBufferManager &uboManager) {
+  {
+    PROFILE_SCOPE("ReadQueries");
+    ReadQueries();
+  }
+  // LODs are picked once so both passes rasterize identical geometry
+  {
+    PROFILE_SCOPE("BuildDrawList");
+    BuildDrawList(packet, resources);
+  }
+
+  if (packet.depthPrepass) {
+    PROFILE_SCOPE("DepthPrepass");
+    if (mGpuProfiler)
+      mGpuProfiler->Begin("depth prepass");
+    DepthPrepass(resources);
+    if (mGpuProfiler)
+      mGpuProfiler->End();
+  }
+
+  PROFILE_SCOPE("MainPass");
+  if (mGpuProfiler)
+    mGpuProfiler->Begin("main pass");
+  glBeginQuery(GL_SAMPLES_PASSED, mQueries[mQueryFrame][1]);
+  for (const DrawItem &item : mDrawList) {
+    ShaderId shader = item.item->shader;
+
+    resources.shaders->BindShader(shader);
+    if (item.item->hasMaterial)
+      SetMaterial(uboManager, item.item->material);
     // ====== VERTEX SHADER ======
-    resources.shaders->SetMat4(shaderComponent.mId, "uModel",
-                               GetTransformMatrix(transformComponent));
+    resources.shaders->SetMat4(shader, U_MODEL, item.model);
+    resources.shaders->SetInt(
+        shader, U_OCTAHEDRAL_NORMALS,
+        item.mesh->GetVertexFormat().GetLayout().normal ==
+            NormalEncoding::Octahedral16);
 
     // ====== FRAG SHADER ==============
-    resources.shaders->SetVec3(shaderComponent.mId, "uObjectColor",
-                               shaderComponent.mObjectColor);
-
-    auto mesh = resources.meshes->GetMesh(meshComponent.mId);
+    resources.shaders->SetVec3(shader, U_OBJECT_COLOR, item.item->objectColor);
 
-    mesh->Draw();
+    item.mesh->Draw(item.lod);
     resources.shaders->UnbindShader();
   }
+  glEndQuery(GL_SAMPLES_PASSED);
+  mQueryPending[mQueryFrame][1] = true;
+  if (mGpuProfiler)
+    mGpuProfiler->End();
+
+  if (packet.depthPrepass) {
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+  }
+  mQueryFrame ^= 1;
 }
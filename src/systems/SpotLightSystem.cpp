@@ -3,8 +3,8 @@
 #include <iostream>
 
 void SpotLightSystem::Update(Coordinator &coordinator,
-                         UniformBufferManager &uboManager) {
-  SpotLightUBO uboData{};
+                             SpotLightUBO &uboData) {
+  uboData = {};
 
   int i = 0;
   for (auto it = mEntities.begin();
@@ -29,5 +29,4 @@ void SpotLightSystem::Update(Coordinator &coordinator,
     i++;
   }
   uboData.size = i;
-  uboManager.UpdateUBO("SpotLight", uboData);
 }